@@ -14,12 +14,144 @@
 #include <type_traits>
 #include <iomanip>
 #include <iostream>
+#include <cstring>
+#include <utility>
+#include <regex>
+#include <unordered_map>
+#include <mutex>
+#include <cstdio>
+#include <fstream>
+#include <chrono>
+#include <cstdint>
+#include <numeric>
+#include <map>
+#include <limits>
+#include <thread>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <iterator>
+#include <deque>
+#include <set>
+#include <fcntl.h>
 
 #ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
 #include <windows.h>
+#include <process.h>
+#include <io.h>
 #else
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define Q_TEST__HAS_BACKTRACE
+#endif
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#if defined(__GLIBC__) && defined(__linux__)
+#include <dlfcn.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#define Q_TEST__HAS_REALTIME_HOOKS
+#endif
+
+#if defined(Q_TEST__HAS_BACKTRACE) && defined(__linux__) && defined(__GLIBC__)
+#include <signal.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#define Q_TEST__HAS_PROFILER
+#endif
+
+#if defined(__GNUC__) && defined(__linux__) && defined(__GLIBC__)
+#include <dlfcn.h>
+#include <fcntl.h>
 #include <unistd.h>
+#define Q_TEST__HAS_IMPACT
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define Q_TEST__HAS_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifndef TEST_BENCHMARK_MIN_TIME_MS
+#define TEST_BENCHMARK_MIN_TIME_MS 10
+#endif
+
+#ifndef TEST_BENCHMARK_WARMUP_MS
+#define TEST_BENCHMARK_WARMUP_MS 10
+#endif
+
+#ifndef TEST_BENCHMARK_SAMPLES
+#define TEST_BENCHMARK_SAMPLES 10
+#endif
+#ifndef TEST_BENCHMARK_TOLERANCE
+#define TEST_BENCHMARK_TOLERANCE 0.1
+#endif
+#ifndef TEST_BENCHMARK_ALPHA
+#define TEST_BENCHMARK_ALPHA 0.05
+#endif
+#ifndef TEST_COMPLEXITY_BUDGET_MS
+#define TEST_COMPLEXITY_BUDGET_MS 500
+#endif
+#ifndef TEST_COMPLEXITY_MIN_N
+#define TEST_COMPLEXITY_MIN_N 256
+#endif
+#ifndef TEST_COMPLEXITY_MAX_N
+#define TEST_COMPLEXITY_MAX_N (1 << 20)
+#endif
+#ifndef TEST_COMPLEXITY_MIN_POINTS
+#define TEST_COMPLEXITY_MIN_POINTS 4
+#endif
+#ifndef TEST_SCALING_TIME_MS
+#define TEST_SCALING_TIME_MS 50
+#endif
+#ifndef TEST_PROFILE_HZ
+#define TEST_PROFILE_HZ 1000
+#endif
+#ifndef TEST_JOURNAL_SYNC_COUNT
+#define TEST_JOURNAL_SYNC_COUNT 32
+#endif
+#ifndef TEST_JOURNAL_SYNC_MS
+#define TEST_JOURNAL_SYNC_MS 1000
+#endif
+#if (defined(TEST_FAILED_FIRST) || defined(TEST_FAILED_ONLY)) && !defined(TEST_FAILED_STATE)
+#define TEST_FAILED_STATE ".qtest_failed"
+#endif
+#ifndef TEST_LOCK_PROFILE_TOP
+#define TEST_LOCK_PROFILE_TOP 3
+#endif
+
+#if (defined(TEST_LOCK_PROFILE) || defined(TEST_REALTIME_SAFETY)) && defined(Q_TEST__HAS_REALTIME_HOOKS)
+#define Q_TEST__HAS_LOCK_HOOKS
 #endif
 
 #define QTEST_TEST_PARAM_ID 0
@@ -34,6 +166,7 @@
 #define Q_TEST__UNIQ_NAME() Q_TEST__UNIQ_NAME_GENERATE(Q___TEST___U_N_I_Q___)
 #define Q_TEST__LAMBDA(...) [Q_TEST__SCOPE]()__VA_ARGS__
 #define Q_TEST__LAMBDA_CALLBACK(...) [Q_TEST__SCOPE](auto callback){ do __VA_ARGS__ while((callback(), false)); }
+#define Q_TEST__TYPED_LAMBDA_CALLBACK(...) [Q_TEST__SCOPE](auto type_tag, auto callback){ using TypeParam [[maybe_unused]] = typename decltype(type_tag)::type; do __VA_ARGS__ while((callback(), false)); }
 #define Q_TEST__TEST_UNIT inline static Q_TEST_NS_DETAIL::QTestScenario Q_TEST__UNIQ_NAME()
 #define Q_TEST__RETURN_IF_FALSE(...) for (int _some_val_=1,_result_val_=1;;) if (!_some_val_--) { if (!_result_val_) return; break; } else _result_val_ = __VA_ARGS__
 
@@ -41,6 +174,10 @@
 #define DESCRIBE(a, ...) Q_TEST_NS_DETAIL::BASE.describe(a, Q_TEST__LAMBDA_CALLBACK(__VA_ARGS__), QTEST_TEST_PARAM_ID, __FILE__)
 #define DESCRIBE_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.describe(a, Q_TEST__LAMBDA_CALLBACK(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __FILE__)
 #define DESCRIBE_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.describe(a, Q_TEST__LAMBDA_CALLBACK(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __FILE__)
+#define DESCRIBE_TYPES(a, types, ...) Q_TEST_NS_DETAIL::BASE.describe_types(a, types{}, Q_TEST__TYPED_LAMBDA_CALLBACK(__VA_ARGS__), QTEST_TEST_PARAM_ID, __FILE__)
+#define DESCRIBE_TYPES_ONLY(a, types, ...) Q_TEST_NS_DETAIL::BASE.describe_types(a, types{}, Q_TEST__TYPED_LAMBDA_CALLBACK(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __FILE__)
+#define DESCRIBE_TYPES_SKIP(a, types, ...) Q_TEST_NS_DETAIL::BASE.describe_types(a, types{}, Q_TEST__TYPED_LAMBDA_CALLBACK(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __FILE__)
+#define TYPE_LIST(...) Q_TEST_NS_DETAIL::TypeList<__VA_ARGS__>
 #define BEFORE_ALL(...) Q_TEST_NS_DETAIL::BASE.before(Q_TEST__LAMBDA(__VA_ARGS__))
 #define BEFORE_EACH(...) Q_TEST_NS_DETAIL::BASE.before_each(Q_TEST__LAMBDA(__VA_ARGS__))
 #define AFTER_ALL(...) Q_TEST_NS_DETAIL::BASE.after(Q_TEST__LAMBDA(__VA_ARGS__))
@@ -48,9 +185,36 @@
 #define IT(a, ...) Q_TEST_NS_DETAIL::BASE.it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_TEST_PARAM_ID, __LINE__)
 #define IT_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __LINE__)
 #define IT_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __LINE__)
+#define IT_EACH(table, a, ...) Q_TEST_NS_DETAIL::BASE.it_each(table, a, __VA_ARGS__, QTEST_TEST_PARAM_ID, __LINE__)
+#define IT_EACH_ONLY(table, a, ...) Q_TEST_NS_DETAIL::BASE.it_each(table, a, __VA_ARGS__, QTEST_ONLY_PARAM_ID, __LINE__)
+#define IT_EACH_SKIP(table, a, ...) Q_TEST_NS_DETAIL::BASE.it_each(table, a, __VA_ARGS__, QTEST_SKIP_PARAM_ID, __LINE__)
+#define BENCHMARK(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_TEST_PARAM_ID, __LINE__)
+#define BENCHMARK_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __LINE__)
+#define BENCHMARK_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __LINE__)
+#define BENCHMARK_COMPARE(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark_compare(a, __VA_ARGS__, QTEST_TEST_PARAM_ID, __LINE__)
+#define BENCHMARK_COMPARE_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark_compare(a, __VA_ARGS__, QTEST_ONLY_PARAM_ID, __LINE__)
+#define BENCHMARK_COMPARE_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark_compare(a, __VA_ARGS__, QTEST_SKIP_PARAM_ID, __LINE__)
+#define BENCHMARK_BYTES(a) Q_TEST_NS_DETAIL::BASE.benchmark_bytes(a)
+#define BENCHMARK_ITEMS(a) Q_TEST_NS_DETAIL::BASE.benchmark_items(a)
+#define DO_NOT_OPTIMIZE(a) Q_TEST_NS_DETAIL::do_not_optimize(a)
+#define CLOBBER_MEMORY() Q_TEST_NS_DETAIL::clobber_memory()
+#define STATIC_IT(a, ...) Q_TEST_NS_DETAIL::BASE.static_it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_TEST_PARAM_ID, __LINE__)
+#define STATIC_IT_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.static_it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __LINE__)
+#define STATIC_IT_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.static_it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __LINE__)
 #define EXPECT(a) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect((a), Q_TEST__STRINGIFY(a)))
+#define EXPECT_LATENCY(...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect_latency(#__VA_ARGS__, __VA_ARGS__))
+#define EXPECT_SCALING(...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect_scaling(#__VA_ARGS__, __VA_ARGS__))
+#define EXPECT_REALTIME_SAFE(...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect_realtime_safe(#__VA_ARGS__, Q_TEST__LAMBDA(__VA_ARGS__)))
+#define EXPECT_LOCK_CONTENTION(...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect_lock_contention(#__VA_ARGS__, Q_TEST__LAMBDA(__VA_ARGS__)))
+#define STRESS(threads, amount, ...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.stress(threads, amount, Q_TEST__LAMBDA(__VA_ARGS__)))
+#define STRESS_THREAD() Q_TEST_NS_DETAIL::stress_thread
+#define PERF_COUNTERS(...) Q_TEST_NS_DETAIL::measure_perf_counters(Q_TEST__LAMBDA(__VA_ARGS__))
+#define RESOURCE_USAGE(...) Q_TEST_NS_DETAIL::measure_resource_usage(Q_TEST__LAMBDA(__VA_ARGS__))
+#define TRACE_SPAN(a) Q_TEST_NS_DETAIL::TraceSpan Q_TEST__UNIQ_NAME()(a)
+#define ADD_REPORTER(a) Q_TEST_NS_DETAIL::BASE.add_reporter(a)
+#define CONSTEXPR_EXPECT(...) static_assert((__VA_ARGS__), "CONSTEXPR_EXPECT(" #__VA_ARGS__ ") FAILED!")
 #define INFO_PRINT(a) Q_TEST_NS_DETAIL::BASE.info_print(a)
-#define TEST_FAILED(a) EXPECT(std::string{a}).fail();
+#define TEST_FAILED(a) EXPECT(Q_TEST_NS_DETAIL::failure_message(a)).fail();
 #define TEST_SUCCEED() EXPECT(1).toBe(1)
 #define SCENARIO_START Q_TEST__TEST_UNIT ([]{ Q_TEST_NS_DETAIL::BASE.script([]{
 #define SCENARIO_END }); });
@@ -61,7 +225,9 @@ namespace Q_TEST_NS_DETAIL {
 struct ErrorReport {
 	std::string value = {};
 	std::string compare = {};
+	std::string hint = {};
 	std::string_view func = {};
+	std::string_view macro = {};
 	bool inverse = false;
 	bool has_compare = false;
 	bool value_substituted = false;
@@ -76,6 +242,49 @@ struct NonStreamable{};
 template <typename T>
 struct is_streamable<T, std::enable_if_t<std::is_convertible_v<decltype(std::declval<std::ostream &>() << std::declval<T>()),std::ostream &>>> : std::true_type {};
 
+class QTestMappedFile {
+	public:
+		QTestMappedFile(const std::string& path);
+		~QTestMappedFile();
+		QTestMappedFile(const QTestMappedFile&) = delete;
+		QTestMappedFile& operator=(const QTestMappedFile&) = delete;
+
+		bool is_open() { return opened; }
+		std::string_view view() { return std::string_view(data, size); }
+
+	private:
+		#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+		#else
+		int fd = -1;
+		#endif
+		const char* data = nullptr;
+		size_t size = 0;
+		bool opened = false;
+};
+
+struct SnapshotResult {
+	bool exists = false;
+	bool equal = false;
+	size_t offset = 0;
+	std::string hint = {};
+};
+
+enum class Complexity { O1, LogN, N, NLogN, N2 };
+
+struct ComplexityPoint {
+	double n = 0;
+	double ns = 0;
+};
+
+struct ComplexityFit {
+	Complexity best = Complexity::O1;
+	std::vector<ComplexityPoint> points = {};
+	double coefficients[5] = {};
+	double rms[5] = {};
+};
+
 template<typename T>
 class QTestExpect {
 	public:
@@ -97,129 +306,3117 @@ class QTestExpect {
 		template<typename E> bool toThrowError();
 		bool toReturnTrue();
 		template<typename V> bool toReturn(V&& compare);
+		template<typename C> bool toContain(C&& compare);
+		bool toStartWith(std::string_view compare);
+		bool toEndWith(std::string_view compare);
+		bool toMatch(std::string_view pattern);
+		bool toMatchSnapshot(const std::string& path);
+		bool toScaleAs(Complexity complexity);
 		QTestExpect<T> NOT();
 		bool fail();
 
-		bool to_be(T&& compare) { return toBe(std::move(compare)); }
-		bool to_be(T& compare) { return toBe(compare); }
-		template<typename C> bool to_be(C&& compare){ return toBe(std::move(compare)); }
-		bool to_be_close_to(T compare, T precision){ return toBeCloseTo(compare, precision); }
-		bool to_be_greater_than(T compare){ return toBeGreaterThan(compare); }
-		bool to_be_greater_than_or_equal(T compare){ return toBeGreaterThanOrEqual(compare); }
-		bool to_be_less_than(T compare){ return toBeLessThan(compare); }
-		bool to_be_less_than_or_equal(T compare){ return toBeLessThanOrEqual(compare); }
-		bool to_be_null(){ return toBeNull(); }
-		bool to_be_null_ptr(){ return toBeNullPtr(); }
-		template<typename CT> bool to_be_iterable_equal(CT&& compare){ return toBeIterableEqual(std::forward(compare)); }
-		template<typename CT> bool to_be_iterable_equal(std::initializer_list<CT> list){ return toBeIterableEqual(list); }
-		bool to_throw_error(){ return toThrowError(); }
-		template<typename E> bool to_throw_error(){ return toThrowError<E>(); }
-		bool to_return_true(){ return toReturnTrue(); }
-		template<typename V> bool to_return(V&& compare) { return toReturn(compare); }
+		bool to_be(T&& compare) { return toBe(std::move(compare)); }
+		bool to_be(T& compare) { return toBe(compare); }
+		template<typename C> bool to_be(C&& compare){ return toBe(std::move(compare)); }
+		bool to_be_close_to(T compare, T precision){ return toBeCloseTo(compare, precision); }
+		bool to_be_greater_than(T compare){ return toBeGreaterThan(compare); }
+		bool to_be_greater_than_or_equal(T compare){ return toBeGreaterThanOrEqual(compare); }
+		bool to_be_less_than(T compare){ return toBeLessThan(compare); }
+		bool to_be_less_than_or_equal(T compare){ return toBeLessThanOrEqual(compare); }
+		bool to_be_null(){ return toBeNull(); }
+		bool to_be_null_ptr(){ return toBeNullPtr(); }
+		template<typename CT> bool to_be_iterable_equal(CT&& compare){ return toBeIterableEqual(std::forward(compare)); }
+		template<typename CT> bool to_be_iterable_equal(std::initializer_list<CT> list){ return toBeIterableEqual(list); }
+		bool to_throw_error(){ return toThrowError(); }
+		template<typename E> bool to_throw_error(){ return toThrowError<E>(); }
+		bool to_return_true(){ return toReturnTrue(); }
+		template<typename V> bool to_return(V&& compare) { return toReturn(compare); }
+		template<typename C> bool to_contain(C&& compare) { return toContain(std::forward<C>(compare)); }
+		bool to_start_with(std::string_view compare) { return toStartWith(compare); }
+		bool to_end_with(std::string_view compare) { return toEndWith(compare); }
+		bool to_match(std::string_view pattern) { return toMatch(pattern); }
+		bool to_match_snapshot(const std::string& path) { return toMatchSnapshot(path); }
+		bool to_scale_as(Complexity complexity) { return toScaleAs(complexity); }
+
+	private:
+		bool proceed_result(bool result);
+		void report_error_resolved(std::string_view func, std::string_view value, std::string_view compare);
+		template<typename V, typename C> void report_error(std::string_view func, V&& value, C&& compare);
+		template<typename V> void report_error(std::string_view func, V&& value);
+		void report_string_error(std::string_view func, std::string_view value, std::string_view compare, std::string hint);
+		template<typename CT> std::string iterable_to_str(CT&& value);
+		template<typename CT> std::string streamable_to_str(CT&& value);
+
+		T val;
+		bool* result;
+		ErrorReport* error;
+		bool inv = false;
+};
+
+struct BenchmarkStats {
+	double mean = 0;
+	double median = 0;
+	double stddev = 0;
+	double min = 0;
+	uint64_t iterations = 0;
+	std::vector<double> samples = {};
+	uint64_t bytes = 0;
+	uint64_t items = 0;
+	double baseline = 0;
+};
+
+struct CompareStats {
+	BenchmarkStats baseline = {};
+	BenchmarkStats candidate = {};
+	double speedup = 0;
+	double speedup_low = 0;
+	double speedup_high = 0;
+	double p_value = 1;
+};
+
+struct BaselineEntry {
+	double median = 0;
+	double stddev = 0;
+	size_t samples = 0;
+};
+
+class QTestBaseline {
+	public:
+		QTestBaseline(std::string path);
+		BaselineEntry* find(const std::string& key);
+		void record(const std::string& key, BenchmarkStats& stats);
+		bool is_regression(BaselineEntry& entry, BenchmarkStats& stats);
+		void save();
+
+	private:
+		std::string path;
+		std::map<std::string, BaselineEntry> entries;
+		bool writable = false;
+		bool changed = false;
+};
+
+class QTestBenchmark {
+	using clock = std::chrono::steady_clock;
+
+	public:
+		QTestBenchmark(std::function<bool()> should_stop) : should_stop(should_stop) {}
+		template<typename F> BenchmarkStats run(F&& fn);
+		template<typename F, typename G> CompareStats compare(F& baseline, G& candidate);
+		template<typename F> double run_batch(F& fn, uint64_t iterations);
+		template<typename F> uint64_t calibrate(F& fn);
+
+		static BenchmarkStats calculate_stats(std::vector<double> samples);
+		static CompareStats calculate_comparison(std::vector<double> baseline, std::vector<double> candidate);
+
+	private:
+		std::function<bool()> should_stop;
+};
+
+struct RealtimeViolation {
+	const char* call = nullptr;
+	void* frames[8] = {};
+	int depth = 0;
+};
+
+class RealtimeScope {
+	static constexpr int max_violations = 8;
+
+	public:
+		template<typename F> void run(F&& fn);
+		RealtimeViolation* add(const char* call);
+		bool is_safe() { return !violations_count && !context_switches; }
+		int count() { return violations_count; }
+		RealtimeViolation& violation(int i) { return violations[i]; }
+		long blocked() { return context_switches; }
+
+	private:
+		RealtimeViolation violations[max_violations];
+		int violations_count = 0;
+		long context_switches = 0;
+};
+
+inline thread_local RealtimeScope* realtime_scope = nullptr;
+
+inline long voluntary_context_switches()
+{
+	#if defined(__linux__) && defined(RUSAGE_THREAD)
+	rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) == 0) return usage.ru_nvcsw;
+	#endif
+	return 0;
+}
+
+template<typename F>
+void RealtimeScope::run(F&& fn)
+{
+	#ifdef Q_TEST__HAS_BACKTRACE
+	static bool warmed_up = [] { void* frame; return backtrace(&frame, 1) >= 0; }();
+	(void)warmed_up;
+	#endif
+	long switches = voluntary_context_switches();
+	realtime_scope = this;
+	fn();
+	realtime_scope = nullptr;
+	context_switches = voluntary_context_switches() - switches;
+}
+
+inline RealtimeViolation* RealtimeScope::add(const char* call)
+{
+	if (violations_count >= max_violations) return nullptr;
+	RealtimeViolation* v = &violations[violations_count++];
+	v->call = call;
+	return v;
+}
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+inline void realtime_violation(const char* call)
+{
+	RealtimeScope* scope = realtime_scope;
+	if (!scope) return;
+	realtime_scope = nullptr;
+	RealtimeViolation* v = scope->add(call);
+	#ifdef Q_TEST__HAS_BACKTRACE
+	if (v) v->depth = backtrace(v->frames, 8);
+	#else
+	(void)v;
+	#endif
+	realtime_scope = scope;
+}
+
+inline std::string generate_realtime_hint(RealtimeScope& scope)
+{
+	std::string res;
+	for (int i=0;i<scope.count();i++) {
+		RealtimeViolation& v = scope.violation(i);
+		if (!res.empty()) res += "\n";
+		res += v.call + std::string(" was called");
+		#ifdef Q_TEST__HAS_BACKTRACE
+		char** symbols = backtrace_symbols(v.frames, v.depth);
+		for (int f=1;symbols && f<v.depth;f++) {
+			res += "\n    " + std::string(symbols[f]);
+		}
+		std::free(symbols);
+		#endif
+	}
+	if (scope.blocked()) {
+		if (!res.empty()) res += "\n";
+		res += "the thread blocked " + std::to_string(scope.blocked()) + " times (voluntary context switches)";
+	}
+	return res;
+}
+
+template<typename T>
+T realtime_next(const char* name, T& cache)
+{
+	#ifdef Q_TEST__HAS_REALTIME_HOOKS
+	if (!cache) cache = reinterpret_cast<T>(dlsym(RTLD_NEXT, name));
+	#else
+	(void)name;
+	#endif
+	return cache;
+}
+
+struct AllocationStats {
+	uint64_t count = 0;
+	uint64_t bytes = 0;
+	uint64_t peak_bytes = 0;
+	uint64_t live_count = 0;
+	uint64_t live_bytes = 0;
+};
+
+struct alignas(16) AllocationHeader {
+	uint64_t size;
+	uint64_t epoch;
+};
+
+class AllocationTracker {
+	public:
+		void install() { installed = true; }
+		void begin();
+		AllocationStats end();
+		bool is_installed() { return installed.load(std::memory_order_relaxed); }
+
+		void* allocate(size_t size);
+		void deallocate(void* ptr);
+
+	private:
+		std::atomic<bool> installed{false};
+		std::atomic<uint64_t> epoch{0};
+		std::atomic<uint64_t> last_epoch{0};
+		std::atomic<uint64_t> count{0};
+		std::atomic<uint64_t> bytes{0};
+		std::atomic<uint64_t> peak_bytes{0};
+		std::atomic<uint64_t> live_count{0};
+		std::atomic<uint64_t> live_bytes{0};
+};
+
+inline AllocationTracker allocation_tracker;
+inline thread_local int allocation_pause = 0;
+inline bool fail_on_leaks = false;
+
+struct AllocationPause {
+	AllocationPause() { allocation_pause++; }
+	~AllocationPause() { allocation_pause--; }
+};
+
+class PausedStringBuf : public std::stringbuf {
+	protected:
+		int_type overflow(int_type c) override { AllocationPause pause; return std::stringbuf::overflow(c); }
+		std::streamsize xsputn(const char* s, std::streamsize n) override { AllocationPause pause; return std::stringbuf::xsputn(s, n); }
+};
+
+class InfoStream : public std::ostream {
+	public:
+		InfoStream() : std::ostream(nullptr) { init(&buf); }
+		InfoStream(InfoStream&& other) : std::ostream(std::move(other)), buf(std::move(other.buf)) { set_rdbuf(&buf); }
+		std::string str() const { return buf.str(); }
+
+	private:
+		PausedStringBuf buf;
+};
+
+template<typename... A>
+std::string failure_message(A&&... a)
+{
+	AllocationPause pause;
+	return std::string{std::forward<A>(a)...};
+}
+
+inline void AllocationTracker::begin()
+{
+	count = 0;
+	bytes = 0;
+	peak_bytes = 0;
+	live_count = 0;
+	live_bytes = 0;
+	epoch = ++last_epoch;
+}
+
+inline AllocationStats AllocationTracker::end()
+{
+	epoch = 0;
+	return {count, bytes, peak_bytes, live_count, live_bytes};
+}
+
+inline void* AllocationTracker::allocate(size_t size)
+{
+	auto* header = static_cast<AllocationHeader*>(std::malloc(size + sizeof(AllocationHeader)));
+	if (!header) return nullptr;
+	header->size = size;
+	header->epoch = allocation_pause ? 0 : epoch.load(std::memory_order_relaxed);
+	if (header->epoch) {
+		count.fetch_add(1, std::memory_order_relaxed);
+		bytes.fetch_add(size, std::memory_order_relaxed);
+		live_count.fetch_add(1, std::memory_order_relaxed);
+		uint64_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+		uint64_t peak = peak_bytes.load(std::memory_order_relaxed);
+		while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+	}
+	return header + 1;
+}
+
+inline void AllocationTracker::deallocate(void* ptr)
+{
+	if (!ptr) return;
+	auto* header = static_cast<AllocationHeader*>(ptr) - 1;
+	if (header->epoch && header->epoch == epoch.load(std::memory_order_relaxed)) {
+		live_count.fetch_sub(1, std::memory_order_relaxed);
+		live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+	}
+	std::free(header);
+}
+
+inline std::string format_bytes(uint64_t value)
+{
+	const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+	if (value < 1024) return std::to_string(value) + " B";
+	double v = value;
+	int i = 0;
+	while (v >= 1024 && i < 4) {
+		v /= 1024;
+		i++;
+	}
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.2f %s", v, units[i]);
+	return buf;
+}
+
+inline std::string generate_allocations_text(AllocationStats& stats)
+{
+	std::string res = "allocations " + std::to_string(stats.count) + ", " + format_bytes(stats.bytes)
+		+ ", peak " + format_bytes(stats.peak_bytes);
+	if (stats.live_count) {
+		res += ", not released " + std::to_string(stats.live_count) + " (" + format_bytes(stats.live_bytes) + ")";
+	}
+	return res;
+}
+
+struct ResourceUsage {
+	bool available = false;
+	uint64_t minor_faults = 0;
+	uint64_t major_faults = 0;
+	uint64_t voluntary_switches = 0;
+	uint64_t involuntary_switches = 0;
+	uint64_t read_chars = 0;
+	uint64_t write_chars = 0;
+	uint64_t read_bytes = 0;
+	uint64_t write_bytes = 0;
+
+	ResourceUsage& operator+=(const ResourceUsage& other);
+	ResourceUsage operator-(const ResourceUsage& other) const;
+};
+
+inline ResourceUsage& ResourceUsage::operator+=(const ResourceUsage& other)
+{
+	available |= other.available;
+	minor_faults += other.minor_faults;
+	major_faults += other.major_faults;
+	voluntary_switches += other.voluntary_switches;
+	involuntary_switches += other.involuntary_switches;
+	read_chars += other.read_chars;
+	write_chars += other.write_chars;
+	read_bytes += other.read_bytes;
+	write_bytes += other.write_bytes;
+	return *this;
+}
+
+inline ResourceUsage ResourceUsage::operator-(const ResourceUsage& other) const
+{
+	auto diff = [](uint64_t a, uint64_t b) { return a > b ? a - b : 0; };
+	ResourceUsage res;
+	res.available = available && other.available;
+	res.minor_faults = diff(minor_faults, other.minor_faults);
+	res.major_faults = diff(major_faults, other.major_faults);
+	res.voluntary_switches = diff(voluntary_switches, other.voluntary_switches);
+	res.involuntary_switches = diff(involuntary_switches, other.involuntary_switches);
+	res.read_chars = diff(read_chars, other.read_chars);
+	res.write_chars = diff(write_chars, other.write_chars);
+	res.read_bytes = diff(read_bytes, other.read_bytes);
+	res.write_bytes = diff(write_bytes, other.write_bytes);
+	return res;
+}
+
+inline std::atomic<uint64_t> resource_usage_own_reads{0};
+
+inline ResourceUsage read_resource_usage()
+{
+	ResourceUsage usage;
+	#if defined(__linux__) && defined(RUSAGE_THREAD)
+	rusage ru;
+	if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+		usage.available = true;
+		usage.minor_faults = ru.ru_minflt;
+		usage.major_faults = ru.ru_majflt;
+		usage.voluntary_switches = ru.ru_nvcsw;
+		usage.involuntary_switches = ru.ru_nivcsw;
+	}
+	int fd = open("/proc/self/io", O_RDONLY);
+	if (fd >= 0) {
+		char buf[512];
+		uint64_t own_reads = resource_usage_own_reads.load();
+		ssize_t n = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (n > 0) {
+			resource_usage_own_reads += n;
+			buf[n] = 0;
+			auto field = [&buf](const char* key) -> uint64_t {
+				const char* line = std::strstr(buf, key);
+				return line ? std::strtoull(line + std::strlen(key), nullptr, 10) : 0;
+			};
+			usage.read_chars = field("rchar:") - own_reads;
+			usage.write_chars = field("wchar:");
+			usage.read_bytes = field("\nread_bytes:");
+			usage.write_bytes = field("\nwrite_bytes:");
+		}
+	}
+	#endif
+	return usage;
+}
+
+template<typename F>
+ResourceUsage measure_resource_usage(F&& fn)
+{
+	ResourceUsage start = read_resource_usage();
+	fn();
+	return read_resource_usage() - start;
+}
+
+inline std::string generate_resource_usage_text(ResourceUsage& usage)
+{
+	auto io = [](uint64_t chars, uint64_t bytes) {
+		std::string res = format_bytes(chars);
+		if (bytes) res += " (" + format_bytes(bytes) + " storage)";
+		return res;
+	};
+	return "page faults " + std::to_string(usage.minor_faults) + " minor, " + std::to_string(usage.major_faults) + " major"
+		+ ", context switches " + std::to_string(usage.voluntary_switches) + " voluntary, " + std::to_string(usage.involuntary_switches) + " involuntary"
+		+ ", read " + io(usage.read_chars, usage.read_bytes) + ", written " + io(usage.write_chars, usage.write_bytes);
+}
+
+class QTestTrace {
+	using clock = std::chrono::steady_clock;
+
+	public:
+		QTestTrace(std::string path);
+		~QTestTrace();
+		QTestTrace(const QTestTrace&) = delete;
+		QTestTrace& operator=(const QTestTrace&) = delete;
+
+		clock::time_point now() { return clock::now(); }
+		void complete(std::string_view name, std::string_view cat, clock::time_point start, clock::time_point end);
+
+	private:
+		void write(const std::string& event);
+		unsigned thread_id();
+		double timestamp(clock::time_point t) { return std::chrono::duration<double, std::micro>(t - origin).count(); }
+
+		std::ofstream out;
+		std::mutex mtx;
+		clock::time_point origin = clock::now();
+		std::atomic<unsigned> threads{0};
+		int pid = 0;
+		bool first = true;
+};
+
+inline QTestTrace* trace = nullptr;
+
+class TraceSpan {
+	public:
+		TraceSpan(std::string_view name, std::string_view cat = "user");
+		~TraceSpan();
+		TraceSpan(const TraceSpan&) = delete;
+		TraceSpan& operator=(const TraceSpan&) = delete;
+
+	private:
+		std::string name;
+		std::string_view cat;
+		std::chrono::steady_clock::time_point start;
+};
+
+inline std::string json_escape(std::string_view str)
+{
+	std::string res;
+	for (char c : str) {
+		switch (c) {
+			case '"': res += "\\\""; break;
+			case '\\': res += "\\\\"; break;
+			case '\n': res += "\\n"; break;
+			case '\t': res += "\\t"; break;
+			default:
+				if ((unsigned char)c < 0x20) {
+					char buf[8];
+					std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+					res += buf;
+				} else {
+					res.push_back(c);
+				}
+		}
+	}
+	return res;
+}
+
+inline QTestTrace::QTestTrace(std::string path) : out(path, std::ios::trunc)
+{
+	#ifdef _WIN32
+	pid = _getpid();
+	#else
+	pid = getpid();
+	#endif
+	out << "[";
+	write("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + std::to_string(pid) + ",\"tid\":" + std::to_string(thread_id()) + ",\"args\":{\"name\":\"QTest\"}}");
+}
+
+inline QTestTrace::~QTestTrace()
+{
+	out << "\n]\n";
+}
+
+inline unsigned QTestTrace::thread_id()
+{
+	thread_local unsigned id = ++threads;
+	return id;
+}
+
+inline void QTestTrace::write(const std::string& event)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	out << (first ? "\n" : ",\n") << event;
+	out.flush();
+	first = false;
+}
+
+inline void QTestTrace::complete(std::string_view name, std::string_view cat, clock::time_point start, clock::time_point end)
+{
+	AllocationPause pause;
+	char times[96];
+	std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", timestamp(start), timestamp(end) - timestamp(start));
+	write("{\"name\":\"" + json_escape(name) + "\",\"cat\":\"" + std::string(cat) + "\",\"ph\":\"X\"," + times
+		+ ",\"pid\":" + std::to_string(pid) + ",\"tid\":" + std::to_string(thread_id()) + "}");
+}
+
+inline TraceSpan::TraceSpan(std::string_view name, std::string_view cat) : cat(cat)
+{
+	if (!trace) return;
+	AllocationPause pause;
+	this->name = name;
+	start = trace->now();
+}
+
+inline TraceSpan::~TraceSpan()
+{
+	if (trace) trace->complete(name, cat, start, trace->now());
+}
+
+struct ProfileSample {
+	static constexpr int max_depth = 48;
+	void* frames[max_depth];
+	int depth;
+};
+
+class QTestProfiler {
+	static constexpr size_t max_samples = 8192;
+
+	public:
+		QTestProfiler(std::string path);
+		~QTestProfiler();
+		QTestProfiler(const QTestProfiler&) = delete;
+		QTestProfiler& operator=(const QTestProfiler&) = delete;
+
+		bool is_available() { return available; }
+		void start();
+		void stop();
+		size_t write(const std::string& test);
+
+	private:
+		static void handler(int);
+		std::string symbol(void* addr);
+
+		std::ofstream out;
+		std::unique_ptr<ProfileSample[]> samples;
+		std::atomic<size_t> count{0};
+		std::unordered_map<void*, std::string> symbols;
+		void* base_frames[ProfileSample::max_depth];
+		int base_depth = 0;
+		bool available = false;
+		#ifdef Q_TEST__HAS_PROFILER
+		timer_t timer;
+		struct sigaction previous = {};
+		bool installed = false;
+		#endif
+};
+
+inline QTestProfiler* profiler = nullptr;
+
+inline QTestProfiler::QTestProfiler(std::string path) : out(path, std::ios::trunc), samples(new ProfileSample[max_samples])
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	struct sigaction sa = {};
+	sa.sa_handler = handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigevent sev = {};
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+	sev._sigev_un._tid = (pid_t)syscall(SYS_gettid);
+	installed = out && sigaction(SIGPROF, &sa, &previous) == 0;
+	available = installed && timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &timer) == 0;
+	void* frame;
+	backtrace(&frame, 1);
+	#endif
+}
+
+inline QTestProfiler::~QTestProfiler()
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	if (available) timer_delete(timer);
+	if (installed) sigaction(SIGPROF, &previous, nullptr);
+	#endif
+}
+
+inline void QTestProfiler::handler(int)
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	QTestProfiler* p = profiler;
+	if (!p) return;
+	size_t i = p->count.fetch_add(1, std::memory_order_relaxed);
+	if (i >= max_samples) return;
+	p->samples[i].depth = backtrace(p->samples[i].frames, ProfileSample::max_depth);
+	#endif
+}
+
+inline void QTestProfiler::start()
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	base_depth = backtrace(base_frames, ProfileSample::max_depth);
+	count = 0;
+	long interval = 1000000000L / TEST_PROFILE_HZ;
+	itimerspec spec = {{0, interval}, {0, interval}};
+	timer_settime(timer, 0, &spec, nullptr);
+	#endif
+}
+
+inline void QTestProfiler::stop()
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	itimerspec spec = {};
+	timer_settime(timer, 0, &spec, nullptr);
+	#endif
+}
+
+inline std::string address_symbol(void* addr)
+{
+	std::string name;
+	#ifdef Q_TEST__HAS_PROFILER
+	Dl_info info = {};
+	if (!dladdr(addr, &info)) return "??";
+	if (info.dli_sname) {
+		int status = 0;
+		char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+		name = status == 0 ? demangled : info.dli_sname;
+		std::free(demangled);
+	} else if (info.dli_fname) {
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "+0x%zx", (size_t)addr - (size_t)info.dli_fbase);
+		std::string file = info.dli_fname;
+		name = file.substr(file.find_last_of('/') + 1) + buf;
+	}
+	#else
+	(void)addr;
+	#endif
+	return name.empty() ? "??" : name;
+}
+
+inline std::string folded_frame(std::string name)
+{
+	for (char& c : name) {
+		if (c == ';' || c == '\n' || c == '\r') c = ',';
+	}
+	return name;
+}
+
+inline std::string QTestProfiler::symbol(void* addr)
+{
+	auto it = symbols.find(addr);
+	if (it != symbols.end()) return it->second;
+	return symbols[addr] = folded_frame(address_symbol(addr));
+}
+
+inline size_t QTestProfiler::write(const std::string& test)
+{
+	AllocationPause pause;
+	size_t total = std::min<size_t>(count, max_samples);
+	std::map<std::string, size_t> folded;
+	for (size_t i=0;i<total;i++) {
+		ProfileSample& s = samples[i];
+		int depth = s.depth;
+		int common = 0;
+		while (common < depth - 2 && common < base_depth - 1 && s.frames[depth - 1 - common] == base_frames[base_depth - 1 - common]) {
+			common++;
+		}
+		std::string stack = folded_frame(test);
+		for (int f=depth-1-common;f>=2;f--) {
+			stack += ";" + symbol((char*)s.frames[f] - (f > 2 ? 1 : 0));
+		}
+		folded[stack]++;
+	}
+	for (auto& [stack, n] : folded) {
+		out << stack << ' ' << n << '\n';
+	}
+	out.flush();
+	return total;
+}
+
+struct TestResult {
+	std::string_view suite;
+	std::string_view name;
+	std::string_view file;
+	int line = 0;
+	bool passed = true;
+	bool skipped = false;
+	double duration = 0;
+	std::string_view expect;
+	const ErrorReport* error = nullptr;
+	std::string_view message;
+	const BenchmarkStats* benchmark = nullptr;
+	const ResourceUsage* resources = nullptr;
+	const AllocationStats* allocations = nullptr;
+};
+
+struct RunStatistics {
+	int tests = 0;
+	int failed = 0;
+	int skipped = 0;
+	double duration = 0;
+	double hooks_duration = 0;
+};
+
+class QTestReporter {
+	public:
+		virtual ~QTestReporter() = default;
+		virtual void run_start() {}
+		virtual void describe_enter(std::string_view) {}
+		virtual void describe_leave(std::string_view) {}
+		virtual void test_result(const TestResult&) {}
+		virtual void statistics(const RunStatistics&) {}
+};
+
+class ReportStream {
+	public:
+		ReportStream(std::string_view target);
+		~ReportStream();
+		ReportStream(const ReportStream&) = delete;
+		ReportStream& operator=(const ReportStream&) = delete;
+
+		void write(std::string_view s);
+
+	private:
+		std::FILE* file = nullptr;
+};
+
+class QTestJUnitReporter : public QTestReporter {
+	public:
+		QTestJUnitReporter(std::string_view target);
+		void run_start() override;
+		void test_result(const TestResult& result) override;
+		void statistics(const RunStatistics& stats) override;
+
+	private:
+		ReportStream out;
+};
+
+class QTestJsonReporter : public QTestReporter {
+	public:
+		QTestJsonReporter(std::string_view target) : out(target) {}
+		void run_start() override;
+		void describe_enter(std::string_view name) override;
+		void describe_leave(std::string_view name) override;
+		void test_result(const TestResult& result) override;
+		void statistics(const RunStatistics& stats) override;
+
+	private:
+		ReportStream out;
+		int depth = 0;
+};
+
+class QTestTapReporter : public QTestReporter {
+	public:
+		QTestTapReporter(std::string_view target) : out(target) {}
+		void run_start() override;
+		void describe_enter(std::string_view name) override;
+		void test_result(const TestResult& result) override;
+		void statistics(const RunStatistics& stats) override;
+
+	private:
+		ReportStream out;
+		int number = 0;
+};
+
+inline ReportStream::ReportStream(std::string_view target)
+{
+	std::string path(target);
+	if (path.rfind("fd:", 0) == 0) {
+		int fd = std::atoi(path.c_str() + 3);
+		#ifdef _WIN32
+		file = _fdopen(_dup(fd), "w");
+		#else
+		file = fdopen(dup(fd), "w");
+		#endif
+	} else {
+		file = std::fopen(path.c_str(), "w");
+	}
+}
+
+inline ReportStream::~ReportStream()
+{
+	if (file) std::fclose(file);
+}
+
+inline void ReportStream::write(std::string_view s)
+{
+	if (!file) return;
+	std::fwrite(s.data(), 1, s.size(), file);
+	std::fflush(file);
+}
+
+inline std::string xml_escape(std::string_view str)
+{
+	std::string res;
+	for (char c : str) {
+		switch (c) {
+			case '&': res += "&amp;"; break;
+			case '<': res += "&lt;"; break;
+			case '>': res += "&gt;"; break;
+			case '"': res += "&quot;"; break;
+			case '\'': res += "&apos;"; break;
+			case '\n': case '\t': res.push_back(c); break;
+			default: res.push_back((unsigned char)c < 0x20 ? '?' : c);
+		}
+	}
+	return res;
+}
+
+inline std::string format_seconds(double ns)
+{
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.6f", ns / 1e9);
+	return buf;
+}
+
+inline QTestJUnitReporter::QTestJUnitReporter(std::string_view target) : out(target)
+{
+	out.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+}
+
+inline void QTestJUnitReporter::run_start()
+{
+	out.write("<testsuites name=\"QTest\">\n<testsuite name=\"QTest\">\n");
+}
+
+inline void QTestJUnitReporter::test_result(const TestResult& result)
+{
+	std::string res = "  <testcase classname=\"" + xml_escape(result.suite) + "\" name=\"" + xml_escape(result.name)
+		+ "\" file=\"" + xml_escape(result.file) + "\" line=\"" + std::to_string(result.line)
+		+ "\" time=\"" + format_seconds(result.duration) + "\"";
+	if (result.skipped) {
+		res += ">\n    <skipped/>\n  </testcase>\n";
+	} else if (result.error) {
+		res += ">\n    <failure message=\"" + xml_escape(result.message) + "\" type=\"" + xml_escape(result.error->func) + "\">"
+			+ xml_escape(result.error->hint) + "</failure>\n  </testcase>\n";
+	} else {
+		res += "/>\n";
+	}
+	out.write(res);
+}
+
+inline void QTestJUnitReporter::statistics(const RunStatistics&)
+{
+	out.write("</testsuite>\n</testsuites>\n");
+}
+
+inline void QTestJsonReporter::run_start()
+{
+	out.write("{\"event\":\"run_start\"}\n");
+}
+
+inline void QTestJsonReporter::describe_enter(std::string_view name)
+{
+	out.write("{\"event\":\"describe_enter\",\"name\":\"" + json_escape(name) + "\",\"depth\":" + std::to_string(++depth) + "}\n");
+}
+
+inline void QTestJsonReporter::describe_leave(std::string_view name)
+{
+	out.write("{\"event\":\"describe_leave\",\"name\":\"" + json_escape(name) + "\",\"depth\":" + std::to_string(depth--) + "}\n");
+}
+
+inline void QTestJsonReporter::test_result(const TestResult& result)
+{
+	auto str = [](std::string_view s) { return "\"" + json_escape(s) + "\""; };
+	std::string status = result.skipped ? "skipped" : (result.passed ? "passed" : "failed");
+	std::string res = "{\"event\":\"test\",\"suite\":" + str(result.suite) + ",\"name\":" + str(result.name)
+		+ ",\"file\":" + str(result.file) + ",\"line\":" + std::to_string(result.line)
+		+ ",\"status\":\"" + status + "\",\"duration_ns\":" + std::to_string((uint64_t)result.duration);
+	if (result.error) {
+		const ErrorReport& e = *result.error;
+		res += ",\"message\":" + str(result.message) + ",\"expect\":" + str(result.expect) + ",\"func\":" + str(e.func)
+			+ ",\"inverse\":" + (e.inverse ? "true" : "false");
+		if (e.value_substituted) res += ",\"value\":" + str(e.value);
+		if (e.compare_substituted) res += ",\"compare\":" + str(e.compare);
+		if (!e.hint.empty()) res += ",\"hint\":" + str(e.hint);
+	}
+	out.write(res + "}\n");
+}
+
+inline void QTestJsonReporter::statistics(const RunStatistics& stats)
+{
+	out.write("{\"event\":\"statistics\",\"tests\":" + std::to_string(stats.tests) + ",\"failed\":" + std::to_string(stats.failed)
+		+ ",\"skipped\":" + std::to_string(stats.skipped) + ",\"duration_ns\":" + std::to_string((uint64_t)stats.duration) + "}\n");
+}
+
+inline std::string tap_escape(std::string_view str)
+{
+	std::string res;
+	for (char c : str) {
+		if (c == '#' || c == '\\') res.push_back('\\');
+		res.push_back(c == '\n' || c == '\r' ? ' ' : c);
+	}
+	return res;
+}
+
+inline void QTestTapReporter::run_start()
+{
+	out.write("TAP version 13\n");
+}
+
+inline void QTestTapReporter::describe_enter(std::string_view name)
+{
+	out.write("# " + tap_escape(name) + "\n");
+}
+
+inline void QTestTapReporter::test_result(const TestResult& result)
+{
+	std::string name = result.suite.empty() ? std::string(result.name) : std::string(result.suite) + " " + std::string(result.name);
+	std::string res = (result.passed ? "ok " : "not ok ") + std::to_string(++number) + " - " + tap_escape(name);
+	if (result.skipped) res += " # SKIP";
+	res += "\n";
+	if (result.error) {
+		res += "  ---\n  message: \"" + json_escape(result.message) + "\"\n  severity: fail\n"
+			+ "  at:\n    file: \"" + json_escape(result.file) + "\"\n    line: " + std::to_string(result.line) + "\n";
+		if (!result.error->hint.empty()) res += "  hint: \"" + json_escape(result.error->hint) + "\"\n";
+		res += "  ...\n";
+	}
+	out.write(res);
+}
+
+inline void QTestTapReporter::statistics(const RunStatistics& stats)
+{
+	out.write("1.." + std::to_string(stats.tests) + "\n");
+}
+
+class QTestMetricsReporter : public QTestReporter {
+	using clock = std::chrono::steady_clock;
+
+	public:
+		QTestMetricsReporter(std::string path) : path(path) {}
+		void describe_enter(std::string_view name) override;
+		void describe_leave(std::string_view name) override;
+		void test_result(const TestResult& result) override;
+		void statistics(const RunStatistics& stats) override;
+
+	private:
+		static constexpr double buckets[] = {0.0001, 0.001, 0.01, 0.1, 1, 10};
+
+		void family(std::string& res, std::string_view name, std::string_view type, std::string_view help, std::string& samples);
+
+		std::string path;
+		std::vector<std::string> describes;
+		std::vector<clock::time_point> describe_starts;
+		std::map<std::string, double> describe_durations;
+		std::map<std::string, uint64_t> occurrences;
+		uint64_t bucket_counts[std::size(buckets)] = {};
+		uint64_t tests = 0;
+		double tests_duration = 0;
+		std::string benchmarks;
+		std::string page_faults;
+		std::string context_switches;
+		std::string io_bytes;
+		std::string allocations;
+		std::string allocated_bytes;
+};
+
+inline std::string metrics_label(std::string_view str)
+{
+	std::string res;
+	for (char c : str) {
+		if (c == '\\' || c == '"') res.push_back('\\');
+		if (c == '\n') {
+			res += "\\n";
+		} else {
+			res.push_back(c);
+		}
+	}
+	return res;
+}
+
+inline std::string metrics_value(double value)
+{
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.9g", value);
+	return buf;
+}
+
+inline void QTestMetricsReporter::describe_enter(std::string_view name)
+{
+	describes.push_back(std::string(name));
+	describe_starts.push_back(clock::now());
+}
+
+inline void QTestMetricsReporter::describe_leave(std::string_view)
+{
+	std::string key;
+	for (auto& d : describes) {
+		key += (key.empty() ? "" : " ") + d;
+	}
+	describe_durations[key] += std::chrono::duration<double>(clock::now() - describe_starts.back()).count();
+	describes.pop_back();
+	describe_starts.pop_back();
+}
+
+inline void QTestMetricsReporter::test_result(const TestResult& result)
+{
+	if (result.skipped) return;
+	double seconds = result.duration / 1e9;
+	tests++;
+	tests_duration += seconds;
+	for (size_t i=0;i<std::size(buckets);i++) {
+		if (seconds <= buckets[i]) bucket_counts[i]++;
+	}
+	std::string labels = "describe=\"" + metrics_label(result.suite) + "\",test=\"" + metrics_label(result.name)
+		+ "\",line=\"" + std::to_string(result.line) + "\"";
+	labels += ",occurrence=\"" + std::to_string(occurrences[labels]++) + "\"";
+	auto sample = [&labels](std::string& samples, std::string_view name, std::string extra, double value) {
+		samples += std::string(name) + "{" + labels + extra + "} " + metrics_value(value) + "\n";
+	};
+	if (result.benchmark) {
+		const BenchmarkStats& b = *result.benchmark;
+		sample(benchmarks, "qtest_benchmark_seconds", ",stat=\"median\"", b.median / 1e9);
+		sample(benchmarks, "qtest_benchmark_seconds", ",stat=\"mean\"", b.mean / 1e9);
+		sample(benchmarks, "qtest_benchmark_seconds", ",stat=\"min\"", b.min / 1e9);
+		sample(benchmarks, "qtest_benchmark_seconds", ",stat=\"stddev\"", b.stddev / 1e9);
+	}
+	if (result.resources && result.resources->available) {
+		const ResourceUsage& r = *result.resources;
+		sample(page_faults, "qtest_test_page_faults", ",type=\"minor\"", r.minor_faults);
+		sample(page_faults, "qtest_test_page_faults", ",type=\"major\"", r.major_faults);
+		sample(context_switches, "qtest_test_context_switches", ",type=\"voluntary\"", r.voluntary_switches);
+		sample(context_switches, "qtest_test_context_switches", ",type=\"involuntary\"", r.involuntary_switches);
+		sample(io_bytes, "qtest_test_io_bytes", ",direction=\"read\"", r.read_chars);
+		sample(io_bytes, "qtest_test_io_bytes", ",direction=\"write\"", r.write_chars);
+	}
+	if (result.allocations) {
+		sample(allocations, "qtest_test_allocations", "", result.allocations->count);
+		sample(allocated_bytes, "qtest_test_allocated_bytes", "", result.allocations->bytes);
+	}
+}
+
+inline void QTestMetricsReporter::family(std::string& res, std::string_view name, std::string_view type, std::string_view help, std::string& samples)
+{
+	if (samples.empty()) return;
+	res += "# TYPE " + std::string(name) + " " + std::string(type) + "\n# HELP " + std::string(name) + " " + std::string(help) + "\n" + samples;
+}
+
+inline void QTestMetricsReporter::statistics(const RunStatistics& stats)
+{
+	std::string res;
+	std::string samples = "qtest_tests{status=\"passed\"} " + std::to_string(stats.tests - stats.failed - stats.skipped) + "\n"
+		+ "qtest_tests{status=\"failed\"} " + std::to_string(stats.failed) + "\n"
+		+ "qtest_tests{status=\"skipped\"} " + std::to_string(stats.skipped) + "\n";
+	family(res, "qtest_tests", "gauge", "Tests of the last run by status.", samples);
+	samples = "qtest_run_duration_seconds " + metrics_value(stats.duration / 1e9) + "\n";
+	family(res, "qtest_run_duration_seconds", "gauge", "Duration of the last run.", samples);
+	samples = "qtest_hooks_duration_seconds " + metrics_value(stats.hooks_duration / 1e9) + "\n";
+	family(res, "qtest_hooks_duration_seconds", "gauge", "Time spent in the BEFORE and AFTER hooks.", samples);
+	samples.clear();
+	for (auto& [describe, seconds] : describe_durations) {
+		samples += "qtest_describe_duration_seconds{describe=\"" + metrics_label(describe) + "\"} " + metrics_value(seconds) + "\n";
+	}
+	family(res, "qtest_describe_duration_seconds", "gauge", "Duration of the describe with its nested describes.", samples);
+	samples.clear();
+	for (size_t i=0;i<std::size(buckets);i++) {
+		samples += "qtest_test_duration_seconds_bucket{le=\"" + metrics_value(buckets[i]) + "\"} " + std::to_string(bucket_counts[i]) + "\n";
+	}
+	samples += "qtest_test_duration_seconds_bucket{le=\"+Inf\"} " + std::to_string(tests) + "\n"
+		+ "qtest_test_duration_seconds_sum " + metrics_value(tests_duration) + "\n"
+		+ "qtest_test_duration_seconds_count " + std::to_string(tests) + "\n";
+	family(res, "qtest_test_duration_seconds", "histogram", "Durations of the tests with their hooks.", samples);
+	family(res, "qtest_benchmark_seconds", "gauge", "Benchmark iteration time.", benchmarks);
+	family(res, "qtest_test_page_faults", "gauge", "Page faults of the test.", page_faults);
+	family(res, "qtest_test_context_switches", "gauge", "Context switches of the test.", context_switches);
+	family(res, "qtest_test_io_bytes", "gauge", "Bytes passed to the read and write calls during the test.", io_bytes);
+	family(res, "qtest_test_allocations", "gauge", "Allocations made by the test.", allocations);
+	family(res, "qtest_test_allocated_bytes", "gauge", "Bytes allocated by the test.", allocated_bytes);
+	res += "# EOF\n";
+	std::string tmp = path + ".tmp";
+	std::FILE* file = std::fopen(tmp.c_str(), "w");
+	if (!file) return;
+	bool written = std::fwrite(res.data(), 1, res.size(), file) == res.size();
+	written &= std::fclose(file) == 0;
+	#ifdef _WIN32
+	written = written && MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+	#else
+	written = written && std::rename(tmp.c_str(), path.c_str()) == 0;
+	#endif
+	if (!written) std::remove(tmp.c_str());
+}
+
+struct JournalEntry {
+	bool passed = true;
+	double duration = 0;
+};
+
+class QTestJournal {
+	static constexpr char magic[] = {'Q', 'T', 'J', '1'};
+
+	public:
+		QTestJournal(std::string path, bool resume);
+		~QTestJournal();
+		QTestJournal(const QTestJournal&) = delete;
+		QTestJournal& operator=(const QTestJournal&) = delete;
+
+		bool replay(const std::string& key, JournalEntry& entry);
+		void record(const std::string& key, bool passed, double duration);
+
+	private:
+		size_t load(std::string& path);
+		void sync();
+
+		int fd = -1;
+		std::unordered_map<std::string, std::deque<JournalEntry>> entries;
+		int unsynced = 0;
+		std::chrono::steady_clock::time_point last_sync = std::chrono::steady_clock::now();
+};
+
+inline QTestJournal* journal = nullptr;
+
+inline uint32_t journal_checksum(const char* data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i=0;i<size;i++) {
+		hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+inline QTestJournal::QTestJournal(std::string path, bool resume)
+{
+	size_t valid = resume ? load(path) : 0;
+	#ifdef _WIN32
+	fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY, 0644);
+	if (fd < 0) return;
+	_chsize_s(fd, valid);
+	_lseek(fd, 0, SEEK_END);
+	if (!valid) _write(fd, magic, sizeof(magic));
+	#else
+	fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) return;
+	if (ftruncate(fd, valid) != 0 || lseek(fd, 0, SEEK_END) < 0 || (!valid && ::write(fd, magic, sizeof(magic)) != sizeof(magic))) {
+		close(fd);
+		fd = -1;
+	}
+	#endif
+}
+
+inline QTestJournal::~QTestJournal()
+{
+	if (fd < 0) return;
+	sync();
+	#ifdef _WIN32
+	_close(fd);
+	#else
+	close(fd);
+	#endif
+}
+
+inline size_t QTestJournal::load(std::string& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (data.size() < sizeof(magic) || std::memcmp(data.data(), magic, sizeof(magic)) != 0) return 0;
+	size_t pos = sizeof(magic);
+	constexpr size_t fixed = sizeof(uint8_t) + sizeof(uint64_t);
+	while (data.size() - pos >= 2 * sizeof(uint32_t)) {
+		uint32_t size, checksum;
+		std::memcpy(&size, data.data() + pos, sizeof(size));
+		std::memcpy(&checksum, data.data() + pos + sizeof(size), sizeof(checksum));
+		const char* payload = data.data() + pos + 2 * sizeof(uint32_t);
+		if (size < fixed || data.size() - pos - 2 * sizeof(uint32_t) < size || journal_checksum(payload, size) != checksum) break;
+		uint64_t duration;
+		std::memcpy(&duration, payload + 1, sizeof(duration));
+		entries[std::string(payload + fixed, size - fixed)].push_back({payload[0] != 0, (double)duration});
+		pos += 2 * sizeof(uint32_t) + size;
+	}
+	return pos;
+}
+
+inline bool QTestJournal::replay(const std::string& key, JournalEntry& entry)
+{
+	auto it = entries.find(key);
+	if (it == entries.end() || it->second.empty()) return false;
+	entry = it->second.front();
+	it->second.pop_front();
+	return true;
+}
+
+inline void QTestJournal::record(const std::string& key, bool passed, double duration)
+{
+	if (fd < 0) return;
+	uint64_t ns = (uint64_t)duration;
+	uint32_t size = sizeof(uint8_t) + sizeof(ns) + key.size();
+	std::string rec(2 * sizeof(uint32_t) + size, '\0');
+	char* payload = rec.data() + 2 * sizeof(uint32_t);
+	payload[0] = passed;
+	std::memcpy(payload + 1, &ns, sizeof(ns));
+	std::memcpy(payload + 1 + sizeof(ns), key.data(), key.size());
+	uint32_t checksum = journal_checksum(payload, size);
+	std::memcpy(rec.data(), &size, sizeof(size));
+	std::memcpy(rec.data() + sizeof(size), &checksum, sizeof(checksum));
+	#ifdef _WIN32
+	_write(fd, rec.data(), (unsigned)rec.size());
+	#else
+	if (::write(fd, rec.data(), rec.size()) < 0) return;
+	#endif
+	auto now = std::chrono::steady_clock::now();
+	if (++unsynced >= TEST_JOURNAL_SYNC_COUNT || now - last_sync >= std::chrono::milliseconds(TEST_JOURNAL_SYNC_MS)) {
+		sync();
+	}
+}
+
+inline void QTestJournal::sync()
+{
+	if (!unsynced) return;
+	#ifdef _WIN32
+	_commit(fd);
+	#else
+	fsync(fd);
+	#endif
+	unsynced = 0;
+	last_sync = std::chrono::steady_clock::now();
+}
+
+class QTestRerunState {
+	public:
+		enum class Pass{All, Failed, First};
+
+		QTestRerunState(std::string path);
+
+		bool has_failed() { return !previous.empty(); }
+		void set_pass(Pass p) { pass = p; }
+		bool has_matched() { return !matched.empty(); }
+		bool filtered(const std::string& id);
+		bool deferred(const std::string& id);
+		void record(const std::string& id, bool passed);
+		void save();
+
+	private:
+		std::string path;
+		std::set<std::string> previous;
+		std::set<std::string> matched;
+		std::set<std::string> ran;
+		std::set<std::string> failed;
+		Pass pass = Pass::All;
+};
+
+inline QTestRerunState* rerun = nullptr;
+
+inline std::string rerun_test_id(std::string_view describes, std::string_view test, int line)
+{
+	std::string res;
+	for (char c : std::string(describes) + std::string(test)) {
+		if (c == '\\') res += "\\\\";
+		else if (c == '\n') res += "\\n";
+		else res.push_back(c);
+	}
+	return res + ":" + std::to_string(line);
+}
+
+inline QTestRerunState::QTestRerunState(std::string path) : path(path)
+{
+	std::ifstream in(path);
+	std::string line;
+	while (std::getline(in, line)) {
+		if (!line.empty()) previous.insert(line);
+	}
+}
+
+inline bool QTestRerunState::filtered(const std::string& id)
+{
+	bool failed = previous.count(id);
+	if (failed) matched.insert(id);
+	return pass == Pass::Failed && !failed;
+}
+
+inline bool QTestRerunState::deferred(const std::string& id)
+{
+	return pass == Pass::First && !previous.count(id);
+}
+
+inline void QTestRerunState::record(const std::string& id, bool passed)
+{
+	ran.insert(id);
+	if (!passed) failed.insert(id);
+}
+
+inline void QTestRerunState::save()
+{
+	std::ofstream out(path, std::ios::trunc);
+	for (auto& id : previous) {
+		if (matched.count(id) && !ran.count(id)) out << id << '\n';
+	}
+	for (auto& id : failed) {
+		out << id << '\n';
+	}
+}
+
+inline constexpr size_t impact_slots_count = 1 << 16;
+inline void* impact_slots[impact_slots_count] = {};
+inline int impact_active = 0;
+inline int impact_overflow = 0;
+
+#ifdef Q_TEST__HAS_IMPACT
+__attribute__((no_instrument_function))
+inline void impact_record(void* fn)
+{
+	if (!__atomic_load_n(&impact_active, __ATOMIC_RELAXED)) return;
+	size_t i = ((uintptr_t)fn >> 4) * 0x9E3779B97F4A7C15ull >> 48;
+	for (size_t probe=0;probe<64;probe++, i=(i + 1) & (impact_slots_count - 1)) {
+		void* slot = __atomic_load_n(&impact_slots[i], __ATOMIC_RELAXED);
+		if (slot == fn) return;
+		void* empty = nullptr;
+		if (!slot && __atomic_compare_exchange_n(&impact_slots[i], &empty, fn, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return;
+		if (empty == fn) return;
+	}
+	__atomic_store_n(&impact_overflow, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+struct ImpactLocation {
+	std::string file;
+	std::string function;
+};
+
+struct ImpactFixture {
+	std::vector<void*> fns;
+	bool overflow = false;
+};
+
+class QTestImpactMap {
+	public:
+		QTestImpactMap(std::string path);
+
+		void select(std::string changed_path);
+		bool filtered(const std::string& id);
+		void begin();
+		void fixture_begin();
+		ImpactFixture fixture_end();
+		void add(const ImpactFixture& fixture);
+		void end(const std::string& id);
+		void save();
+
+	private:
+		bool is_impacted(const std::vector<ImpactLocation>& locations);
+		bool drain(std::vector<void*>& fns);
+		std::map<void*, ImpactLocation> symbolize();
+
+		std::string path;
+		std::map<std::string, std::vector<ImpactLocation>> previous;
+		std::map<std::string, std::vector<void*>> recorded;
+		std::vector<std::string> changed;
+		std::vector<void*> collected;
+		bool overflowed = false;
+		bool selecting = false;
+};
+
+inline QTestImpactMap* impact = nullptr;
+
+inline QTestImpactMap::QTestImpactMap(std::string path) : path(path)
+{
+	std::ifstream in(path);
+	std::string line;
+	std::vector<ImpactLocation>* test = nullptr;
+	while (std::getline(in, line)) {
+		if (line.rfind("test ", 0) == 0) {
+			test = &previous[line.substr(5)];
+		} else if (test && !line.empty()) {
+			size_t tab = line.find('\t');
+			test->push_back({line.substr(0, tab), tab == std::string::npos ? "" : line.substr(tab + 1)});
+		}
+	}
+}
+
+inline void QTestImpactMap::select(std::string changed_path)
+{
+	std::ifstream in(changed_path);
+	std::string line;
+	while (std::getline(in, line)) {
+		if (!line.empty()) changed.push_back(line);
+	}
+	selecting = true;
+}
+
+inline bool QTestImpactMap::is_impacted(const std::vector<ImpactLocation>& locations)
+{
+	for (auto& l : locations) {
+		for (auto& c : changed) {
+			if (l.file == c || (l.file.size() > c.size() && l.file.compare(l.file.size() - c.size(), c.size(), c) == 0 && l.file[l.file.size() - c.size() - 1] == '/')) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+inline bool QTestImpactMap::filtered(const std::string& id)
+{
+	if (!selecting) return false;
+	auto it = previous.find(id);
+	return it != previous.end() && !is_impacted(it->second);
+}
+
+inline void QTestImpactMap::begin()
+{
+	collected.clear();
+	overflowed = false;
+	#ifdef Q_TEST__HAS_IMPACT
+	__atomic_store_n(&impact_overflow, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&impact_active, 1, __ATOMIC_RELAXED);
+	#endif
+}
+
+inline bool QTestImpactMap::drain(std::vector<void*>& fns)
+{
+	bool overflow = false;
+	#ifdef Q_TEST__HAS_IMPACT
+	for (auto& slot : impact_slots) {
+		if (!__atomic_load_n(&slot, __ATOMIC_RELAXED)) continue;
+		void* fn = __atomic_exchange_n(&slot, nullptr, __ATOMIC_RELAXED);
+		if (fn) fns.push_back(fn);
+	}
+	overflow = __atomic_exchange_n(&impact_overflow, 0, __ATOMIC_RELAXED);
+	#else
+	(void)fns;
+	#endif
+	return overflow;
+}
+
+inline void QTestImpactMap::fixture_begin()
+{
+	AllocationPause pause;
+	overflowed |= drain(collected);
+}
+
+inline ImpactFixture QTestImpactMap::fixture_end()
+{
+	AllocationPause pause;
+	ImpactFixture fixture;
+	fixture.overflow = drain(fixture.fns);
+	return fixture;
+}
+
+inline void QTestImpactMap::add(const ImpactFixture& fixture)
+{
+	AllocationPause pause;
+	collected.insert(collected.end(), fixture.fns.begin(), fixture.fns.end());
+	overflowed |= fixture.overflow;
+}
+
+inline void QTestImpactMap::end(const std::string& id)
+{
+	#ifdef Q_TEST__HAS_IMPACT
+	__atomic_store_n(&impact_active, 0, __ATOMIC_RELAXED);
+	#endif
+	AllocationPause pause;
+	overflowed |= drain(collected);
+	if (overflowed) {
+		recorded[id] = {};
+	} else if (!collected.empty()) {
+		recorded[id] = std::move(collected);
+	}
+	collected.clear();
+}
+
+inline std::map<void*, ImpactLocation> QTestImpactMap::symbolize()
+{
+	std::map<void*, ImpactLocation> res;
+	#ifdef Q_TEST__HAS_IMPACT
+	std::map<std::string, std::vector<std::pair<void*, uintptr_t>>> objects;
+	for (auto& [id, fns] : recorded) {
+		for (void* fn : fns) {
+			if (res.count(fn)) continue;
+			res[fn] = {};
+			Dl_info info;
+			if (!dladdr(fn, &info) || !info.dli_fname) continue;
+			objects[info.dli_fname].push_back({fn, (uintptr_t)fn - (uintptr_t)info.dli_fbase});
+		}
+	}
+	for (auto& [file, fns] : objects) {
+		uint16_t type = 0;
+		int fd = open(file.c_str(), O_RDONLY);
+		if (fd >= 0 && pread(fd, &type, sizeof(type), 16) != sizeof(type)) type = 0;
+		if (fd >= 0) close(fd);
+		std::string quoted = "'";
+		for (char c : file) {
+			quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+		}
+		quoted += "'";
+		for (size_t start=0;start<fns.size();start+=512) {
+			std::string cmd = "addr2line -f -C -e " + quoted;
+			size_t end = std::min(fns.size(), start + 512);
+			for (size_t i=start;i<end;i++) {
+				char buf[32];
+				std::snprintf(buf, sizeof(buf), " 0x%zx", type == 2 ? (size_t)fns[i].first : (size_t)fns[i].second);
+				cmd += buf;
+			}
+			std::FILE* out = popen(cmd.c_str(), "r");
+			if (!out) continue;
+			char function[4096], location[4096];
+			for (size_t i=start;i<end && std::fgets(function, sizeof(function), out) && std::fgets(location, sizeof(location), out);i++) {
+				std::string loc = location;
+				loc = loc.substr(0, loc.rfind(':'));
+				std::string name = function;
+				if (!name.empty() && name.back() == '\n') name.pop_back();
+				if (loc != "??") res[fns[i].first] = {loc, name};
+			}
+			pclose(out);
+		}
+	}
+	#endif
+	return res;
+}
+
+inline void QTestImpactMap::save()
+{
+	if (recorded.empty()) return;
+	std::map<void*, ImpactLocation> symbols = symbolize();
+	for (auto& [id, fns] : recorded) {
+		std::set<std::pair<std::string, std::string>> locations;
+		for (void* fn : fns) {
+			ImpactLocation& l = symbols[fn];
+			if (!l.file.empty()) locations.insert({l.file, l.function});
+		}
+		std::vector<ImpactLocation>& test = previous[id];
+		test.clear();
+		for (auto& [file, function] : locations) {
+			test.push_back({file, function});
+		}
+	}
+	std::ofstream out(path, std::ios::trunc);
+	for (auto& [id, locations] : previous) {
+		if (locations.empty()) continue;
+		out << "test " << id << '\n';
+		for (auto& l : locations) {
+			out << l.file << '\t' << l.function << '\n';
+		}
+	}
+}
+
+class QTestPrint {
+	enum class Color{Success, Error, Neutral, Grey, Default};
+	using test_infos = std::vector<std::stringstream>;
+	public:
+		QTestPrint();
+		void print(std::string_view s);
+		void print(std::string&& s);
+		void print(const char* s);
+		void print_description(std::string_view str);
+		void print_test(std::string_view str, bool good, bool skipped);
+		void print_test_info(std::string_view arr);
+		void print_test_error(std::string_view s);
+		void print_benchmark(std::string_view s);
+		void print_test_stats(std::string_view s);
+		void print_describe_stats(std::string_view descr, std::string_view s);
+		void print_failed_test(std::string_view str, std::string_view file, int line);
+		void print_statistics(int tests_count, int tests_failed, int tests_skipped);
+		void print_top_allocations(std::vector<std::string>& lines);
+		void print_start();
+		void print_title(std::string_view str);
+		void print_delimeter();
+		void print_delimeter(std::string_view c);
+		void print_error(std::string_view s);
+		void print_success(std::string_view s);
+		void print_neutral(std::string_view s);
+		void print_grey(std::string_view s);
+		void print_error_sign();
+		void print_success_sign();
+		void print_skip_sign();
+		void print_succeed_message();
+		void print_failure_message();
+
+	private:
+		std::string create_titled_message(std::string_view str);
+		std::string toupper(std::string_view txt);
+		void processConsoleWindow();
+		void set_color_default();
+		void set_color_error();
+		void set_color_success();
+		void set_color_neutral();
+		void set_color_grey();
+		void set_color(Color c);
+
+		#ifdef _WIN32
+		HANDLE hConsole;
+		DWORD def_bgcolor, def_color;
+		#endif
+		int line_length = 60;
+		static constexpr std::string_view newline = "\n";
+		static constexpr std::string_view tab = "    ";
+		static constexpr std::string_view delim_txt = "*";
+		static constexpr std::string_view succeed_txt = "succeed";
+		static constexpr std::string_view failed_txt = "failed";
+		static constexpr std::string_view skipped_txt = "skipped";
+		static constexpr std::string_view statistics_txt = "statistics";
+		static constexpr std::string_view testing_txt = "testing";
+		static constexpr std::string_view allocations_txt = "top allocations";
+		static constexpr std::string_view succ_sign = "[/]";
+		static constexpr std::string_view fail_sign = "[x]";
+		static constexpr std::string_view skip_sign = "[-]";
+};
+
+struct QTestScenario { QTestScenario(std::function<void()> fn) { fn(); } };
+
+template<typename... Ts> struct TypeList {};
+template<typename T> struct TypeTag { using type = T; };
+
+template<typename T>
+inline std::string type_name()
+{
+	#ifdef _MSC_VER
+	std::string_view name = __FUNCSIG__;
+	size_t from = name.find("type_name<") + 10;
+	size_t to = name.rfind(">(void)");
+	#else
+	std::string_view name = __PRETTY_FUNCTION__;
+	size_t from = name.find("T = ") + 4;
+	size_t to = name.find(';', from);
+	if (to == std::string_view::npos) to = name.rfind(']');
+	#endif
+	return std::string(name.substr(from, to - from));
+}
+
+inline std::string sanitize(std::string& value)
+{
+	std::string str;
+	for (char c : value) {
+		switch(c) {
+			case '\n':
+				str.append("\\n");
+				break;
+			case '\r':
+				str.append("\\r");
+				break;
+			case '\t':
+				str.append("\\t");
+				break;
+			case '\b':
+				str.append("\\b");
+				break;
+			case '\x1b':
+				str.append("\\x1b");
+				break;
+			default:
+				str.push_back(c);
+		}
+	}
+	return str;
+}
+
+inline int lowest_bit_index(unsigned mask)
+{
+	#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+	#else
+	return __builtin_ctz(mask);
+	#endif
+}
+
+inline size_t find_substring(std::string_view haystack, std::string_view needle)
+{
+	const size_t n = haystack.size();
+	const size_t k = needle.size();
+	if (k == 0) return 0;
+	if (k > n) return std::string_view::npos;
+	const char* hs = haystack.data();
+	const char* nd = needle.data();
+	size_t i = 0;
+	#ifdef Q_TEST__HAS_SSE2
+	const __m128i first = _mm_set1_epi8(nd[0]);
+	const __m128i last = _mm_set1_epi8(nd[k-1]);
+	for (; i + k + 15 <= n; i += 16) {
+		const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hs + i));
+		const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hs + i + k - 1));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+		while (mask) {
+			const int bit = lowest_bit_index(mask);
+			if (std::memcmp(hs + i + bit + 1, nd + 1, k - 1) == 0) {
+				return i + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+	#endif
+	while (i + k <= n) {
+		const void* p = std::memchr(hs + i, nd[0], n - k + 1 - i);
+		if (!p) break;
+		i = (size_t)(static_cast<const char*>(p) - hs);
+		if (std::memcmp(hs + i + 1, nd + 1, k - 1) == 0) {
+			return i;
+		}
+		++i;
+	}
+	return std::string_view::npos;
+}
+
+inline std::pair<size_t, size_t> find_nearest_match(std::string_view haystack, std::string_view needle)
+{
+	size_t lo = 0, hi = needle.size(), pos = std::string_view::npos;
+	while (lo < hi) {
+		size_t mid = (lo + hi + 1) / 2;
+		size_t p = find_substring(haystack, needle.substr(0, mid));
+		if (p != std::string_view::npos) {
+			lo = mid;
+			pos = p;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return {pos, lo};
+}
+
+inline std::string excerpt_region(std::string_view str, size_t pos, size_t len)
+{
+	constexpr size_t context = 20;
+	size_t from = pos > context ? pos - context : 0;
+	size_t to = std::min(str.size(), pos + len + context);
+	std::string region(str.substr(from, to - from));
+	std::string res = from > 0 ? "..." : "";
+	res += sanitize(region);
+	if (to < str.size()) res += "...";
+	return res;
+}
+
+inline const std::regex& cached_regex(std::string_view pattern)
+{
+	static std::unordered_map<std::string, std::regex> cache;
+	static std::mutex mtx;
+	std::lock_guard<std::mutex> lock(mtx);
+	AllocationPause pause;
+	auto it = cache.find(std::string(pattern));
+	if (it == cache.end()) {
+		it = cache.emplace(std::string(pattern), std::regex(pattern.begin(), pattern.end())).first;
+	}
+	return it->second;
+}
+
+inline QTestMappedFile::QTestMappedFile(const std::string& path)
+{
+	#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) return;
+	size = (size_t)file_size.QuadPart;
+	opened = true;
+	if (!size) return;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping) {
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	opened = data != nullptr;
+	#else
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	struct stat st;
+	if (fstat(fd, &st) != 0) return;
+	size = (size_t)st.st_size;
+	opened = true;
+	if (!size) return;
+	void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED) {
+		opened = false;
+		return;
+	}
+	madvise(ptr, size, MADV_SEQUENTIAL);
+	data = static_cast<const char*>(ptr);
+	#endif
+}
+
+inline QTestMappedFile::~QTestMappedFile()
+{
+	#ifdef _WIN32
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	#else
+	if (data) munmap(const_cast<char*>(data), size);
+	if (fd >= 0) close(fd);
+	#endif
+}
+
+inline std::string_view snapshot_line_at(std::string_view str, size_t offset)
+{
+	offset = std::min(offset, str.size());
+	size_t from = str.rfind('\n', offset ? offset - 1 : 0);
+	from = (from == std::string_view::npos || from >= offset) ? 0 : from + 1;
+	size_t to = str.find('\n', offset);
+	if (to == std::string_view::npos) to = str.size();
+	constexpr size_t max_line = 120;
+	if (to - from > max_line) {
+		from = offset > max_line / 2 ? offset - max_line / 2 : 0;
+		to = std::min(str.size(), from + max_line);
+	}
+	return str.substr(from, to - from);
+}
+
+inline SnapshotResult compare_snapshot(std::string_view actual, const std::string& path)
+{
+	SnapshotResult res;
+	QTestMappedFile file(path);
+	if (!file.is_open()) {
+		res.hint = "snapshot " + path + " can't be read";
+		return res;
+	}
+	res.exists = true;
+	std::string_view expected = file.view();
+	constexpr size_t chunk = 1 << 20;
+	size_t common = std::min(actual.size(), expected.size());
+	size_t offset = 0;
+	while (offset < common) {
+		size_t len = std::min(chunk, common - offset);
+		if (std::memcmp(actual.data() + offset, expected.data() + offset, len) != 0) {
+			auto diff = std::mismatch(actual.begin() + offset, actual.begin() + offset + len, expected.begin() + offset);
+			offset = diff.first - actual.begin();
+			break;
+		}
+		offset += len;
+	}
+	res.offset = offset;
+	res.equal = offset == common && actual.size() == expected.size();
+	if (res.equal) return res;
+	size_t line = 1 + std::count(expected.begin(), expected.begin() + offset, '\n');
+	std::string expected_line(snapshot_line_at(expected, offset));
+	std::string actual_line(snapshot_line_at(actual, offset));
+	res.hint = "first difference at offset " + std::to_string(offset) + " (line " + std::to_string(line) + "), sizes "
+		+ std::to_string(actual.size()) + " vs " + std::to_string(expected.size()) + " in " + path + "\n"
+		+ "-" + sanitize(expected_line) + "\n"
+		+ "+" + sanitize(actual_line);
+	return res;
+}
+
+inline bool write_snapshot(std::string_view actual, const std::string& path)
+{
+	std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+		if (!out) return false;
+		out.write(actual.data(), actual.size());
+		if (!out) return false;
+	}
+	#ifdef _WIN32
+	return MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+	#else
+	return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+	#endif
+}
+
+template<typename T>
+inline void do_not_optimize(T& value)
+{
+	#ifdef _MSC_VER
+	const volatile void* ptr = &value;
+	(void)ptr;
+	_ReadWriteBarrier();
+	#else
+	asm volatile("" : : "r,m"(value) : "memory");
+	#endif
+}
+
+template<typename T>
+inline void do_not_optimize(const T& value)
+{
+	#ifdef _MSC_VER
+	const volatile void* ptr = &value;
+	(void)ptr;
+	_ReadWriteBarrier();
+	#else
+	asm volatile("" : : "r,m"(value) : "memory");
+	#endif
+}
+
+inline void clobber_memory()
+{
+	#ifdef _MSC_VER
+	_ReadWriteBarrier();
+	#else
+	asm volatile("" : : : "memory");
+	#endif
+}
+
+template<typename F>
+BenchmarkStats QTestBenchmark::run(F&& fn)
+{
+	BenchmarkStats stats;
+	uint64_t iterations = calibrate(fn);
+	if (should_stop()) return stats;
+	std::vector<double> samples;
+	samples.reserve(TEST_BENCHMARK_SAMPLES);
+	for (int i=0;i<TEST_BENCHMARK_SAMPLES && !should_stop();i++) {
+		samples.push_back(run_batch(fn, iterations) / iterations);
+	}
+	stats = calculate_stats(std::move(samples));
+	stats.iterations = iterations;
+	return stats;
+}
+
+template<typename F, typename G>
+CompareStats QTestBenchmark::compare(F& baseline, G& candidate)
+{
+	uint64_t baseline_iterations = calibrate(baseline);
+	uint64_t candidate_iterations = calibrate(candidate);
+	if (should_stop()) return {};
+	std::vector<double> baseline_samples, candidate_samples;
+	baseline_samples.reserve(TEST_BENCHMARK_SAMPLES);
+	candidate_samples.reserve(TEST_BENCHMARK_SAMPLES);
+	for (int i=0;i<TEST_BENCHMARK_SAMPLES && !should_stop();i++) {
+		if (i % 2) {
+			candidate_samples.push_back(run_batch(candidate, candidate_iterations) / candidate_iterations);
+			baseline_samples.push_back(run_batch(baseline, baseline_iterations) / baseline_iterations);
+		} else {
+			baseline_samples.push_back(run_batch(baseline, baseline_iterations) / baseline_iterations);
+			candidate_samples.push_back(run_batch(candidate, candidate_iterations) / candidate_iterations);
+		}
+	}
+	CompareStats stats = calculate_comparison(std::move(baseline_samples), std::move(candidate_samples));
+	stats.baseline.iterations = baseline_iterations;
+	stats.candidate.iterations = candidate_iterations;
+	return stats;
+}
+
+template<typename F>
+double QTestBenchmark::run_batch(F& fn, uint64_t iterations)
+{
+	auto start = clock::now();
+	for (uint64_t i=0;i<iterations;i++) {
+		fn();
+	}
+	auto end = clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+template<typename F>
+uint64_t QTestBenchmark::calibrate(F& fn)
+{
+	constexpr double warmup_ns = TEST_BENCHMARK_WARMUP_MS * 1e6;
+	constexpr double min_time_ns = TEST_BENCHMARK_MIN_TIME_MS * 1e6;
+	double warmed = 0;
+	uint64_t iterations = 1;
+	while (warmed < warmup_ns && !should_stop()) {
+		double took = run_batch(fn, iterations);
+		warmed += took;
+		if (took >= min_time_ns) break;
+		iterations *= 2;
+	}
+	while (!should_stop()) {
+		double took = run_batch(fn, iterations);
+		if (took >= min_time_ns) break;
+		double factor = took > 0 ? std::min(10.0, 1.2 * min_time_ns / took) : 10.0;
+		iterations = std::max(iterations + 1, (uint64_t)(iterations * factor));
+	}
+	return iterations;
+}
+
+inline BenchmarkStats QTestBenchmark::calculate_stats(std::vector<double> samples)
+{
+	BenchmarkStats stats;
+	if (samples.empty()) return stats;
+	size_t n = samples.size();
+	stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / n;
+	double sq = 0;
+	for (double s : samples) {
+		sq += (s - stats.mean) * (s - stats.mean);
+	}
+	stats.stddev = n > 1 ? std::sqrt(sq / (n - 1)) : 0;
+	std::vector<double> sorted = samples;
+	std::sort(sorted.begin(), sorted.end());
+	stats.min = sorted.front();
+	stats.median = n % 2 ? sorted[n/2] : (sorted[n/2 - 1] + sorted[n/2]) / 2;
+	stats.samples = std::move(samples);
+	return stats;
+}
+
+inline double mann_whitney_p(const std::vector<double>& a, const std::vector<double>& b)
+{
+	size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+	if (!n1 || !n2) return 1;
+	std::vector<std::pair<double, bool>> all;
+	all.reserve(n);
+	for (double v : a) all.push_back({v, true});
+	for (double v : b) all.push_back({v, false});
+	std::sort(all.begin(), all.end());
+	double rank_sum = 0, ties = 0;
+	for (size_t i=0;i<n;) {
+		size_t j = i;
+		while (j < n && all[j].first == all[i].first) j++;
+		double rank = (i + j + 1) / 2.0;
+		for (size_t k=i;k<j;k++) {
+			if (all[k].second) rank_sum += rank;
+		}
+		double t = j - i;
+		ties += t * t * t - t;
+		i = j;
+	}
+	double u = rank_sum - n1 * (n1 + 1) / 2.0;
+	double mu = n1 * n2 / 2.0;
+	double sigma = std::sqrt(n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1.0))));
+	if (sigma == 0) return 1;
+	double z = std::max(0.0, std::abs(u - mu) - 0.5) / sigma;
+	return std::erfc(z / std::sqrt(2.0));
+}
+
+inline CompareStats QTestBenchmark::calculate_comparison(std::vector<double> baseline, std::vector<double> candidate)
+{
+	CompareStats stats;
+	stats.p_value = mann_whitney_p(baseline, candidate);
+	std::vector<double> diffs;
+	for (double b : baseline) {
+		for (double c : candidate) {
+			if (b > 0 && c > 0) diffs.push_back(std::log(b) - std::log(c));
+		}
+	}
+	if (!diffs.empty()) {
+		std::sort(diffs.begin(), diffs.end());
+		size_t m = diffs.size();
+		double n1 = baseline.size(), n2 = candidate.size();
+		double k = m / 2.0 - 1.96 * std::sqrt(n1 * n2 * (n1 + n2 + 1) / 12.0);
+		size_t low = k > 0 ? (size_t)k : 0;
+		double median = m % 2 ? diffs[m/2] : (diffs[m/2 - 1] + diffs[m/2]) / 2;
+		stats.speedup = std::exp(median);
+		stats.speedup_low = std::exp(diffs[low]);
+		stats.speedup_high = std::exp(diffs[m - 1 - low]);
+	}
+	stats.baseline = calculate_stats(std::move(baseline));
+	stats.candidate = calculate_stats(std::move(candidate));
+	return stats;
+}
+
+inline QTestBaseline::QTestBaseline(std::string path) : path(path)
+{
+	std::ifstream in(path);
+	std::string line;
+	while (std::getline(in, line)) {
+		std::stringstream ss(line);
+		BaselineEntry entry;
+		std::string key;
+		if (!(ss >> entry.median >> entry.stddev >> entry.samples)) continue;
+		ss.get();
+		std::getline(ss, key);
+		entries[key] = entry;
+	}
+	writable = !in.is_open();
+	#ifdef TEST_BENCHMARK_BASELINE_UPDATE
+	writable = true;
+	#endif
+}
+
+inline BaselineEntry* QTestBaseline::find(const std::string& key)
+{
+	auto it = entries.find(key);
+	return it == entries.end() ? nullptr : &it->second;
+}
+
+inline void QTestBaseline::record(const std::string& key, BenchmarkStats& stats)
+{
+	if (!writable) return;
+	entries[key] = {stats.median, stats.stddev, stats.samples.size()};
+	changed = true;
+}
+
+inline bool QTestBaseline::is_regression(BaselineEntry& entry, BenchmarkStats& stats)
+{
+	if (stats.median <= entry.median * (1 + TEST_BENCHMARK_TOLERANCE)) return false;
+	double n_base = std::max<size_t>(entry.samples, 1);
+	double n_cur = std::max<size_t>(stats.samples.size(), 1);
+	double noise = std::sqrt(entry.stddev * entry.stddev / n_base + stats.stddev * stats.stddev / n_cur);
+	return stats.median - entry.median > 3 * noise;
+}
+
+inline void QTestBaseline::save()
+{
+	if (!changed) return;
+	std::ofstream out(path, std::ios::trunc);
+	out.precision(17);
+	for (auto& [key, entry] : entries) {
+		out << entry.median << ' ' << entry.stddev << ' ' << entry.samples << ' ' << key << '\n';
+	}
+}
+
+inline std::string format_number(double value, const char* unit)
+{
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "%.2f %s", value, unit);
+	return buf;
+}
+
+inline std::string format_percent(double fraction)
+{
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%g%%", fraction * 100);
+	return buf;
+}
+
+inline std::string format_duration(double ns)
+{
+	if (ns < 1e3) return format_number(ns, "ns");
+	if (ns < 1e6) return format_number(ns / 1e3, "us");
+	if (ns < 1e9) return format_number(ns / 1e6, "ms");
+	return format_number(ns / 1e9, "s");
+}
+
+inline std::string format_rate(double per_second, const char* unit)
+{
+	const char* prefixes[] = {"", "k", "M", "G", "T"};
+	int i = 0;
+	while (per_second >= 1000 && i < 4) {
+		per_second /= 1000;
+		i++;
+	}
+	std::string full_unit = std::string(prefixes[i]) + unit;
+	if (full_unit[0] == ' ') full_unit.erase(0, 1);
+	return format_number(per_second, full_unit.c_str());
+}
+
+inline int highest_bit_index(uint64_t value)
+{
+	#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (int)index;
+	#else
+	return 63 - __builtin_clzll(value);
+	#endif
+}
+
+class LatencyHistogram {
+	static constexpr int sub_bits = 7;
+	static constexpr uint64_t sub_count = 1 << sub_bits;
+
+	public:
+		LatencyHistogram() : counts((64 - sub_bits + 1) * sub_count, 0) {}
+		void record(uint64_t ns);
+		uint64_t percentile(double p);
+		uint64_t max() { return max_value; }
+		uint64_t min() { return total ? min_value : 0; }
+		double mean() { return total ? (double)sum / total : 0; }
+		uint64_t count() { return total; }
+		std::string summary();
+
+	private:
+		size_t index_of(uint64_t ns);
+		uint64_t highest_value_at(size_t index);
+
+		std::vector<uint64_t> counts;
+		uint64_t total = 0;
+		uint64_t sum = 0;
+		uint64_t min_value = UINT64_MAX;
+		uint64_t max_value = 0;
+};
+
+class QTestLatency {
+	public:
+		QTestLatency(LatencyHistogram&& histogram, bool* result, ErrorReport* error)
+			: histogram(std::move(histogram)), result(result), error(error) {}
+		template<typename R, typename P> bool percentileToBeLessThan(double p, std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool p50ToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool p90ToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool p99ToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool p999ToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool maxToBeLessThan(std::chrono::duration<R, P> compare);
+
+		template<typename R, typename P> bool percentile_to_be_less_than(double p, std::chrono::duration<R, P> compare) { return percentileToBeLessThan(p, compare); }
+		template<typename R, typename P> bool p50_to_be_less_than(std::chrono::duration<R, P> compare) { return p50ToBeLessThan(compare); }
+		template<typename R, typename P> bool p90_to_be_less_than(std::chrono::duration<R, P> compare) { return p90ToBeLessThan(compare); }
+		template<typename R, typename P> bool p99_to_be_less_than(std::chrono::duration<R, P> compare) { return p99ToBeLessThan(compare); }
+		template<typename R, typename P> bool p999_to_be_less_than(std::chrono::duration<R, P> compare) { return p999ToBeLessThan(compare); }
+		template<typename R, typename P> bool max_to_be_less_than(std::chrono::duration<R, P> compare) { return maxToBeLessThan(compare); }
+
+	private:
+		template<typename R, typename P> bool check(std::string_view func, uint64_t value, std::chrono::duration<R, P> compare, std::string prefix = "");
+
+		LatencyHistogram histogram;
+		bool* result;
+		ErrorReport* error;
+};
+
+inline size_t LatencyHistogram::index_of(uint64_t ns)
+{
+	if (ns < sub_count) return ns;
+	int shift = highest_bit_index(ns) - sub_bits;
+	return sub_count * (shift + 1) + ((ns >> shift) - sub_count);
+}
+
+inline uint64_t LatencyHistogram::highest_value_at(size_t index)
+{
+	if (index < sub_count) return index;
+	int shift = index / sub_count - 1;
+	uint64_t lowest = (sub_count + index % sub_count) << shift;
+	return lowest + ((uint64_t(1) << shift) - 1);
+}
+
+inline void LatencyHistogram::record(uint64_t ns)
+{
+	counts[index_of(ns)]++;
+	total++;
+	sum += ns;
+	min_value = std::min(min_value, ns);
+	max_value = std::max(max_value, ns);
+}
+
+inline uint64_t LatencyHistogram::percentile(double p)
+{
+	if (!total) return 0;
+	uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p / 100 * total));
+	uint64_t seen = 0;
+	for (size_t i=0;i<counts.size();i++) {
+		seen += counts[i];
+		if (seen >= rank) return std::min(highest_value_at(i), max_value);
+	}
+	return max_value;
+}
+
+inline std::string LatencyHistogram::summary()
+{
+	return "min " + format_duration(min()) + ", p50 " + format_duration(percentile(50))
+		+ ", p90 " + format_duration(percentile(90)) + ", p99 " + format_duration(percentile(99))
+		+ ", p99.9 " + format_duration(percentile(99.9)) + ", max " + format_duration(max())
+		+ ", mean " + format_duration(mean()) + " (" + std::to_string(total) + " calls)";
+}
+
+template<typename R, typename P>
+bool QTestLatency::check(std::string_view func, uint64_t value, std::chrono::duration<R, P> compare, std::string prefix)
+{
+	double limit = std::chrono::duration<double, std::nano>(compare).count();
+	if (!(*result &= value < limit)) {
+		AllocationPause pause;
+		error->func = func;
+		error->value = format_duration(value);
+		error->compare = prefix + format_duration(limit);
+		error->hint = histogram.summary();
+		error->has_compare = true;
+		error->value_substituted = true;
+		error->compare_substituted = true;
+	}
+	return *result;
+}
+
+template<typename R, typename P>
+bool QTestLatency::percentileToBeLessThan(double p, std::chrono::duration<R, P> compare)
+{
+	char prefix[32];
+	std::snprintf(prefix, sizeof(prefix), "%g, ", p);
+	return check(__func__, histogram.percentile(p), compare, prefix);
+}
+
+template<typename R, typename P>
+bool QTestLatency::p50ToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.percentile(50), compare);
+}
+
+template<typename R, typename P>
+bool QTestLatency::p90ToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.percentile(90), compare);
+}
+
+template<typename R, typename P>
+bool QTestLatency::p99ToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.percentile(99), compare);
+}
+
+template<typename R, typename P>
+bool QTestLatency::p999ToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.percentile(99.9), compare);
+}
+
+template<typename R, typename P>
+bool QTestLatency::maxToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.max(), compare);
+}
+inline const char* complexity_name(Complexity c)
+{
+	switch (c) {
+		case Complexity::O1: return "O(1)";
+		case Complexity::LogN: return "O(log n)";
+		case Complexity::N: return "O(n)";
+		case Complexity::NLogN: return "O(n log n)";
+		case Complexity::N2: return "O(n^2)";
+	}
+	return "";
+}
+
+inline double complexity_curve(Complexity c, double n)
+{
+	switch (c) {
+		case Complexity::O1: return 1;
+		case Complexity::LogN: return std::log2(n);
+		case Complexity::N: return n;
+		case Complexity::NLogN: return n * std::log2(n);
+		case Complexity::N2: return n * n;
+	}
+	return 1;
+}
+
+inline ComplexityFit fit_complexity(std::vector<ComplexityPoint> points)
+{
+	ComplexityFit fit;
+	double best_rms = std::numeric_limits<double>::max();
+	for (int i=0;i<5;i++) {
+		Complexity c = (Complexity)i;
+		double num = 0, den = 0;
+		for (auto& p : points) {
+			double x = complexity_curve(c, p.n) / p.ns;
+			num += x;
+			den += x * x;
+		}
+		double a = den > 0 ? num / den : 0;
+		double sq = 0;
+		for (auto& p : points) {
+			double r = 1 - a * complexity_curve(c, p.n) / p.ns;
+			sq += r * r;
+		}
+		fit.coefficients[i] = a;
+		fit.rms[i] = points.empty() ? 0 : std::sqrt(sq / points.size());
+		if (fit.rms[i] < best_rms) {
+			best_rms = fit.rms[i];
+			fit.best = c;
+		}
+	}
+	fit.points = std::move(points);
+	return fit;
+}
+
+template<typename F>
+ComplexityFit measure_complexity(F& fn)
+{
+	using clock = std::chrono::steady_clock;
+	constexpr double budget_ns = TEST_COMPLEXITY_BUDGET_MS * 1e6;
+	constexpr double min_time_ns = 1e5;
+	std::vector<ComplexityPoint> points;
+	double spent = 0;
+	for (size_t n = TEST_COMPLEXITY_MIN_N; n <= (size_t)TEST_COMPLEXITY_MAX_N; n *= 2) {
+		double best = std::numeric_limits<double>::max();
+		double step = 0;
+		for (int rep=0;rep<3;rep++) {
+			uint64_t calls = 0;
+			double took = 0;
+			auto start = clock::now();
+			do {
+				fn(n);
+				calls++;
+				took = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+			} while (took < min_time_ns);
+			best = std::min(best, took / calls);
+			step += took;
+		}
+		points.push_back({(double)n, best});
+		spent += step;
+		if (spent + step * 4 > budget_ns) break;
+	}
+	return fit_complexity(std::move(points));
+}
+
+inline std::string generate_complexity_hint(ComplexityFit& fit, Complexity expected)
+{
+	char buf[128];
+	std::string res;
+	for (int i=0;i<5;i++) {
+		std::snprintf(buf, sizeof(buf), "%s%s rms %.1f%%", i ? ", " : "fit: ", complexity_name((Complexity)i), fit.rms[i] * 100);
+		res += buf;
+	}
+	int e = (int)expected;
+	for (auto& p : fit.points) {
+		double predicted = fit.coefficients[e] * complexity_curve(expected, p.n);
+		std::snprintf(buf, sizeof(buf), "\nn=%.0f: ", p.n);
+		res += buf + format_duration(p.ns) + ", " + complexity_name(expected) + " predicts " + format_duration(predicted);
+		if (predicted > 0) {
+			std::snprintf(buf, sizeof(buf), " (%+.1f%%)", (p.ns / predicted - 1) * 100);
+			res += buf;
+		}
+	}
+	return res;
+}
+struct ScalingPoint {
+	unsigned threads = 0;
+	uint64_t ops = 0;
+	double throughput = 0;
+	double efficiency = 0;
+};
+
+class SpinBarrier {
+	public:
+		void arrive() { ready.fetch_add(1, std::memory_order_acq_rel); }
+		void wait_start() { while (!started.load(std::memory_order_acquire)) std::this_thread::yield(); }
+		void start(unsigned threads);
+
+	private:
+		std::atomic<unsigned> ready{0};
+		std::atomic<bool> started{false};
+};
+
+struct ThreadFailure {
+	ThreadFailure* next = nullptr;
+	std::thread::id thread;
+	std::string_view expect_str;
+	ErrorReport error;
+	bool result = true;
+};
+
+class ThreadFailures {
+	public:
+		~ThreadFailures() { take(); }
+		ThreadFailure& node();
+		std::vector<ThreadFailure*> take();
+
+	private:
+		std::atomic<ThreadFailure*> head{nullptr};
+		std::atomic<unsigned> generation{1};
+		std::vector<std::unique_ptr<ThreadFailure>> retired;
+};
+
+inline thread_local ThreadFailure* thread_failure = nullptr;
+inline thread_local unsigned thread_failure_generation = 0;
+
+struct StressStats {
+	unsigned threads = 0;
+	uint64_t iterations = 0;
+	double duration = 0;
+	double throughput = 0;
+	unsigned failed_threads = 0;
+};
+
+inline thread_local unsigned stress_thread = 0;
+
+class QTestScaling {
+	public:
+		QTestScaling(std::vector<ScalingPoint>&& points, bool* result, ErrorReport* error)
+			: points(std::move(points)), result(result), error(error) {}
+		bool throughputToBeGreaterThan(double ops_per_second, unsigned threads);
+		bool efficiencyToBeGreaterThan(double efficiency, unsigned threads);
+
+		bool throughput_to_be_greater_than(double ops_per_second, unsigned threads) { return throughputToBeGreaterThan(ops_per_second, threads); }
+		bool efficiency_to_be_greater_than(double efficiency, unsigned threads) { return efficiencyToBeGreaterThan(efficiency, threads); }
+
+	private:
+		ScalingPoint* find(unsigned threads);
+		void report(std::string_view func, std::string value, std::string compare);
+
+		std::vector<ScalingPoint> points;
+		bool* result;
+		ErrorReport* error;
+};
+
+inline void SpinBarrier::start(unsigned threads)
+{
+	while (ready.load(std::memory_order_acquire) < threads) std::this_thread::yield();
+	started.store(true, std::memory_order_release);
+}
+
+inline ThreadFailure& ThreadFailures::node()
+{
+	unsigned current = generation.load(std::memory_order_acquire);
+	if (thread_failure_generation != current) {
+		AllocationPause pause;
+		thread_failure = new ThreadFailure();
+		thread_failure->thread = std::this_thread::get_id();
+		thread_failure_generation = current;
+		ThreadFailure* next = head.load(std::memory_order_relaxed);
+		do {
+			thread_failure->next = next;
+		} while (!head.compare_exchange_weak(next, thread_failure, std::memory_order_release, std::memory_order_relaxed));
+	}
+	return *thread_failure;
+}
+
+inline std::vector<ThreadFailure*> ThreadFailures::take()
+{
+	std::vector<ThreadFailure*> res;
+	generation.fetch_add(1, std::memory_order_acq_rel);
+	ThreadFailure* node = head.exchange(nullptr, std::memory_order_acquire);
+	AllocationPause pause;
+	retired.clear();
+	if (!node) return res;
+	for (;node;node=node->next) {
+		res.push_back(node);
+		retired.emplace_back(node);
+	}
+	std::reverse(res.begin(), res.end());
+	return res;
+}
+
+inline void pin_stress_thread(unsigned index)
+{
+	#if defined(TEST_STRESS_PIN) && defined(__linux__) && defined(__GLIBC__)
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || !CPU_COUNT(&allowed)) return;
+	unsigned n = index % CPU_COUNT(&allowed);
+	for (int cpu=0;cpu<CPU_SETSIZE;cpu++) {
+		if (!CPU_ISSET(cpu, &allowed) || n--) continue;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		return;
+	}
+	#else
+	(void)index;
+	#endif
+}
+
+inline std::string generate_stress_text(StressStats& stats)
+{
+	std::string res = "stress " + std::to_string(stats.threads) + " threads, " + std::to_string(stats.iterations) + " iterations in "
+		+ format_duration(stats.duration) + ", " + format_rate(stats.throughput, " ops/s");
+	if (stats.failed_threads) res += ", " + std::to_string(stats.failed_threads) + (stats.failed_threads == 1 ? " thread" : " threads") + " failed";
+	return res;
+}
+
+inline std::vector<unsigned> scaling_thread_counts(unsigned max_threads)
+{
+	std::vector<unsigned> counts;
+	for (unsigned t=1;t<max_threads;t*=2) {
+		counts.push_back(t);
+	}
+	counts.push_back(std::max(1u, max_threads));
+	return counts;
+}
+
+template<typename F>
+ScalingPoint measure_throughput(F& fn, unsigned threads)
+{
+	using clock = std::chrono::steady_clock;
+	AllocationPause pause;
+	SpinBarrier barrier;
+	std::atomic<bool> stop{false};
+	std::vector<uint64_t> ops(threads, 0);
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+	for (unsigned t=0;t<threads;t++) {
+		workers.emplace_back([&, t]{
+			AllocationPause pause;
+			barrier.arrive();
+			barrier.wait_start();
+			uint64_t count = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				fn(t);
+				count++;
+			}
+			ops[t] = count;
+		});
+	}
+	barrier.start(threads);
+	auto start = clock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(TEST_SCALING_TIME_MS));
+	stop.store(true, std::memory_order_relaxed);
+	for (auto& w : workers) {
+		w.join();
+	}
+	double seconds = std::chrono::duration<double>(clock::now() - start).count();
+	ScalingPoint point;
+	point.threads = threads;
+	for (uint64_t n : ops) {
+		point.ops += n;
+	}
+	point.throughput = seconds > 0 ? point.ops / seconds : 0;
+	return point;
+}
+
+template<typename F>
+std::vector<ScalingPoint> measure_scaling(F& fn, unsigned max_threads)
+{
+	std::vector<ScalingPoint> points;
+	for (unsigned threads : scaling_thread_counts(max_threads)) {
+		points.push_back(measure_throughput(fn, threads));
+		double single = points.front().throughput;
+		points.back().efficiency = single > 0 ? points.back().throughput / (single * threads) : 0;
+	}
+	return points;
+}
+
+inline std::string generate_scaling_table(std::vector<ScalingPoint>& points)
+{
+	char buf[128];
+	std::string res = "threads        throughput   speedup   efficiency";
+	for (auto& p : points) {
+		std::snprintf(buf, sizeof(buf), "\n%7u  %16s  %7.2fx  %10.1f%%", p.threads, format_rate(p.throughput, " ops/s").c_str(), p.efficiency * p.threads, p.efficiency * 100);
+		res += buf;
+	}
+	return res;
+}
+
+inline ScalingPoint* QTestScaling::find(unsigned threads)
+{
+	for (auto& p : points) {
+		if (p.threads == threads) return &p;
+	}
+	return nullptr;
+}
+
+inline void QTestScaling::report(std::string_view func, std::string value, std::string compare)
+{
+	error->func = func;
+	error->value = value;
+	error->compare = compare;
+	error->has_compare = true;
+	error->value_substituted = true;
+	error->compare_substituted = true;
+}
+
+inline bool QTestScaling::throughputToBeGreaterThan(double ops_per_second, unsigned threads)
+{
+	ScalingPoint* point = find(threads);
+	if (!(*result &= point && point->throughput > ops_per_second)) {
+		AllocationPause pause;
+		report(__func__, point ? format_rate(point->throughput, " ops/s") : "not measured", format_rate(ops_per_second, " ops/s") + ", " + std::to_string(threads));
+	}
+	return *result;
+}
+
+inline bool QTestScaling::efficiencyToBeGreaterThan(double efficiency, unsigned threads)
+{
+	ScalingPoint* point = find(threads);
+	if (!(*result &= point && point->efficiency > efficiency)) {
+		AllocationPause pause;
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%.2f", point ? point->efficiency : 0);
+		std::string value = point ? buf : "not measured";
+		std::snprintf(buf, sizeof(buf), "%.2f, %u", efficiency, threads);
+		report(__func__, value, buf);
+	}
+	return *result;
+}
+struct PerfCounters {
+	bool available = false;
+	unsigned opened = 0;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t branch_misses = 0;
+	uint64_t l1d_misses = 0;
+	uint64_t llc_misses = 0;
+	uint64_t dtlb_misses = 0;
+};
+
+class QTestPerf {
+	static constexpr int counters_count = 6;
+
+	public:
+		QTestPerf();
+		~QTestPerf();
+		QTestPerf(const QTestPerf&) = delete;
+		QTestPerf& operator=(const QTestPerf&) = delete;
+
+		bool is_available();
+		void start();
+		PerfCounters stop();
+
+	private:
+		int fds[counters_count] = {-1, -1, -1, -1, -1, -1};
+};
+
+inline QTestPerf::QTestPerf()
+{
+	#ifdef __linux__
+	constexpr uint64_t read_miss = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+	const std::pair<uint32_t, uint64_t> configs[counters_count] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | read_miss},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | read_miss},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | read_miss},
+	};
+	for (int i=0;i<counters_count;i++) {
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = configs[i].first;
+		attr.config = configs[i].second;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+	#endif
+}
+
+inline QTestPerf::~QTestPerf()
+{
+	#ifdef __linux__
+	for (int fd : fds) {
+		if (fd >= 0) close(fd);
+	}
+	#endif
+}
+
+inline bool QTestPerf::is_available()
+{
+	for (int fd : fds) {
+		if (fd >= 0) return true;
+	}
+	return false;
+}
+
+inline void QTestPerf::start()
+{
+	#ifdef __linux__
+	for (int fd : fds) {
+		if (fd < 0) continue;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	#endif
+}
+
+inline PerfCounters QTestPerf::stop()
+{
+	PerfCounters counters;
+	#ifdef __linux__
+	uint64_t PerfCounters::* fields[counters_count] = {
+		&PerfCounters::cycles, &PerfCounters::instructions, &PerfCounters::branch_misses,
+		&PerfCounters::l1d_misses, &PerfCounters::llc_misses, &PerfCounters::dtlb_misses,
+	};
+	for (int i=0;i<counters_count;i++) {
+		if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+	for (int i=0;i<counters_count;i++) {
+		uint64_t data[3];
+		if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data)) continue;
+		counters.*fields[i] = data[2] ? (uint64_t)((double)data[0] * data[1] / data[2]) : 0;
+		counters.opened |= 1u << i;
+	}
+	counters.available = counters.opened != 0;
+	#endif
+	return counters;
+}
+
+template<typename F>
+PerfCounters measure_perf_counters(F&& fn)
+{
+	QTestPerf perf;
+	perf.start();
+	fn();
+	return perf.stop();
+}
+
+inline std::string format_count(uint64_t value)
+{
+	const char* prefixes[] = {"", " k", " M", " G", " T"};
+	if (value < 1000) return std::to_string(value);
+	double v = value;
+	int i = 0;
+	while (v >= 1000 && i < 4) {
+		v /= 1000;
+		i++;
+	}
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.2f%s", v, prefixes[i]);
+	return buf;
+}
+
+inline std::string generate_perf_counters_text(PerfCounters& counters)
+{
+	const char* names[] = {"cycles", "instructions", "branch misses", "L1d misses", "LLC misses", "dTLB misses"};
+	uint64_t values[] = {counters.cycles, counters.instructions, counters.branch_misses, counters.l1d_misses, counters.llc_misses, counters.dtlb_misses};
+	std::string res;
+	for (int i=0;i<6;i++) {
+		if (!(counters.opened & (1u << i))) continue;
+		if (!res.empty()) res += ", ";
+		res += names[i] + std::string(" ") + format_count(values[i]);
+		if (i == 1 && (counters.opened & 1u) && counters.cycles) {
+			char ipc[32];
+			std::snprintf(ipc, sizeof(ipc), " (IPC %.2f)", (double)counters.instructions / counters.cycles);
+			res += ipc;
+		}
+	}
+	return res;
+}
+struct LockSite {
+	void* lock = nullptr;
+	std::string site;
+	uint64_t acquisitions = 0;
+	uint64_t contended = 0;
+	double wait = 0;
+	double hold = 0;
+};
+
+struct LockContention {
+	bool available = false;
+	uint64_t acquisitions = 0;
+	uint64_t contended = 0;
+	double wait = 0;
+	double hold = 0;
+	std::vector<LockSite> locks;
+};
+
+struct LockSlot {
+	static constexpr int max_depth = 8;
+	std::atomic<void*> lock{nullptr};
+	std::atomic<uint64_t> acquisitions{0};
+	std::atomic<uint64_t> contended{0};
+	std::atomic<uint64_t> wait{0};
+	std::atomic<uint64_t> hold{0};
+	void* frames[max_depth] = {};
+	int depth = 0;
+};
+
+struct HeldLock {
+	void* lock;
+	uint64_t since;
+	unsigned generation;
+};
+
+inline constexpr size_t lock_slots_count = 4096;
+inline constexpr int max_held_locks = 16;
+inline LockSlot lock_slots[lock_slots_count];
+inline std::atomic<int> lock_profile_depth{0};
+inline std::atomic<unsigned> lock_profile_generation{0};
+inline thread_local HeldLock held_locks[max_held_locks];
+inline thread_local int held_locks_count = 0;
+
+class QTestLockContention {
+	public:
+		QTestLockContention(LockContention&& contention, bool* result, ErrorReport* error)
+			: contention(std::move(contention)), result(result), error(error) {}
+		template<typename R, typename P> bool waitToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool holdToBeLessThan(std::chrono::duration<R, P> compare);
+		bool contendedToBeLessThan(uint64_t count);
+
+		template<typename R, typename P> bool wait_to_be_less_than(std::chrono::duration<R, P> compare) { return waitToBeLessThan(compare); }
+		template<typename R, typename P> bool hold_to_be_less_than(std::chrono::duration<R, P> compare) { return holdToBeLessThan(compare); }
+		bool contended_to_be_less_than(uint64_t count) { return contendedToBeLessThan(count); }
 
 	private:
-		bool proceed_result(bool result);
-		void report_error_resolved(std::string_view func, std::string_view value, std::string_view compare);
-		template<typename V, typename C> void report_error(std::string_view func, V&& value, C&& compare);
-		template<typename V> void report_error(std::string_view func, V&& value);
-		template<typename CT> std::string iterable_to_str(CT&& value);
-		template<typename CT> std::string streamable_to_str(CT&& value);
+		void report(std::string_view func, std::string value, std::string compare);
 
-		T val;
+		LockContention contention;
 		bool* result;
 		ErrorReport* error;
-		bool inv = false;
 };
 
-class QTestPrint {
-	enum class Color{Success, Error, Neutral, Grey, Default};
-	using test_infos = std::vector<std::stringstream>;
-	public:
-		QTestPrint();
-		void print(std::string_view s);
-		void print(std::string&& s);
-		void print(const char* s);
-		void print_description(std::string_view str);
-		void print_test(std::string_view str, bool good, bool skipped);
-		void print_test_info(std::string_view arr);
-		void print_test_error(std::string_view s);
-		void print_failed_test(std::string_view str, std::string_view file, int line);
-		void print_statistics(int tests_count, int tests_failed, int tests_skipped);
-		void print_start();
-		void print_title(std::string_view str);
-		void print_delimeter();
-		void print_delimeter(std::string_view c);
-		void print_error(std::string_view s);
-		void print_success(std::string_view s);
-		void print_neutral(std::string_view s);
-		void print_grey(std::string_view s);
-		void print_error_sign();
-		void print_success_sign();
-		void print_skip_sign();
-		void print_succeed_message();
-		void print_failure_message();
+inline uint64_t lock_clock()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-	private:
-		std::string create_titled_message(std::string_view str);
-		std::string toupper(std::string_view txt);
-		void processConsoleWindow();
-		void set_color_default();
-		void set_color_error();
-		void set_color_success();
-		void set_color_neutral();
-		void set_color_grey();
-		void set_color(Color c);
+inline LockSlot* lock_slot(void* lock, void* caller)
+{
+	size_t i = ((uintptr_t)lock >> 3) * 0x9E3779B97F4A7C15ull >> 52;
+	for (size_t probe=0;probe<64;probe++, i=(i + 1) & (lock_slots_count - 1)) {
+		LockSlot& s = lock_slots[i];
+		void* current = s.lock.load(std::memory_order_acquire);
+		if (current == lock) return &s;
+		if (current) continue;
+		if (!caller) return nullptr;
+		if (!s.lock.compare_exchange_strong(current, lock, std::memory_order_acq_rel)) {
+			if (current == lock) return &s;
+			continue;
+		}
+		s.frames[0] = caller;
+		s.depth = 1;
+		#ifdef Q_TEST__HAS_BACKTRACE
+		void* frames[LockSlot::max_depth + 8];
+		int depth = backtrace(frames, LockSlot::max_depth + 8);
+		for (int f=0;f<depth;f++) {
+			if (frames[f] != caller) continue;
+			s.depth = std::min(depth - f, LockSlot::max_depth);
+			std::copy(frames + f, frames + f + s.depth, s.frames);
+			break;
+		}
+		#endif
+		return &s;
+	}
+	return nullptr;
+}
 
-		#ifdef _WIN32
-		HANDLE hConsole;
-		DWORD def_bgcolor, def_color;
+inline void lock_acquired(void* lock, void* caller, uint64_t wait, bool contended)
+{
+	LockSlot* s = lock_slot(lock, caller);
+	if (!s) return;
+	s->acquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (contended) {
+		s->contended.fetch_add(1, std::memory_order_relaxed);
+		s->wait.fetch_add(wait, std::memory_order_relaxed);
+	}
+	unsigned generation = lock_profile_generation.load(std::memory_order_relaxed);
+	int kept = 0;
+	for (int i=0;i<held_locks_count;i++) {
+		if (held_locks[i].generation == generation) held_locks[kept++] = held_locks[i];
+	}
+	held_locks_count = kept;
+	if (held_locks_count == max_held_locks) return;
+	held_locks[held_locks_count++] = {lock, lock_clock(), generation};
+}
+
+inline void lock_released(void* lock)
+{
+	for (int i=0;i<held_locks_count;i++) {
+		if (held_locks[i].lock != lock) continue;
+		HeldLock held = held_locks[i];
+		std::copy(held_locks + i + 1, held_locks + held_locks_count, held_locks + i);
+		held_locks_count--;
+		if (held.generation != lock_profile_generation.load(std::memory_order_relaxed)) return;
+		LockSlot* s = lock_slot(lock, nullptr);
+		if (s) s->hold.fetch_add(lock_clock() - held.since, std::memory_order_relaxed);
+		return;
+	}
+}
+
+template<typename L>
+int lock_profiled(L* lock, void* caller, int (*lock_fn)(L*), int (*try_fn)(L*))
+{
+	if (!lock_profile_depth.load(std::memory_order_relaxed)) return lock_fn(lock);
+	if (try_fn(lock) == 0) {
+		lock_acquired(lock, caller, 0, false);
+		return 0;
+	}
+	uint64_t start = lock_clock();
+	int res = lock_fn(lock);
+	if (res == 0) lock_acquired(lock, caller, lock_clock() - start, true);
+	return res;
+}
+
+inline void lock_profile_begin()
+{
+	if (!lock_profile_depth.load()) {
+		for (auto& s : lock_slots) {
+			s.acquisitions.store(0, std::memory_order_relaxed);
+			s.contended.store(0, std::memory_order_relaxed);
+			s.wait.store(0, std::memory_order_relaxed);
+			s.hold.store(0, std::memory_order_relaxed);
+			s.lock.store(nullptr, std::memory_order_release);
+		}
+		lock_profile_generation++;
+		#ifdef Q_TEST__HAS_BACKTRACE
+		static bool warmed_up = [] { void* frame; return backtrace(&frame, 1) >= 0; }();
+		(void)warmed_up;
 		#endif
-		int line_length = 60;
-		static constexpr std::string_view newline = "\n";
-		static constexpr std::string_view tab = "    ";
-		static constexpr std::string_view delim_txt = "*";
-		static constexpr std::string_view succeed_txt = "succeed";
-		static constexpr std::string_view failed_txt = "failed";
-		static constexpr std::string_view skipped_txt = "skipped";
-		static constexpr std::string_view statistics_txt = "statistics";
-		static constexpr std::string_view testing_txt = "testing";
-		static constexpr std::string_view succ_sign = "[/]";
-		static constexpr std::string_view fail_sign = "[x]";
-		static constexpr std::string_view skip_sign = "[-]";
-};
+	}
+	lock_profile_depth++;
+}
 
-struct QTestScenario { QTestScenario(std::function<void()> fn) { fn(); } };
+inline void lock_profile_end()
+{
+	lock_profile_depth--;
+}
 
-inline std::string sanitize(std::string& value)
+inline std::string lock_call_site(LockSlot& s)
 {
-	std::string str;
-	for (char c : value) {
-		switch(c) {
-			case '\n':
-				str.append("\\n");
-				break;
-			case '\r':
-				str.append("\\r");
-				break;
-			case '\t':
-				str.append("\\t");
-				break;
-			case '\b':
-				str.append("\\b");
-				break;
-			case '\x1b':
-				str.append("\\x1b");
-				break;
-			default:
-				str.push_back(c);
+	std::string first;
+	for (int f=0;f<s.depth;f++) {
+		std::string name = address_symbol((char*)s.frames[f] - 1);
+		if (f == 0) first = name;
+		bool named = name != "??" && name.find("+0x") == std::string::npos;
+		if (named && name.rfind("std::", 0) != 0 && name.rfind("__gthread", 0) != 0 && name.rfind("pthread_", 0) != 0) return name;
+	}
+	return first;
+}
+
+inline LockContention read_lock_contention(const LockContention* since = nullptr)
+{
+	AllocationPause pause;
+	LockContention res;
+	#ifdef Q_TEST__HAS_LOCK_HOOKS
+	res.available = true;
+	#endif
+	std::map<void*, const LockSite*> previous;
+	if (since) {
+		for (auto& l : since->locks) {
+			previous[l.lock] = &l;
 		}
 	}
-	return str;
+	for (auto& s : lock_slots) {
+		LockSite l;
+		l.lock = s.lock.load(std::memory_order_acquire);
+		if (!l.lock) continue;
+		l.acquisitions = s.acquisitions.load(std::memory_order_relaxed);
+		l.contended = s.contended.load(std::memory_order_relaxed);
+		l.wait = s.wait.load(std::memory_order_relaxed);
+		l.hold = s.hold.load(std::memory_order_relaxed);
+		auto it = previous.find(l.lock);
+		if (it != previous.end()) {
+			l.acquisitions -= it->second->acquisitions;
+			l.contended -= it->second->contended;
+			l.wait -= it->second->wait;
+			l.hold -= it->second->hold;
+		}
+		if (!l.acquisitions && !l.hold) continue;
+		l.site = lock_call_site(s);
+		res.acquisitions += l.acquisitions;
+		res.contended += l.contended;
+		res.wait += l.wait;
+		res.hold += l.hold;
+		res.locks.push_back(std::move(l));
+	}
+	std::sort(res.locks.begin(), res.locks.end(), [](const LockSite& a, const LockSite& b) {
+		return a.wait != b.wait ? a.wait > b.wait : a.contended > b.contended;
+	});
+	return res;
+}
+
+template<typename F>
+LockContention measure_lock_contention(F&& fn)
+{
+	lock_profile_begin();
+	LockContention before = read_lock_contention();
+	fn();
+	lock_profile_end();
+	return read_lock_contention(&before);
+}
+
+inline std::vector<std::string> generate_lock_contention_lines(LockContention& contention)
+{
+	std::vector<std::string> res;
+	if (!contention.acquisitions) return res;
+	res.push_back("locks " + std::to_string(contention.locks.size()) + ", acquired " + std::to_string(contention.acquisitions)
+		+ ", contended " + std::to_string(contention.contended) + ", wait " + format_duration(contention.wait)
+		+ ", hold " + format_duration(contention.hold));
+	for (size_t i=0;i<contention.locks.size() && i<TEST_LOCK_PROFILE_TOP;i++) {
+		LockSite& l = contention.locks[i];
+		if (!l.contended) break;
+		char lock[32];
+		std::snprintf(lock, sizeof(lock), "%p", l.lock);
+		res.push_back("lock " + std::string(lock) + " at " + l.site + ": contended " + std::to_string(l.contended) + " of "
+			+ std::to_string(l.acquisitions) + ", wait " + format_duration(l.wait) + ", hold " + format_duration(l.hold));
+	}
+	return res;
+}
+
+inline void QTestLockContention::report(std::string_view func, std::string value, std::string compare)
+{
+	AllocationPause pause;
+	error->func = func;
+	error->value = contention.available ? value : "not measured";
+	error->compare = compare;
+	error->has_compare = true;
+	error->value_substituted = true;
+	error->compare_substituted = true;
+	for (auto& line : generate_lock_contention_lines(contention)) {
+		error->hint += (error->hint.empty() ? "" : "\n") + line;
+	}
+}
+
+template<typename R, typename P>
+bool QTestLockContention::waitToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	double limit = std::chrono::duration<double, std::nano>(compare).count();
+	if (!(*result &= contention.available && contention.wait < limit)) {
+		report(__func__, format_duration(contention.wait), format_duration(limit));
+	}
+	return *result;
+}
+
+template<typename R, typename P>
+bool QTestLockContention::holdToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	double limit = std::chrono::duration<double, std::nano>(compare).count();
+	if (!(*result &= contention.available && contention.hold < limit)) {
+		report(__func__, format_duration(contention.hold), format_duration(limit));
+	}
+	return *result;
+}
+
+inline bool QTestLockContention::contendedToBeLessThan(uint64_t count)
+{
+	if (!(*result &= contention.available && contention.contended < count)) {
+		report(__func__, std::to_string(contention.contended), std::to_string(count));
+	}
+	return *result;
 }
 
 class QTestBase {
 	using function_cb_t = std::function<void()>;
 	using describe_function_cb_t = std::function<void(std::function<void()>)>;
+	struct DeferredTest {
+		std::string text;
+		function_cb_t fn;
+		int param;
+		int line;
+	};
+
 	struct Describe {
 		Describe(std::string str, std::string_view file, int mode) : text(str), file(file), mode(mode) {}
 		bool is_skip() { return mode == QTEST_SKIP_PARAM_ID; }
@@ -232,16 +3429,38 @@ class QTestBase {
 		std::vector<function_cb_t> after_alls = {};
 		std::vector<function_cb_t> before_eachs = {};
 		std::vector<function_cb_t> after_eachs = {};
+		std::vector<DeferredTest> deferred = {};
+		ImpactFixture impact_fixture = {};
+		ResourceUsage resources = {};
 	};
 	struct Test {
 		Test(std::string str, int line) : text(str), line(line) {}
 		std::string text;
 		int line;
 		std::string_view expect_str = "";
-		std::vector<std::stringstream> info_prints = {};
+		std::vector<InfoStream> info_prints = {};
 		ErrorReport error = {};
+		std::shared_ptr<BenchmarkStats> benchmark = nullptr;
+		std::shared_ptr<CompareStats> comparison = nullptr;
+		std::shared_ptr<PerfCounters> perf_counters = nullptr;
+		std::shared_ptr<AllocationStats> allocations = nullptr;
+		std::shared_ptr<ResourceUsage> resources = nullptr;
+		std::shared_ptr<LockContention> locks = nullptr;
+		std::shared_ptr<StressStats> stress = nullptr;
+		size_t profile_samples = 0;
+		double duration = 0;
+		bool replayed = false;
 		bool result = true;
 	};
+	struct AllocatingTest {
+		std::string text;
+		std::shared_ptr<AllocationStats> allocations;
+	};
+	struct ExpectTarget {
+		bool* result;
+		ErrorReport* error;
+	};
+
 	struct FailedTest {
 		std::vector<std::shared_ptr<Test>> tests;
 		std::vector<std::shared_ptr<Describe>> stack;
@@ -252,49 +3471,99 @@ class QTestBase {
 		~QTestBase();
 		void script(function_cb_t fn);
 		void describe(std::string str, describe_function_cb_t fn, int param, std::string_view file);
+		template<typename... Ts, typename F> void describe_types(std::string str, TypeList<Ts...>, F fn, int param, std::string_view file);
 		void before(function_cb_t fn);
 		void before_each(function_cb_t fn);
 		void after(function_cb_t fn);
 		void after_each(function_cb_t fn);
 		void it(std::string str, function_cb_t fn, int param, int line);
+		template<typename F> void static_it(std::string str, F&& fn, int param, int line);
+		template<typename Table, typename F> void it_each(Table&& table, std::string str, F fn, int param, int line);
+		template<typename F> void benchmark(std::string str, F fn, int param, int line);
+		template<typename F, typename G> void benchmark_compare(std::string str, F baseline, G candidate, int param, int line);
+		void benchmark_bytes(uint64_t bytes);
+		void benchmark_items(uint64_t items);
 		template<typename T> std::basic_ostream<char>& info_print(T&& str);
 		std::basic_ostream<char>& info_print();
 		template<typename T> QTestExpect<T> expect(T&& a, std::string_view s);
 		template<typename T> QTestExpect<T> expect(T& a, std::string_view s);
+		template<typename F> QTestLatency expect_latency(std::string_view s, F&& fn, uint64_t iterations);
+		template<typename F> QTestScaling expect_scaling(std::string_view s, F&& fn, unsigned max_threads);
+		template<typename F> bool expect_realtime_safe(std::string_view s, F&& fn);
+		template<typename F> QTestLockContention expect_lock_contention(std::string_view s, F&& fn);
+		template<typename A, typename F> bool stress(unsigned threads, A amount, F&& fn);
+		void add_reporter(std::shared_ptr<QTestReporter> reporter);
 
 	private:
 		Describe& current_describe();
+		bool filtered_by_only(int param);
+		void show_describes();
 		void test_precalls();
 		void test_postcalls();
 		bool in_skip_describe();
 		bool in_only_describe();
 		void current_describe_ran_inc();
+		void run_deferred(Describe& d);
 		bool current_describe_ran();
 		void run_scenarios();
 		void call_before_all(Describe& d);
 		void call_after_all(Describe& d);
 		void call_before_each(Describe& d);
 		void call_after_each(Describe& d);
+		void call_hook(function_cb_t& fn, std::string_view name);
 		void show_start();
 		void show_statistics();
+		void show_top_allocations();
+		void check_allocations(AllocationStats stats);
+		void add_resource_usage(ResourceUsage usage);
+		ExpectTarget expect_target(std::string_view s, std::string_view macro = "EXPECT");
+		void merge_thread_failures();
 		void show_test_results(Test& t, bool is_skip);
+		void report_test_results(Test& t, bool is_skip);
+		bool replay_test(std::string& str);
 		void show_failed_test_results(Test& t, std::string_view file);
 		void show_test_infos(Test& t);
+		void show_test_hint(std::string& hint);
 		void show_failed_tests();
 		void show_succeed();
 		std::string generate_describes_text(std::vector<std::shared_ptr<Describe>>& descrs);
+		template<typename R> std::string generate_row_text(std::string_view str, R& row, size_t index);
 		std::string generate_test_error(std::string_view expect_str, ErrorReport& error);
+		std::string generate_benchmark_text(BenchmarkStats& stats);
+		std::string generate_comparison_text(CompareStats& stats);
+		void check_benchmark_baseline(std::string& str, BenchmarkStats& stats);
 
 		std::vector<function_cb_t> scenarios;
 		std::vector<std::shared_ptr<Describe>> describes;
 		std::vector<FailedTest> failed_tests;
+		std::vector<AllocatingTest> allocating_tests;
 		std::shared_ptr<Test> current_test;
 		std::unique_ptr<QTestPrint> P;
+		std::unique_ptr<QTestBaseline> baseline;
+		std::unique_ptr<QTestPerf> perf;
+		std::unique_ptr<QTestTrace> tracer;
+		std::unique_ptr<QTestProfiler> sampler;
+		std::vector<std::shared_ptr<QTestReporter>> reporters;
+		ThreadFailures thread_failures;
+		std::thread::id test_thread = std::this_thread::get_id();
+		std::unique_ptr<QTestJournal> results_journal;
+		std::unique_ptr<QTestRerunState> failed_state;
+		std::unique_ptr<QTestImpactMap> impact_map;
+		uint64_t bench_bytes = 0;
+		uint64_t bench_items = 0;
 		int tests_count = 0;
 		int tests_failed = 0;
 		int tests_skipped = 0;
 		bool tests_only = false;
 		bool describes_changed = false;
+		bool track_resources = false;
+		bool profile_locks = false;
+		bool failed_first = false;
+		bool failed_only = false;
+		bool replaying = false;
+		bool running = false;
+		std::chrono::steady_clock::time_point run_start;
+		double hooks_duration = 0;
 };
 
 template<typename T>
@@ -328,6 +3597,7 @@ bool QTestExpect<T>::toBeCloseTo(T compare, T precision)
 {
 	T v = val;
 	if (!(*result &= proceed_result(std::abs(v-compare) <= std::abs(precision)))) {
+		AllocationPause pause;
 		report_error_resolved(__func__, streamable_to_str(val), streamable_to_str(compare) + ", " + streamable_to_str(precision));
 	}
 	return *result;
@@ -439,6 +3709,133 @@ bool QTestExpect<T>::toReturn(V&& compare)
 	return *result;
 }
 
+template<typename T>
+template<typename C>
+bool QTestExpect<T>::toContain(C&& compare)
+{
+	if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+		std::string_view haystack = val;
+		std::string_view needle = compare;
+		size_t pos = find_substring(haystack, needle);
+		if (!(*result &= proceed_result(pos != std::string_view::npos))) {
+			AllocationPause pause;
+			std::string hint;
+			if (pos != std::string_view::npos) {
+				hint = "found at offset " + std::to_string(pos) + ": " + excerpt_region(haystack, pos, needle.size());
+			} else {
+				auto [near_pos, near_len] = find_nearest_match(haystack, needle);
+				if (near_len) {
+					hint = "nearest match (" + std::to_string(near_len) + " of " + std::to_string(needle.size()) + " chars) at offset "
+						+ std::to_string(near_pos) + ": " + excerpt_region(haystack, near_pos, near_len);
+				} else {
+					hint = "no partial match in " + std::to_string(haystack.size()) + " chars";
+				}
+			}
+			report_string_error(__func__, haystack, needle, std::move(hint));
+		}
+	} else {
+		bool found = std::find(std::begin(val), std::end(val), compare) != std::end(val);
+		if (!(*result &= proceed_result(found))) {
+			report_error(__func__, val, compare);
+		}
+	}
+	return *result;
+}
+
+template<typename T>
+bool QTestExpect<T>::toStartWith(std::string_view compare)
+{
+	std::string_view str = val;
+	if (!(*result &= proceed_result(str.substr(0, compare.size()) == compare))) {
+		AllocationPause pause;
+		auto diff = std::mismatch(compare.begin(), compare.end(), str.begin(), str.end());
+		size_t pos = diff.first - compare.begin();
+		report_string_error(__func__, str, compare, "differs at offset " + std::to_string(pos) + ": " + excerpt_region(str, pos, 1));
+	}
+	return *result;
+}
+
+template<typename T>
+bool QTestExpect<T>::toEndWith(std::string_view compare)
+{
+	std::string_view str = val;
+	bool res = str.size() >= compare.size() && str.substr(str.size() - compare.size()) == compare;
+	if (!(*result &= proceed_result(res))) {
+		AllocationPause pause;
+		auto diff = std::mismatch(compare.rbegin(), compare.rend(), str.rbegin(), str.rend());
+		size_t pos = str.size() - std::min(str.size(), (size_t)(diff.second - str.rbegin()) + 1);
+		report_string_error(__func__, str, compare, "differs at offset " + std::to_string(pos) + ": " + excerpt_region(str, pos, 1));
+	}
+	return *result;
+}
+
+template<typename T>
+bool QTestExpect<T>::toMatch(std::string_view pattern)
+{
+	std::string_view str = val;
+	std::cmatch match;
+	bool res;
+	try {
+		res = std::regex_search(str.data(), str.data() + str.size(), match, cached_regex(pattern));
+	} catch (std::regex_error& e) {
+		AllocationPause pause;
+		*result = false;
+		report_string_error(__func__, str, pattern, std::string("invalid pattern: ") + e.what());
+		return *result;
+	}
+	if (!(*result &= proceed_result(res))) {
+		AllocationPause pause;
+		std::string hint = "no match in " + std::to_string(str.size()) + " chars";
+		if (res) {
+			hint = "matched at offset " + std::to_string(match.position(0)) + ": " + excerpt_region(str, match.position(0), match.length(0));
+		}
+		report_string_error(__func__, str, pattern, std::move(hint));
+	}
+	return *result;
+}
+
+template<typename T>
+bool QTestExpect<T>::toMatchSnapshot(const std::string& path)
+{
+	AllocationPause pause;
+	std::string_view str = val;
+	SnapshotResult snapshot = compare_snapshot(str, path);
+	#ifdef TEST_SNAPSHOT_UPDATE
+	if (!snapshot.equal && !inv) {
+		snapshot.equal = write_snapshot(str, path);
+		snapshot.hint = "snapshot " + path + " can't be written";
+	}
+	#else
+	if (!snapshot.exists) {
+		snapshot.hint += ", define TEST_SNAPSHOT_UPDATE to write it";
+	}
+	#endif
+	if (!(*result &= proceed_result(snapshot.equal))) {
+		report_string_error(__func__, str, path, std::move(snapshot.hint));
+	}
+	return *result;
+}
+
+template<typename T>
+bool QTestExpect<T>::toScaleAs(Complexity complexity)
+{
+	AllocationPause pause;
+	ComplexityFit fit = measure_complexity(val);
+	if (fit.points.size() < TEST_COMPLEXITY_MIN_POINTS) {
+		*result = false;
+		report_error_resolved(__func__, "not enough points", complexity_name(complexity));
+		error->hint = "not enough points: " + std::to_string(fit.points.size()) + " sizes measured within TEST_COMPLEXITY_BUDGET_MS, "
+			+ std::to_string(TEST_COMPLEXITY_MIN_POINTS) + " needed";
+		return *result;
+	}
+	bool scales = fit.best == complexity || fit.rms[(int)complexity] <= fit.rms[(int)fit.best] + 0.05;
+	if (!(*result &= proceed_result(scales))) {
+		report_error_resolved(__func__, complexity_name(fit.best), complexity_name(complexity));
+		error->hint = generate_complexity_hint(fit, complexity);
+	}
+	return *result;
+}
+
 template<typename T>
 bool QTestExpect<T>::fail()
 {
@@ -468,6 +3865,7 @@ bool QTestExpect<T>::proceed_result(bool result)
 template<typename T>
 void QTestExpect<T>::report_error_resolved(std::string_view func, std::string_view value, std::string_view compare)
 {
+	AllocationPause pause;
 	error->func = func;
 	error->inverse = inv;
 	error->has_compare = true;
@@ -477,10 +3875,19 @@ void QTestExpect<T>::report_error_resolved(std::string_view func, std::string_vi
 	error->compare = compare;
 }
 
+template<typename T>
+void QTestExpect<T>::report_string_error(std::string_view func, std::string_view value, std::string_view compare, std::string hint)
+{
+	AllocationPause pause;
+	report_error_resolved(func, streamable_to_str(value.substr(0, 32)), streamable_to_str(compare));
+	error->hint = std::move(hint);
+}
+
 template<typename T>
 template<typename V, typename C>
 void QTestExpect<T>::report_error(std::string_view func, V&& value, C&& compare)
 {
+	AllocationPause pause;
 	error->func = func;
 	error->inverse = inv;
 	error->has_compare = true;
@@ -498,6 +3905,7 @@ template<typename T>
 template<typename V>
 void QTestExpect<T>::report_error(std::string_view func, V&& value)
 {
+	AllocationPause pause;
 	error->func = func;
 	error->inverse = inv;
 	if constexpr (is_streamable<V>::value) {
@@ -510,6 +3918,7 @@ template<typename T>
 template<typename CT>
 std::string QTestExpect<T>::iterable_to_str(CT&& value)
 {
+	AllocationPause pause;
 	std::stringstream ss;
 	std::string value_str = "{";
 	for (auto &v : value) {
@@ -528,6 +3937,7 @@ template<typename T>
 template<typename CT>
 std::string QTestExpect<T>::streamable_to_str(CT&& value)
 {
+	AllocationPause pause;
 	std::stringstream ss;
 	ss << value;
 	if constexpr (std::is_convertible_v<CT, std::string_view>) {
@@ -580,9 +3990,33 @@ inline void QTestPrint::print_test_info(std::string_view s)
 
 inline void QTestPrint::print_test_error(std::string_view s)
 {
-	print("        ");
-	print(" - ");
-	print_error(s);
+	print("        ");
+	print(" - ");
+	print_error(s);
+	print(newline);
+}
+
+inline void QTestPrint::print_benchmark(std::string_view s)
+{
+	print("        ");
+	print(" - ");
+	print_neutral(s);
+	print(newline);
+}
+
+inline void QTestPrint::print_test_stats(std::string_view s)
+{
+	print("        ");
+	print(" # ");
+	print_grey(s);
+	print(newline);
+}
+
+inline void QTestPrint::print_describe_stats(std::string_view descr, std::string_view s)
+{
+	print("    ");
+	print(" # ");
+	print_grey(std::string(descr) + "total: " + std::string(s));
 	print(newline);
 }
 
@@ -640,6 +4074,17 @@ inline void QTestPrint::print_statistics(int tests_count, int tests_failed, int
 	print(newline);
 }
 
+inline void QTestPrint::print_top_allocations(std::vector<std::string>& lines)
+{
+	print_title(toupper(allocations_txt));
+	print(newline);
+	for (auto& line : lines) {
+		print(" ");
+		print_grey(line);
+		print(newline);
+	}
+	print(newline);
+}
 inline void QTestPrint::print_start()
 {
 	print_delimeter("_");
@@ -823,6 +4268,72 @@ inline QTestBase::QTestBase()
 	#ifdef TEST_ONLY_RULE
 	tests_only = true;
 	#endif
+	#ifdef TEST_BENCHMARK_BASELINE
+	baseline = std::make_unique<QTestBaseline>(TEST_BENCHMARK_BASELINE);
+	#endif
+	#ifdef TEST_TRACK_ALLOCATIONS
+	allocation_tracker.install();
+	#endif
+	#ifdef TEST_FAIL_ON_LEAKS
+	fail_on_leaks = true;
+	#endif
+	#ifdef TEST_RESOURCE_USAGE
+	track_resources = true;
+	#endif
+	#ifdef TEST_TRACE_OUTPUT
+	tracer = std::make_unique<QTestTrace>(TEST_TRACE_OUTPUT);
+	trace = tracer.get();
+	#endif
+	#ifdef TEST_PROFILE_OUTPUT
+	sampler = std::make_unique<QTestProfiler>(TEST_PROFILE_OUTPUT);
+	if (!sampler->is_available()) sampler = nullptr;
+	profiler = sampler.get();
+	#endif
+	#if defined(TEST_LOCK_PROFILE) && defined(Q_TEST__HAS_LOCK_HOOKS)
+	profile_locks = true;
+	#endif
+	#ifdef TEST_REPORT_JUNIT
+	add_reporter(std::make_shared<QTestJUnitReporter>(TEST_REPORT_JUNIT));
+	#endif
+	#ifdef TEST_REPORT_JSONL
+	add_reporter(std::make_shared<QTestJsonReporter>(TEST_REPORT_JSONL));
+	#endif
+	#ifdef TEST_REPORT_TAP
+	add_reporter(std::make_shared<QTestTapReporter>(TEST_REPORT_TAP));
+	#endif
+	#ifdef TEST_JOURNAL
+	bool resume = false;
+	#ifdef TEST_JOURNAL_RESUME
+	resume = true;
+	#endif
+	results_journal = std::make_unique<QTestJournal>(TEST_JOURNAL, resume);
+	journal = results_journal.get();
+	#endif
+	#ifdef TEST_FAILED_STATE
+	failed_state = std::make_unique<QTestRerunState>(TEST_FAILED_STATE);
+	rerun = failed_state.get();
+	#endif
+	#ifdef TEST_IMPACT_MAP
+	impact_map = std::make_unique<QTestImpactMap>(TEST_IMPACT_MAP);
+	impact = impact_map.get();
+	#ifdef TEST_IMPACT_CHANGED
+	impact->select(TEST_IMPACT_CHANGED);
+	#endif
+	#endif
+	#ifdef TEST_FAILED_FIRST
+	failed_first = true;
+	#endif
+	#ifdef TEST_FAILED_ONLY
+	failed_first = true;
+	failed_only = true;
+	#endif
+	#ifdef TEST_METRICS_OUTPUT
+	add_reporter(std::make_shared<QTestMetricsReporter>(TEST_METRICS_OUTPUT));
+	#endif
+	#ifdef TEST_PERF_COUNTERS
+	perf = std::make_unique<QTestPerf>();
+	if (!perf->is_available()) perf = nullptr;
+	#endif
 	P = std::make_unique<QTestPrint>();
 	show_start();
 }
@@ -830,6 +4341,26 @@ inline QTestBase::QTestBase()
 inline QTestBase::~QTestBase()
 {
 	run_scenarios();
+	trace = nullptr;
+	tracer = nullptr;
+	profiler = nullptr;
+	sampler = nullptr;
+	journal = nullptr;
+	results_journal = nullptr;
+	if (baseline) {
+		baseline->save();
+	}
+	if (rerun) {
+		rerun->save();
+	}
+	if (impact) {
+		impact->save();
+	}
+	RunStatistics stats = {tests_count, tests_failed, tests_skipped, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - run_start).count(), hooks_duration};
+	for (auto& r : reporters) {
+		r->statistics(stats);
+	}
+	reporters.clear();
 	show_statistics();
 	if(tests_failed) exit(1);
 }
@@ -841,27 +4372,86 @@ inline void QTestBase::script(std::function<void()> fn)
 
 inline void QTestBase::describe(std::string str, describe_function_cb_t fn, int param, std::string_view file)
 {
+	TraceSpan span(str, "describe");
 	describes.push_back(std::make_shared<Describe>(str, file, param));
 	describes_changed = true;
-	fn([this]{ if (current_describe_ran()) call_after_all(current_describe()); });
+	for (auto& r : reporters) {
+		r->describe_enter(str);
+	}
+	fn([this]{
+		run_deferred(current_describe());
+		if (current_describe_ran()) call_after_all(current_describe());
+	});
+	if (current_describe().resources.available) {
+		P->print_describe_stats(generate_describes_text(describes), generate_resource_usage_text(current_describe().resources));
+	}
+	for (auto& r : reporters) {
+		r->describe_leave(str);
+	}
 	describes.pop_back();
 	describes_changed = true;
 }
 
+template<typename... Ts, typename F>
+inline void QTestBase::describe_types(std::string str, TypeList<Ts...>, F fn, int param, std::string_view file)
+{
+	(describe(str + " <" + type_name<Ts>() + ">", [&fn](std::function<void()> callback){ fn(TypeTag<Ts>{}, callback); }, param, file), ...);
+}
+
 inline void QTestBase::it(std::string str, function_cb_t fn, int param, int line)
 {
-	if (tests_only && param != QTEST_ONLY_PARAM_ID && !in_only_describe()) return;
-	if (describes_changed) {
-		std::string descr = generate_describes_text(describes);
-		P->print_description(descr);
+	std::string test_id = (rerun || impact) ? rerun_test_id(generate_describes_text(describes), str, line) : "";
+	bool rerun_filtered = rerun && rerun->filtered(test_id);
+	if (filtered_by_only(param) || rerun_filtered) return;
+	if (impact && impact->filtered(test_id)) return;
+	if (rerun && !replaying && !describes.empty() && rerun->deferred(test_id)) {
+		current_describe().deferred.push_back({str, fn, param, line});
+		return;
 	}
+	show_describes();
 	tests_count++;
 	current_test = std::make_shared<Test>(str, line);
 	bool is_skip = (param == QTEST_SKIP_PARAM_ID || in_skip_describe());
-	if (!is_skip) {
+	bool is_replay = !is_skip && journal && replay_test(str);
+	if (!is_skip && !is_replay) {
+		TraceSpan span(str, "it");
+		auto start = std::chrono::steady_clock::now();
+		ResourceUsage resources_start;
+		if (track_resources) resources_start = read_resource_usage();
+		bool track_allocations = allocation_tracker.is_installed();
+		if (track_allocations) allocation_tracker.begin();
+		if (impact) impact->begin();
 		test_precalls();
+		if (sampler) sampler->start();
+		if (perf) perf->start();
+		if (profile_locks) lock_profile_begin();
 		fn();
+		if (profile_locks) lock_profile_end();
+		if (perf) {
+			AllocationPause pause;
+			current_test->perf_counters = std::make_shared<PerfCounters>(perf->stop());
+		}
+		if (profile_locks) {
+			AllocationPause pause;
+			current_test->locks = std::make_shared<LockContention>(read_lock_contention());
+		}
+		if (sampler) {
+			sampler->stop();
+			AllocationPause pause;
+			current_test->profile_samples = sampler->write(generate_describes_text(describes) + str);
+		}
 		test_postcalls();
+		merge_thread_failures();
+		if (impact) {
+			for (auto& d : describes) {
+				impact->add(d->impact_fixture);
+			}
+			impact->end(test_id);
+		}
+		if (track_allocations) check_allocations(allocation_tracker.end());
+		if (track_resources) add_resource_usage(read_resource_usage() - resources_start);
+		current_test->duration = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		if (journal) journal->record(generate_describes_text(describes) + str, current_test->result, current_test->duration);
 		current_describe_ran_inc();
 	}
 	if (is_skip) {
@@ -875,10 +4465,179 @@ inline void QTestBase::it(std::string str, function_cb_t fn, int param, int line
 			failed_tests.back().tests.push_back(current_test);
 		}
 	}
+	if (rerun && !is_skip) {
+		rerun->record(test_id, current_test->result);
+	}
+	report_test_results(*current_test, is_skip);
 	show_test_results(*current_test, is_skip);
 	describes_changed = false;
 }
 
+template<typename F>
+inline void QTestBase::static_it(std::string str, F&&, int param, int line)
+{
+	std::string test_id = (rerun || impact) ? rerun_test_id(generate_describes_text(describes), str, line) : "";
+	bool rerun_filtered = rerun && rerun->filtered(test_id);
+	if (filtered_by_only(param) || rerun_filtered) return;
+	if (impact && impact->filtered(test_id)) return;
+	show_describes();
+	tests_count++;
+	current_test = std::make_shared<Test>(str, line);
+	bool is_skip = (param == QTEST_SKIP_PARAM_ID || in_skip_describe());
+	if (is_skip) {
+		++tests_skipped;
+	}
+	report_test_results(*current_test, is_skip);
+	show_test_results(*current_test, is_skip);
+	describes_changed = false;
+}
+
+template<typename Table, typename F>
+inline void QTestBase::it_each(Table&& table, std::string str, F fn, int param, int line)
+{
+	size_t index = 0;
+	if constexpr (std::is_invocable_v<Table&>) {
+		while (auto row = table()) {
+			it(generate_row_text(str, *row, index++), [fn, row]() mutable { fn(*row); }, param, line);
+		}
+	} else {
+		for (auto&& row : table) {
+			it(generate_row_text(str, row, index++), [fn, row]() mutable { fn(row); }, param, line);
+		}
+	}
+}
+
+template<typename F>
+inline void QTestBase::benchmark(std::string str, F fn, int param, int line)
+{
+	it(str, [this, str, fn]() mutable {
+		AllocationPause pause;
+		bench_bytes = 0;
+		bench_items = 0;
+		QTestBenchmark bench([this]{ return !current_test->result; });
+		BenchmarkStats stats = bench.run(fn);
+		stats.bytes = bench_bytes;
+		stats.items = bench_items;
+		if (baseline && current_test->result) {
+			check_benchmark_baseline(str, stats);
+		}
+		current_test->benchmark = std::make_shared<BenchmarkStats>(std::move(stats));
+	}, param, line);
+}
+template<typename F, typename G>
+inline void QTestBase::benchmark_compare(std::string str, F baseline, G candidate, int param, int line)
+{
+	it(str, [this, baseline, candidate]() mutable {
+		AllocationPause pause;
+		QTestBenchmark bench([this]{ return !current_test->result; });
+		CompareStats stats = bench.compare(baseline, candidate);
+		if (!current_test->result) return;
+		if (stats.speedup < 1 && stats.p_value < TEST_BENCHMARK_ALPHA) {
+			char speedup[32];
+			std::snprintf(speedup, sizeof(speedup), "%.2fx", stats.speedup);
+			current_test->result = false;
+			current_test->expect_str = "candidate speedup";
+			current_test->error = {};
+			current_test->error.func = "toBeSignificantlySlower";
+			current_test->error.inverse = true;
+			current_test->error.value_substituted = true;
+			current_test->error.value = speedup;
+			current_test->error.hint = generate_comparison_text(stats);
+		}
+		current_test->comparison = std::make_shared<CompareStats>(std::move(stats));
+	}, param, line);
+}
+
+inline void QTestBase::check_benchmark_baseline(std::string& str, BenchmarkStats& stats)
+{
+	std::string key = generate_describes_text(describes) + str;
+	BaselineEntry* entry = baseline->find(key);
+	#ifdef TEST_BENCHMARK_BASELINE_UPDATE
+	entry = nullptr;
+	#endif
+	if (!entry) {
+		baseline->record(key, stats);
+		return;
+	}
+	stats.baseline = entry->median;
+	if (baseline->is_regression(*entry, stats)) {
+		current_test->result = false;
+		current_test->expect_str = "benchmark median";
+		current_test->error = {};
+		current_test->error.func = "toBeWithinBaseline";
+		current_test->error.has_compare = true;
+		current_test->error.value_substituted = true;
+		current_test->error.value = format_duration(stats.median);
+		current_test->error.compare_substituted = true;
+		current_test->error.compare = format_duration(entry->median) + ", " + format_percent(TEST_BENCHMARK_TOLERANCE);
+		current_test->error.hint = generate_benchmark_text(stats);
+	}
+}
+
+inline void QTestBase::check_allocations(AllocationStats stats)
+{
+	current_test->allocations = std::make_shared<AllocationStats>(stats);
+	allocating_tests.push_back({generate_describes_text(describes) + current_test->text, current_test->allocations});
+	if (fail_on_leaks && stats.live_count && current_test->result) {
+		current_test->result = false;
+		current_test->expect_str = "not released allocations";
+		current_test->error = {};
+		current_test->error.func = "toBe";
+		current_test->error.has_compare = true;
+		current_test->error.value_substituted = true;
+		current_test->error.value = std::to_string(stats.live_count);
+		current_test->error.compare_substituted = true;
+		current_test->error.compare = "0";
+		current_test->error.hint = format_bytes(stats.live_bytes) + " allocated by the test are not released";
+	}
+}
+
+inline void QTestBase::add_resource_usage(ResourceUsage usage)
+{
+	current_test->resources = std::make_shared<ResourceUsage>(usage);
+	for (auto& d : describes) {
+		d->resources += usage;
+	}
+}
+
+inline bool QTestBase::replay_test(std::string& str)
+{
+	JournalEntry entry;
+	if (!journal->replay(generate_describes_text(describes) + str, entry)) return false;
+	current_test->replayed = true;
+	current_test->duration = entry.duration;
+	if (!entry.passed) {
+		current_test->result = false;
+		current_test->expect_str = "journaled result";
+		current_test->error = {};
+		current_test->error.func = "toBePassed";
+		current_test->error.value_substituted = true;
+		current_test->error.value = "failed";
+		current_test->error.hint = "the test failed before the run was resumed";
+	}
+	return true;
+}
+
+inline void QTestBase::add_reporter(std::shared_ptr<QTestReporter> reporter)
+{
+	reporters.push_back(reporter);
+	if (!running) return;
+	reporter->run_start();
+	for (auto& d : describes) {
+		reporter->describe_enter(d->text);
+	}
+}
+
+inline void QTestBase::benchmark_bytes(uint64_t bytes)
+{
+	bench_bytes = bytes;
+}
+
+inline void QTestBase::benchmark_items(uint64_t items)
+{
+	bench_items = items;
+}
+
 inline void QTestBase::before(function_cb_t fn)
 {
 	current_describe().before_alls.push_back(fn);
@@ -902,30 +4661,174 @@ inline void QTestBase::after_each(function_cb_t fn)
 template<typename T>
 inline std::basic_ostream<char>& QTestBase::info_print(T&& str)
 {
-	current_test->info_prints.push_back(std::stringstream{});
+	AllocationPause pause;
+	current_test->info_prints.emplace_back();
 	return current_test->info_prints.back() << str;
 }
 
 inline std::basic_ostream<char>& QTestBase::info_print()
 {
-	current_test->info_prints.push_back(std::stringstream{});
+	AllocationPause pause;
+	current_test->info_prints.emplace_back();
 	return current_test->info_prints.back();
 }
 
 template<typename T>
 QTestExpect<T> QTestBase::expect(T&& a, std::string_view s)
 {
-	current_test->expect_str = s;
-	current_test->error = {};
-	return QTestExpect<T>(std::move(a), &(current_test->result), &current_test->error);
+	ExpectTarget target = expect_target(s);
+	return QTestExpect<T>(std::move(a), target.result, target.error);
 }
 
 template<typename T>
 QTestExpect<T> QTestBase::expect(T& a, std::string_view s)
 {
-	current_test->expect_str = s;
-	current_test->error = {};
-	return QTestExpect<T>(a, &(current_test->result), &current_test->error);
+	ExpectTarget target = expect_target(s);
+	return QTestExpect<T>(a, target.result, target.error);
+}
+
+template<typename F>
+QTestLatency QTestBase::expect_latency(std::string_view s, F&& fn, uint64_t iterations)
+{
+	ExpectTarget target = expect_target(s, "EXPECT_LATENCY");
+	LatencyHistogram histogram;
+	for (uint64_t i=0;i<iterations;i++) {
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		auto end = std::chrono::steady_clock::now();
+		histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	}
+	return QTestLatency(std::move(histogram), target.result, target.error);
+}
+
+template<typename F>
+bool QTestBase::expect_realtime_safe(std::string_view s, F&& fn)
+{
+	ExpectTarget target = expect_target(s, "EXPECT_REALTIME_SAFE");
+	RealtimeScope scope;
+	scope.run(fn);
+	if (!(*target.result &= scope.is_safe())) {
+		AllocationPause pause;
+		target.error->func = "toBeRealtimeSafe";
+		target.error->value_substituted = true;
+		target.error->value = scope.count() ? scope.violation(0).call : "blocked";
+		target.error->hint = generate_realtime_hint(scope);
+	}
+	return *target.result;
+}
+
+template<typename F>
+QTestLockContention QTestBase::expect_lock_contention(std::string_view s, F&& fn)
+{
+	ExpectTarget target = expect_target(s, "EXPECT_LOCK_CONTENTION");
+	return QTestLockContention(measure_lock_contention(fn), target.result, target.error);
+}
+template<typename F>
+QTestScaling QTestBase::expect_scaling(std::string_view s, F&& fn, unsigned max_threads)
+{
+	ExpectTarget target = expect_target(s, "EXPECT_SCALING");
+	std::vector<ScalingPoint> points = measure_scaling(fn, max_threads);
+	std::stringstream table(generate_scaling_table(points));
+	std::string line;
+	while (std::getline(table, line)) {
+		info_print(line);
+	}
+	return QTestScaling(std::move(points), target.result, target.error);
+}
+
+template<typename A, typename F>
+bool QTestBase::stress(unsigned threads, A amount, F&& fn)
+{
+	using clock = std::chrono::steady_clock;
+	AllocationPause pause;
+	threads = std::max(1u, threads);
+	uint64_t iterations = UINT64_MAX;
+	if constexpr (std::is_integral_v<A>) iterations = amount;
+	SpinBarrier barrier;
+	std::atomic<bool> stop{false};
+	std::atomic<unsigned> failed{0};
+	std::vector<uint64_t> ops(threads, 0);
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+	for (unsigned t=0;t<threads;t++) {
+		workers.emplace_back([&, t]{
+			stress_thread = t;
+			pin_stress_thread(t);
+			ThreadFailure& node = thread_failures.node();
+			barrier.arrive();
+			barrier.wait_start();
+			uint64_t count = 0;
+			while (count < iterations && !stop.load(std::memory_order_relaxed)) {
+				fn();
+				count++;
+				if (!node.result) {
+					failed.fetch_add(1, std::memory_order_relaxed);
+					stop.store(true, std::memory_order_relaxed);
+				}
+			}
+			ops[t] = count;
+		});
+	}
+	barrier.start(threads);
+	auto start = clock::now();
+	if constexpr (!std::is_integral_v<A>) {
+		while (clock::now() - start < amount && !stop.load(std::memory_order_relaxed)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		stop.store(true, std::memory_order_relaxed);
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+	StressStats stats;
+	stats.threads = threads;
+	stats.duration = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+	for (uint64_t n : ops) {
+		stats.iterations += n;
+	}
+	stats.throughput = stats.duration > 0 ? stats.iterations / (stats.duration / 1e9) : 0;
+	stats.failed_threads = failed.load();
+	current_test->stress = std::make_shared<StressStats>(stats);
+	merge_thread_failures();
+	return current_test->result;
+}
+
+inline QTestBase::ExpectTarget QTestBase::expect_target(std::string_view s, std::string_view macro)
+{
+	AllocationPause pause;
+	if (std::this_thread::get_id() == test_thread) {
+		current_test->expect_str = s;
+		current_test->error = {};
+		current_test->error.macro = macro;
+		return {&(current_test->result), &current_test->error};
+	}
+	static thread_local ErrorReport discarded;
+	ThreadFailure& node = thread_failures.node();
+	if (!node.result) return {&node.result, &discarded};
+	node.expect_str = s;
+	node.error = {};
+	node.error.macro = macro;
+	return {&node.result, &node.error};
+}
+
+inline void QTestBase::merge_thread_failures()
+{
+	std::vector<ThreadFailure*> failures = thread_failures.take();
+	AllocationPause pause;
+	for (auto& f : failures) {
+		if (f->result) continue;
+		std::stringstream thread;
+		thread << f->thread;
+		if (current_test->result) {
+			current_test->result = false;
+			current_test->expect_str = f->expect_str;
+			current_test->error = f->error;
+			current_test->error.hint = "failed in the thread " + thread.str() + (f->error.hint.empty() ? "" : "\n" + f->error.hint);
+		} else {
+			std::string& hint = current_test->error.hint;
+			hint += (hint.empty() ? "" : "\n") + std::string("the thread ") + thread.str() + " failed as well: " + generate_test_error(f->expect_str, f->error);
+		}
+	}
 }
 
 inline std::string QTestBase::generate_describes_text(std::vector<std::shared_ptr<Describe>>& descrs)
@@ -938,6 +4841,24 @@ inline std::string QTestBase::generate_describes_text(std::vector<std::shared_pt
 	return res;
 }
 
+template<typename R>
+std::string QTestBase::generate_row_text(std::string_view str, R& row, size_t index)
+{
+	std::string row_str;
+	if constexpr (is_streamable<R>::value) {
+		std::stringstream ss;
+		ss << row;
+		row_str = ss.str();
+	} else {
+		row_str = "#" + std::to_string(index);
+	}
+	size_t pos = str.find("{}");
+	if (pos == std::string_view::npos) {
+		return std::string(str) + " [" + row_str + "]";
+	}
+	return std::string(str.substr(0, pos)) + row_str + std::string(str.substr(pos + 2));
+}
+
 inline bool QTestBase::current_describe_ran()
 {
 	return current_describe().tests_ran > 0;
@@ -963,6 +4884,19 @@ inline void QTestBase::test_postcalls()
 	}
 }
 
+inline bool QTestBase::filtered_by_only(int param)
+{
+	return tests_only && param != QTEST_ONLY_PARAM_ID && !in_only_describe();
+}
+
+inline void QTestBase::show_describes()
+{
+	if (describes_changed) {
+		std::string descr = generate_describes_text(describes);
+		P->print_description(descr);
+	}
+}
+
 inline bool QTestBase::in_skip_describe()
 {
 	for (auto &d : describes) if (d->is_skip()) return true;
@@ -975,6 +4909,17 @@ inline bool QTestBase::in_only_describe()
 	return false;
 }
 
+inline void QTestBase::run_deferred(Describe& d)
+{
+	std::vector<DeferredTest> tests = std::move(d.deferred);
+	d.deferred.clear();
+	replaying = true;
+	for (auto& t : tests) {
+		it(t.text, t.fn, t.param, t.line);
+	}
+	replaying = false;
+}
+
 inline QTestBase::Describe& QTestBase::current_describe()
 {
 	return *describes.back();
@@ -982,31 +4927,69 @@ inline QTestBase::Describe& QTestBase::current_describe()
 
 inline void QTestBase::run_scenarios()
 {
-	for (auto& fn : scenarios) {
-		fn();
+	run_start = std::chrono::steady_clock::now();
+	for (auto& r : reporters) {
+		r->run_start();
+	}
+	running = true;
+	auto run = [this]{
+		for (auto& fn : scenarios) {
+			TraceSpan span("SCENARIO", "scenario");
+			fn();
+		}
+	};
+	bool rerun_failed = failed_first && rerun && rerun->has_failed();
+	if (rerun_failed) {
+		rerun->set_pass(failed_only ? QTestRerunState::Pass::Failed : QTestRerunState::Pass::First);
+	}
+	run();
+	if (rerun_failed && failed_only && !rerun->has_matched()) {
+		rerun->set_pass(QTestRerunState::Pass::All);
+		run();
 	}
 }
 
 inline void QTestBase::call_before_all(Describe& d)
 {
-	for (auto fn : d.before_alls) fn();
+	AllocationPause pause;
+	bool record_fixture = impact && !d.before_alls.empty();
+	if (record_fixture) impact->fixture_begin();
+	for (auto& fn : d.before_alls) {
+		call_hook(fn, "BEFORE_ALL");
+	}
+	if (record_fixture) d.impact_fixture = impact->fixture_end();
 	d.before_alls.clear();
 }
 
 inline void QTestBase::call_after_all(Describe& d)
 {
-	for (auto fn : d.after_alls) fn();
+	AllocationPause pause;
+	for (auto& fn : d.after_alls) {
+		call_hook(fn, "AFTER_ALL");
+	}
 	d.after_alls.clear();
 }
 
 inline void QTestBase::call_before_each(Describe& d)
 {
-	for (auto fn : d.before_eachs) fn();
+	for (auto& fn : d.before_eachs) {
+		call_hook(fn, "BEFORE_EACH");
+	}
 }
 
 inline void QTestBase::call_after_each(Describe& d)
 {
-	for (auto fn : d.after_eachs) fn();
+	for (auto& fn : d.after_eachs) {
+		call_hook(fn, "AFTER_EACH");
+	}
+}
+
+inline void QTestBase::call_hook(function_cb_t& fn, std::string_view name)
+{
+	TraceSpan span(name, "hook");
+	auto start = std::chrono::steady_clock::now();
+	fn();
+	hooks_duration += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
 }
 
 inline std::string QTestBase::generate_test_error(std::string_view expect_str, ErrorReport& error)
@@ -1032,9 +5015,37 @@ inline std::string QTestBase::generate_test_error(std::string_view expect_str, E
 		compare_str = (error.compare_substituted ? error.compare : "...");
 	}
 	std::string not_str = error.inverse ? ".NOT()" : "";
-	res += "EXPECT(" + std::string(expect_str) + value_str + ")" + not_str + "." + std::string(error.func) + "(" + compare_str + ") FAILED!";
+	std::string macro = error.macro.empty() ? "EXPECT" : std::string(error.macro);
+	res += macro + "(" + std::string(expect_str) + value_str + ")" + not_str + "." + std::string(error.func) + "(" + compare_str + ") FAILED!";
+	return res;
+}
+
+inline std::string QTestBase::generate_benchmark_text(BenchmarkStats& stats)
+{
+	std::string res = "mean " + format_duration(stats.mean) + ", median " + format_duration(stats.median)
+		+ ", stddev " + format_duration(stats.stddev) + ", min " + format_duration(stats.min)
+		+ " (" + std::to_string(stats.samples.size()) + " x " + std::to_string(stats.iterations) + " iterations)";
+	double seconds = stats.median / 1e9;
+	if (stats.bytes && seconds > 0) {
+		res += ", " + format_rate(stats.bytes / seconds, "B/s");
+	}
+	if (stats.items && seconds > 0) {
+		res += ", " + format_rate(stats.items / seconds, " items/s");
+	}
+	if (stats.baseline > 0) {
+		char diff[32];
+		std::snprintf(diff, sizeof(diff), "%+.1f%%", (stats.median / stats.baseline - 1) * 100);
+		res += ", baseline " + format_duration(stats.baseline) + " (" + diff + ")";
+	}
 	return res;
 }
+inline std::string QTestBase::generate_comparison_text(CompareStats& stats)
+{
+	char buf[128];
+	std::snprintf(buf, sizeof(buf), "speedup %.2fx [%.2fx, %.2fx], p=%.4f", stats.speedup, stats.speedup_low, stats.speedup_high, stats.p_value);
+	return std::string(buf) + ", baseline median " + format_duration(stats.baseline.median)
+		+ ", candidate median " + format_duration(stats.candidate.median);
+}
 
 inline void QTestBase::show_failed_tests()
 {
@@ -1057,6 +5068,9 @@ inline void QTestBase::show_start()
 inline void QTestBase::show_statistics()
 {
 	P->print_statistics(tests_count, tests_failed, tests_skipped);
+	if (allocating_tests.size()) {
+		show_top_allocations();
+	}
 	if(tests_failed){
 		show_failed_tests();
 	} else {
@@ -1065,6 +5079,18 @@ inline void QTestBase::show_statistics()
 	P->print_delimeter("_");
 }
 
+inline void QTestBase::show_top_allocations()
+{
+	constexpr size_t top = 5;
+	std::vector<AllocatingTest> tests = allocating_tests;
+	std::sort(tests.begin(), tests.end(), [](auto& a, auto& b){ return a.allocations->bytes > b.allocations->bytes; });
+	std::vector<std::string> lines;
+	for (size_t i=0;i<tests.size() && i<top;i++) {
+		lines.push_back(tests[i].text + ": " + generate_allocations_text(*tests[i].allocations));
+	}
+	P->print_top_allocations(lines);
+}
+
 inline void QTestBase::show_test_infos(Test& t)
 {
 	for (auto &s : t.info_prints) {
@@ -1073,15 +5099,83 @@ inline void QTestBase::show_test_infos(Test& t)
 	if (!t.result) {
 		std::string error_text = generate_test_error(t.expect_str, t.error);
 		P->print_test_error(error_text);
+		show_test_hint(t.error.hint);
+	}
+}
+
+inline void QTestBase::show_test_hint(std::string& hint)
+{
+	std::stringstream ss(hint);
+	std::string line;
+	while (std::getline(ss, line)) {
+		P->print_test_info(sanitize(line));
 	}
 }
 
 inline void QTestBase::show_test_results(Test& t, bool is_skip)
 {
 	P->print_test(t.text, t.result, is_skip);
+	if (t.benchmark && t.result) {
+		P->print_benchmark(generate_benchmark_text(*t.benchmark));
+	}
+	if (t.comparison && t.result) {
+		P->print_benchmark(generate_comparison_text(*t.comparison));
+	}
+	if (t.perf_counters) {
+		P->print_test_stats(generate_perf_counters_text(*t.perf_counters));
+	}
+	if (t.allocations && t.allocations->count) {
+		P->print_test_stats(generate_allocations_text(*t.allocations));
+	}
+	if (t.resources && t.resources->available) {
+		P->print_test_stats(generate_resource_usage_text(*t.resources));
+	}
+	if (t.locks) {
+		for (auto& line : generate_lock_contention_lines(*t.locks)) {
+			P->print_test_stats(line);
+		}
+	}
+	if (t.stress) {
+		P->print_test_stats(generate_stress_text(*t.stress));
+	}
+	if (t.profile_samples) {
+		P->print_test_stats("profile samples " + std::to_string(t.profile_samples));
+	}
+	if (t.replayed) {
+		P->print_test_stats("result from the journal");
+	}
 	show_test_infos(t);
 }
 
+inline void QTestBase::report_test_results(Test& t, bool is_skip)
+{
+	if (reporters.empty()) return;
+	std::string suite = generate_describes_text(describes);
+	if (!suite.empty()) suite.pop_back();
+	TestResult result;
+	result.suite = suite;
+	result.name = t.text;
+	result.file = describes.empty() ? "" : describes[0]->file;
+	result.line = t.line;
+	result.passed = t.result;
+	result.skipped = is_skip;
+	result.duration = t.duration;
+	result.benchmark = t.benchmark.get();
+	result.resources = t.resources.get();
+	result.allocations = t.allocations.get();
+	std::string message;
+	if (!t.result) {
+		ErrorReport error = t.error;
+		message = generate_test_error(t.expect_str, error);
+		result.expect = t.expect_str;
+		result.error = &t.error;
+		result.message = message;
+	}
+	for (auto& r : reporters) {
+		r->test_result(result);
+	}
+}
+
 inline void QTestBase::show_failed_test_results(Test& t, std::string_view file)
 {
 	P->print_failed_test(t.text, file, t.line);
@@ -1097,4 +5191,152 @@ inline QTestBase BASE;
 
 } // Q_TEST_NS_DETAIL
 
+#if defined(TEST_TRACK_ALLOCATIONS) || defined(TEST_REALTIME_SAFETY)
+void* operator new(std::size_t size)
+{
+	Q_TEST_NS_DETAIL::realtime_violation("operator new");
+	void* ptr = Q_TEST_NS_DETAIL::allocation_tracker.allocate(size);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+	Q_TEST_NS_DETAIL::realtime_violation("operator new[]");
+	void* ptr = Q_TEST_NS_DETAIL::allocation_tracker.allocate(size);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	Q_TEST_NS_DETAIL::realtime_violation("operator new");
+	return Q_TEST_NS_DETAIL::allocation_tracker.allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	Q_TEST_NS_DETAIL::realtime_violation("operator new[]");
+	return Q_TEST_NS_DETAIL::allocation_tracker.allocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete[]");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete[]");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete[]");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+#endif
+
+
+#if defined(TEST_REALTIME_SAFETY) && defined(Q_TEST__HAS_REALTIME_HOOKS)
+#define Q_TEST__REALTIME_HOOK(ret, name, params, args, spec) \
+	extern "C" ret name params spec \
+	{ \
+		static ret (*next) params = nullptr; \
+		Q_TEST_NS_DETAIL::realtime_violation(#name); \
+		return Q_TEST_NS_DETAIL::realtime_next(#name, next) args; \
+	}
+
+Q_TEST__REALTIME_HOOK(int, pthread_join, (pthread_t t, void** r), (t, r), noexcept(false))
+Q_TEST__REALTIME_HOOK(int, sem_wait, (sem_t* s), (s), noexcept(false))
+Q_TEST__REALTIME_HOOK(int, sched_yield, (), (), noexcept(true))
+Q_TEST__REALTIME_HOOK(int, nanosleep, (const timespec* t, timespec* r), (t, r), noexcept(false))
+Q_TEST__REALTIME_HOOK(int, usleep, (useconds_t t), (t), noexcept(false))
+Q_TEST__REALTIME_HOOK(ssize_t, read, (int fd, void* buf, size_t n), (fd, buf, n), noexcept(false))
+Q_TEST__REALTIME_HOOK(ssize_t, write, (int fd, const void* buf, size_t n), (fd, buf, n), noexcept(false))
+#endif
+
+#ifdef Q_TEST__HAS_LOCK_HOOKS
+#define Q_TEST__LOCK_HOOK(name, try_name, type) \
+	extern "C" int name(type* l) noexcept(true) \
+	{ \
+		static int (*next)(type*) = nullptr; \
+		static int (*next_try)(type*) = nullptr; \
+		Q_TEST_NS_DETAIL::realtime_violation(#name); \
+		return Q_TEST_NS_DETAIL::lock_profiled(l, __builtin_return_address(0), Q_TEST_NS_DETAIL::realtime_next(#name, next), Q_TEST_NS_DETAIL::realtime_next(#try_name, next_try)); \
+	}
+
+#define Q_TEST__UNLOCK_HOOK(name, type) \
+	extern "C" int name(type* l) noexcept(true) \
+	{ \
+		static int (*next)(type*) = nullptr; \
+		Q_TEST_NS_DETAIL::lock_released(l); \
+		return Q_TEST_NS_DETAIL::realtime_next(#name, next)(l); \
+	}
+
+#define Q_TEST__COND_HOOK(name, params, args) \
+	extern "C" int name params noexcept(false) \
+	{ \
+		static int (*next) params = nullptr; \
+		Q_TEST_NS_DETAIL::realtime_violation(#name); \
+		Q_TEST_NS_DETAIL::lock_released(m); \
+		int res = Q_TEST_NS_DETAIL::realtime_next(#name, next) args; \
+		if (Q_TEST_NS_DETAIL::lock_profile_depth.load(std::memory_order_relaxed)) Q_TEST_NS_DETAIL::lock_acquired(m, __builtin_return_address(0), 0, false); \
+		return res; \
+	}
+
+Q_TEST__LOCK_HOOK(pthread_mutex_lock, pthread_mutex_trylock, pthread_mutex_t)
+Q_TEST__LOCK_HOOK(pthread_rwlock_rdlock, pthread_rwlock_tryrdlock, pthread_rwlock_t)
+Q_TEST__LOCK_HOOK(pthread_rwlock_wrlock, pthread_rwlock_trywrlock, pthread_rwlock_t)
+Q_TEST__UNLOCK_HOOK(pthread_mutex_unlock, pthread_mutex_t)
+Q_TEST__UNLOCK_HOOK(pthread_rwlock_unlock, pthread_rwlock_t)
+Q_TEST__COND_HOOK(pthread_cond_wait, (pthread_cond_t* c, pthread_mutex_t* m), (c, m))
+Q_TEST__COND_HOOK(pthread_cond_timedwait, (pthread_cond_t* c, pthread_mutex_t* m, const timespec* t), (c, m, t))
+#endif
+
+
+#if defined(TEST_IMPACT_MAP) && defined(Q_TEST__HAS_IMPACT)
+extern "C" __attribute__((no_instrument_function)) void __cyg_profile_func_enter(void* fn, void*)
+{
+	Q_TEST_NS_DETAIL::impact_record(fn);
+}
+
+extern "C" __attribute__((no_instrument_function)) void __cyg_profile_func_exit(void*, void*)
+{
+}
+#endif
+
+
+namespace QTest {
+	using Complexity = Q_TEST_NS_DETAIL::Complexity;
+	constexpr Complexity O1 = Complexity::O1;
+	constexpr Complexity LogN = Complexity::LogN;
+	constexpr Complexity N = Complexity::N;
+	constexpr Complexity NLogN = Complexity::NLogN;
+	constexpr Complexity N2 = Complexity::N2;
+	using Reporter = Q_TEST_NS_DETAIL::QTestReporter;
+	using TestResult = Q_TEST_NS_DETAIL::TestResult;
+	using RunStatistics = Q_TEST_NS_DETAIL::RunStatistics;
+}
+
 #endif // QTEST_H
@@ -7,6 +7,10 @@
 #define DESCRIBE(a, ...) Q_TEST_NS_DETAIL::BASE.describe(a, Q_TEST__LAMBDA_CALLBACK(__VA_ARGS__), QTEST_TEST_PARAM_ID, __FILE__)
 #define DESCRIBE_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.describe(a, Q_TEST__LAMBDA_CALLBACK(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __FILE__)
 #define DESCRIBE_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.describe(a, Q_TEST__LAMBDA_CALLBACK(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __FILE__)
+#define DESCRIBE_TYPES(a, types, ...) Q_TEST_NS_DETAIL::BASE.describe_types(a, types{}, Q_TEST__TYPED_LAMBDA_CALLBACK(__VA_ARGS__), QTEST_TEST_PARAM_ID, __FILE__)
+#define DESCRIBE_TYPES_ONLY(a, types, ...) Q_TEST_NS_DETAIL::BASE.describe_types(a, types{}, Q_TEST__TYPED_LAMBDA_CALLBACK(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __FILE__)
+#define DESCRIBE_TYPES_SKIP(a, types, ...) Q_TEST_NS_DETAIL::BASE.describe_types(a, types{}, Q_TEST__TYPED_LAMBDA_CALLBACK(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __FILE__)
+#define TYPE_LIST(...) Q_TEST_NS_DETAIL::TypeList<__VA_ARGS__>
 #define BEFORE_ALL(...) Q_TEST_NS_DETAIL::BASE.before(Q_TEST__LAMBDA(__VA_ARGS__))
 #define BEFORE_EACH(...) Q_TEST_NS_DETAIL::BASE.before_each(Q_TEST__LAMBDA(__VA_ARGS__))
 #define AFTER_ALL(...) Q_TEST_NS_DETAIL::BASE.after(Q_TEST__LAMBDA(__VA_ARGS__))
@@ -14,9 +18,36 @@
 #define IT(a, ...) Q_TEST_NS_DETAIL::BASE.it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_TEST_PARAM_ID, __LINE__)
 #define IT_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __LINE__)
 #define IT_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __LINE__)
+#define IT_EACH(table, a, ...) Q_TEST_NS_DETAIL::BASE.it_each(table, a, __VA_ARGS__, QTEST_TEST_PARAM_ID, __LINE__)
+#define IT_EACH_ONLY(table, a, ...) Q_TEST_NS_DETAIL::BASE.it_each(table, a, __VA_ARGS__, QTEST_ONLY_PARAM_ID, __LINE__)
+#define IT_EACH_SKIP(table, a, ...) Q_TEST_NS_DETAIL::BASE.it_each(table, a, __VA_ARGS__, QTEST_SKIP_PARAM_ID, __LINE__)
+#define BENCHMARK(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_TEST_PARAM_ID, __LINE__)
+#define BENCHMARK_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __LINE__)
+#define BENCHMARK_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __LINE__)
+#define BENCHMARK_COMPARE(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark_compare(a, __VA_ARGS__, QTEST_TEST_PARAM_ID, __LINE__)
+#define BENCHMARK_COMPARE_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark_compare(a, __VA_ARGS__, QTEST_ONLY_PARAM_ID, __LINE__)
+#define BENCHMARK_COMPARE_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.benchmark_compare(a, __VA_ARGS__, QTEST_SKIP_PARAM_ID, __LINE__)
+#define BENCHMARK_BYTES(a) Q_TEST_NS_DETAIL::BASE.benchmark_bytes(a)
+#define BENCHMARK_ITEMS(a) Q_TEST_NS_DETAIL::BASE.benchmark_items(a)
+#define DO_NOT_OPTIMIZE(a) Q_TEST_NS_DETAIL::do_not_optimize(a)
+#define CLOBBER_MEMORY() Q_TEST_NS_DETAIL::clobber_memory()
+#define STATIC_IT(a, ...) Q_TEST_NS_DETAIL::BASE.static_it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_TEST_PARAM_ID, __LINE__)
+#define STATIC_IT_ONLY(a, ...) Q_TEST_NS_DETAIL::BASE.static_it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_ONLY_PARAM_ID, __LINE__)
+#define STATIC_IT_SKIP(a, ...) Q_TEST_NS_DETAIL::BASE.static_it(a, Q_TEST__LAMBDA(__VA_ARGS__), QTEST_SKIP_PARAM_ID, __LINE__)
 #define EXPECT(a) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect((a), Q_TEST__STRINGIFY(a)))
+#define EXPECT_LATENCY(...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect_latency(#__VA_ARGS__, __VA_ARGS__))
+#define EXPECT_SCALING(...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect_scaling(#__VA_ARGS__, __VA_ARGS__))
+#define EXPECT_REALTIME_SAFE(...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect_realtime_safe(#__VA_ARGS__, Q_TEST__LAMBDA(__VA_ARGS__)))
+#define EXPECT_LOCK_CONTENTION(...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.expect_lock_contention(#__VA_ARGS__, Q_TEST__LAMBDA(__VA_ARGS__)))
+#define STRESS(threads, amount, ...) Q_TEST__RETURN_IF_FALSE(Q_TEST_NS_DETAIL::BASE.stress(threads, amount, Q_TEST__LAMBDA(__VA_ARGS__)))
+#define STRESS_THREAD() Q_TEST_NS_DETAIL::stress_thread
+#define PERF_COUNTERS(...) Q_TEST_NS_DETAIL::measure_perf_counters(Q_TEST__LAMBDA(__VA_ARGS__))
+#define RESOURCE_USAGE(...) Q_TEST_NS_DETAIL::measure_resource_usage(Q_TEST__LAMBDA(__VA_ARGS__))
+#define TRACE_SPAN(a) Q_TEST_NS_DETAIL::TraceSpan Q_TEST__UNIQ_NAME()(a)
+#define ADD_REPORTER(a) Q_TEST_NS_DETAIL::BASE.add_reporter(a)
+#define CONSTEXPR_EXPECT(...) static_assert((__VA_ARGS__), "CONSTEXPR_EXPECT(" #__VA_ARGS__ ") FAILED!")
 #define INFO_PRINT(a) Q_TEST_NS_DETAIL::BASE.info_print(a)
-#define TEST_FAILED(a) EXPECT(std::string{a}).fail();
+#define TEST_FAILED(a) EXPECT(Q_TEST_NS_DETAIL::failure_message(a)).fail();
 #define TEST_SUCCEED() EXPECT(1).toBe(1)
 #define SCENARIO_START Q_TEST__TEST_UNIT ([]{ Q_TEST_NS_DETAIL::BASE.script([]{
 #define SCENARIO_END }); });
@@ -0,0 +1,224 @@
+#ifndef QTESTALLOC_H
+#define QTESTALLOC_H
+
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "qtestrealtime.hpp"
+
+namespace Q_TEST_NS_DETAIL {
+
+struct AllocationStats {
+	uint64_t count = 0;
+	uint64_t bytes = 0;
+	uint64_t peak_bytes = 0;
+	uint64_t live_count = 0;
+	uint64_t live_bytes = 0;
+};
+
+// Every block gets the header with its size and the epoch of the test it was
+// allocated in (0 if it was allocated outside of the tests), so only the frees
+// of the current test memory change its live counters.
+struct alignas(16) AllocationHeader {
+	uint64_t size;
+	uint64_t epoch;
+};
+
+class AllocationTracker
+{
+	public:
+		void install() { installed = true; }
+		void begin();
+		AllocationStats end();
+		bool is_installed() { return installed.load(std::memory_order_relaxed); }
+
+		void* allocate(size_t size);
+		void deallocate(void* ptr);
+
+	private:
+		std::atomic<bool> installed{false};
+		std::atomic<uint64_t> epoch{0};
+		std::atomic<uint64_t> last_epoch{0};
+		std::atomic<uint64_t> count{0};
+		std::atomic<uint64_t> bytes{0};
+		std::atomic<uint64_t> peak_bytes{0};
+		std::atomic<uint64_t> live_count{0};
+		std::atomic<uint64_t> live_bytes{0};
+};
+
+inline AllocationTracker allocation_tracker;
+inline thread_local int allocation_pause = 0;
+// Set by TEST_FAIL_ON_LEAKS.
+inline bool fail_on_leaks = false;
+
+// Allocations of the framework itself made while the test runs.
+struct AllocationPause {
+	AllocationPause() { allocation_pause++; }
+	~AllocationPause() { allocation_pause--; }
+};
+
+// The stream of INFO_PRINT is written after info_print returns, in the chained
+// operator<< calls, so its buffer grows with the tracking paused.
+class PausedStringBuf : public std::stringbuf
+{
+	protected:
+		int_type overflow(int_type c) override { AllocationPause pause; return std::stringbuf::overflow(c); }
+		std::streamsize xsputn(const char* s, std::streamsize n) override { AllocationPause pause; return std::stringbuf::xsputn(s, n); }
+};
+
+class InfoStream : public std::ostream
+{
+	public:
+		InfoStream() : std::ostream(nullptr) { init(&buf); }
+		InfoStream(InfoStream&& other) : std::ostream(std::move(other)), buf(std::move(other.buf)) { set_rdbuf(&buf); }
+		std::string str() const { return buf.str(); }
+
+	private:
+		PausedStringBuf buf;
+};
+
+inline void AllocationTracker::begin()
+{
+	count = 0;
+	bytes = 0;
+	peak_bytes = 0;
+	live_count = 0;
+	live_bytes = 0;
+	epoch = ++last_epoch;
+}
+
+inline AllocationStats AllocationTracker::end()
+{
+	epoch = 0;
+	return {count, bytes, peak_bytes, live_count, live_bytes};
+}
+
+inline void* AllocationTracker::allocate(size_t size)
+{
+	auto* header = static_cast<AllocationHeader*>(std::malloc(size + sizeof(AllocationHeader)));
+	if (!header) return nullptr;
+	header->size = size;
+	header->epoch = allocation_pause ? 0 : epoch.load(std::memory_order_relaxed);
+	if (header->epoch) {
+		count.fetch_add(1, std::memory_order_relaxed);
+		bytes.fetch_add(size, std::memory_order_relaxed);
+		live_count.fetch_add(1, std::memory_order_relaxed);
+		uint64_t live = live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+		uint64_t peak = peak_bytes.load(std::memory_order_relaxed);
+		while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed));
+	}
+	return header + 1;
+}
+
+inline void AllocationTracker::deallocate(void* ptr)
+{
+	if (!ptr) return;
+	auto* header = static_cast<AllocationHeader*>(ptr) - 1;
+	if (header->epoch && header->epoch == epoch.load(std::memory_order_relaxed)) {
+		live_count.fetch_sub(1, std::memory_order_relaxed);
+		live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+	}
+	std::free(header);
+}
+
+inline std::string format_bytes(uint64_t value)
+{
+	const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+	if (value < 1024) return std::to_string(value) + " B";
+	double v = value;
+	int i = 0;
+	while (v >= 1024 && i < 4) {
+		v /= 1024;
+		i++;
+	}
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.2f %s", v, units[i]);
+	return buf;
+}
+
+inline std::string generate_allocations_text(AllocationStats& stats)
+{
+	std::string res = "allocations " + std::to_string(stats.count) + ", " + format_bytes(stats.bytes)
+		+ ", peak " + format_bytes(stats.peak_bytes);
+	if (stats.live_count) {
+		res += ", not released " + std::to_string(stats.live_count) + " (" + format_bytes(stats.live_bytes) + ")";
+	}
+	return res;
+}
+
+} // Q_TEST_NS_DETAIL
+
+// Replacement functions can't be inline, so they are defined only in the
+// translation unit that defines TEST_TRACK_ALLOCATIONS or TEST_REALTIME_SAFETY.
+#if defined(TEST_TRACK_ALLOCATIONS) || defined(TEST_REALTIME_SAFETY)
+void* operator new(std::size_t size)
+{
+	Q_TEST_NS_DETAIL::realtime_violation("operator new");
+	void* ptr = Q_TEST_NS_DETAIL::allocation_tracker.allocate(size);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+	Q_TEST_NS_DETAIL::realtime_violation("operator new[]");
+	void* ptr = Q_TEST_NS_DETAIL::allocation_tracker.allocate(size);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+	Q_TEST_NS_DETAIL::realtime_violation("operator new");
+	return Q_TEST_NS_DETAIL::allocation_tracker.allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+	Q_TEST_NS_DETAIL::realtime_violation("operator new[]");
+	return Q_TEST_NS_DETAIL::allocation_tracker.allocate(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete[]");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete[]");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	if (ptr) Q_TEST_NS_DETAIL::realtime_violation("operator delete[]");
+	Q_TEST_NS_DETAIL::allocation_tracker.deallocate(ptr);
+}
+#endif
+
+#endif // QTESTALLOC_H
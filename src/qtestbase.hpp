@@ -11,41 +11,36 @@
 
 #include "qtestexpect.hpp"
 #include "qtestprint.hpp"
+#include "qtestbench.hpp"
+#include "qtestlatency.hpp"
+#include "qtestthreads.hpp"
+#include "qtestperf.hpp"
+#include "qtestalloc.hpp"
+#include "qtestrealtime.hpp"
+#include "qtestresource.hpp"
+#include "qtesttrace.hpp"
+#include "qtestprofile.hpp"
+#include "qtestlocks.hpp"
+#include "qtestreport.hpp"
+#include "qtestmetrics.hpp"
+#include "qtestjournal.hpp"
+#include "qtestrerun.hpp"
+#include "qtestimpact.hpp"
 #include "qtestutils.hpp"
 
 namespace Q_TEST_NS_DETAIL {
 
-inline std::string sanitize(std::string& value)
-{
-	std::string str;
-	for (char c : value) {
-		switch(c) {
-			case '\n':
-				str.append("\\n");
-				break;
-			case '\r':
-				str.append("\\r");
-				break;
-			case '\t':
-				str.append("\\t");
-				break;
-			case '\b':
-				str.append("\\b");
-				break;
-			case '\x1b':
-				str.append("\\x1b");
-				break;
-			default:
-				str.push_back(c);
-		}
-	}
-	return str;
-}
-
 class QTestBase
 {
 	using function_cb_t = std::function<void()>;
 	using describe_function_cb_t = std::function<void(std::function<void()>)>;
+	struct DeferredTest {
+		std::string text;
+		function_cb_t fn;
+		int param;
+		int line;
+	};
+
 	struct Describe {
 		Describe(std::string str, std::string_view file, int mode) : text(str), file(file), mode(mode) {}
 		bool is_skip() { return mode == QTEST_SKIP_PARAM_ID; }
@@ -59,6 +54,9 @@ class QTestBase
 		std::vector<function_cb_t> after_alls = {};
 		std::vector<function_cb_t> before_eachs = {};
 		std::vector<function_cb_t> after_eachs = {};
+		std::vector<DeferredTest> deferred = {};
+		ImpactFixture impact_fixture = {};
+		ResourceUsage resources = {};
 	};
 
 	struct Test {
@@ -69,9 +67,29 @@ class QTestBase
 		std::string_view expect_str = "";
 		std::vector<std::stringstream> info_prints = {};
 		ErrorReport error = {};
+		std::shared_ptr<BenchmarkStats> benchmark = nullptr;
+		std::shared_ptr<CompareStats> comparison = nullptr;
+		std::shared_ptr<PerfCounters> perf_counters = nullptr;
+		std::shared_ptr<AllocationStats> allocations = nullptr;
+		std::shared_ptr<ResourceUsage> resources = nullptr;
+		std::shared_ptr<LockContention> locks = nullptr;
+		std::shared_ptr<StressStats> stress = nullptr;
+		size_t profile_samples = 0;
+		double duration = 0;
+		bool replayed = false;
 		bool result = true;
 	};
 
+	struct AllocatingTest {
+		std::string text;
+		std::shared_ptr<AllocationStats> allocations;
+	};
+
+	struct ExpectTarget {
+		bool* result;
+		ErrorReport* error;
+	};
+
 	struct FailedTest {
 		std::vector<std::shared_ptr<Test>> tests;
 		std::vector<std::shared_ptr<Describe>> stack;
@@ -83,26 +101,43 @@ class QTestBase
 
 		void script(function_cb_t fn);
 		void describe(std::string str, describe_function_cb_t fn, int param, std::string_view file);
+		template<typename... Ts, typename F> void describe_types(std::string str, TypeList<Ts...>, F fn, int param, std::string_view file);
 		void before(function_cb_t fn);
 		void before_each(function_cb_t fn);
 		void after(function_cb_t fn);
 		void after_each(function_cb_t fn);
 		void it(std::string str, function_cb_t fn, int param, int line);
+		template<typename F> void static_it(std::string str, F&& fn, int param, int line);
+		template<typename Table, typename F> void it_each(Table&& table, std::string str, F fn, int param, int line);
+		template<typename F> void benchmark(std::string str, F fn, int param, int line);
+		template<typename F, typename G> void benchmark_compare(std::string str, F baseline, G candidate, int param, int line);
+		void benchmark_bytes(uint64_t bytes);
+		void benchmark_items(uint64_t items);
 
 		template<typename T> std::basic_ostream<char>& info_print(T&& str);
 		std::basic_ostream<char>& info_print();
 
 		template<typename T> QTestExpect<T> expect(T&& a, std::string_view s);
 		template<typename T> QTestExpect<T> expect(T& a, std::string_view s);
+		template<typename F> QTestLatency expect_latency(std::string_view s, F&& fn, uint64_t iterations);
+		template<typename F> QTestScaling expect_scaling(std::string_view s, F&& fn, unsigned max_threads);
+		template<typename F> bool expect_realtime_safe(std::string_view s, F&& fn);
+		template<typename F> QTestLockContention expect_lock_contention(std::string_view s, F&& fn);
+		template<typename A, typename F> bool stress(unsigned threads, A amount, F&& fn);
+
+		void add_reporter(std::shared_ptr<QTestReporter> reporter);
 
 	private:
 		Describe& current_describe();
+		bool filtered_by_only(int param);
+		void show_describes();
 
 		void test_precalls();
 		void test_postcalls();
 		bool in_skip_describe();
 		bool in_only_describe();
 		void current_describe_ran_inc();
+		void run_deferred(Describe& d);
 		bool current_describe_ran();
 
 		void run_scenarios();
@@ -110,32 +145,66 @@ class QTestBase
 		void call_after_all(Describe& d);
 		void call_before_each(Describe& d);
 		void call_after_each(Describe& d);
+		void call_hook(function_cb_t& fn, std::string_view name);
 
 		void show_start();
 		void show_statistics();
+		void show_top_allocations();
+		void check_allocations(AllocationStats stats);
+		void add_resource_usage(ResourceUsage usage);
 
+		ExpectTarget expect_target(std::string_view s, std::string_view macro = "EXPECT");
+		void merge_thread_failures();
 		void show_test_results(Test& t, bool is_skip);
+		void report_test_results(Test& t, bool is_skip);
+		bool replay_test(std::string& str);
 		void show_failed_test_results(Test& t, std::string_view file);
 		void show_test_infos(Test& t);
+		void show_test_hint(std::string& hint);
 
 		void show_failed_tests();
 		void show_succeed();
 
 		std::string generate_describes_text(std::vector<std::shared_ptr<Describe>>& descrs);
+		template<typename R> std::string generate_row_text(std::string_view str, R& row, size_t index);
 		std::string generate_test_error(std::string_view expect_str, ErrorReport& error);
+		std::string generate_benchmark_text(BenchmarkStats& stats);
+		std::string generate_comparison_text(CompareStats& stats);
+		void check_benchmark_baseline(std::string& str, BenchmarkStats& stats);
 
 		std::vector<function_cb_t> scenarios;
 		std::vector<std::shared_ptr<Describe>> describes;
 		std::vector<FailedTest> failed_tests;
+		std::vector<AllocatingTest> allocating_tests;
 		std::shared_ptr<Test> current_test;
 
 		std::unique_ptr<QTestPrint> P;
-
+		std::unique_ptr<QTestBaseline> baseline;
+		std::unique_ptr<QTestPerf> perf;
+		std::unique_ptr<QTestTrace> tracer;
+		std::unique_ptr<QTestProfiler> sampler;
+		std::vector<std::shared_ptr<QTestReporter>> reporters;
+		ThreadFailures thread_failures;
+		std::thread::id test_thread = std::this_thread::get_id();
+		std::unique_ptr<QTestJournal> results_journal;
+		std::unique_ptr<QTestRerunState> failed_state;
+		std::unique_ptr<QTestImpactMap> impact_map;
+
+		uint64_t bench_bytes = 0;
+		uint64_t bench_items = 0;
 		int tests_count = 0;
 		int tests_failed = 0;
 		int tests_skipped = 0;
 		bool tests_only = false;
 		bool describes_changed = false;
+		bool track_resources = false;
+		bool profile_locks = false;
+		bool failed_first = false;
+		bool failed_only = false;
+		bool replaying = false;
+		bool running = false;
+		std::chrono::steady_clock::time_point run_start;
+		double hooks_duration = 0;
 };
 
 
@@ -144,6 +213,72 @@ inline QTestBase::QTestBase()
 	#ifdef TEST_ONLY_RULE
 	tests_only = true;
 	#endif
+	#ifdef TEST_BENCHMARK_BASELINE
+	baseline = std::make_unique<QTestBaseline>(TEST_BENCHMARK_BASELINE);
+	#endif
+	#ifdef TEST_TRACK_ALLOCATIONS
+	allocation_tracker.install();
+	#endif
+	#ifdef TEST_FAIL_ON_LEAKS
+	fail_on_leaks = true;
+	#endif
+	#ifdef TEST_RESOURCE_USAGE
+	track_resources = true;
+	#endif
+	#ifdef TEST_TRACE_OUTPUT
+	tracer = std::make_unique<QTestTrace>(TEST_TRACE_OUTPUT);
+	trace = tracer.get();
+	#endif
+	#ifdef TEST_PROFILE_OUTPUT
+	sampler = std::make_unique<QTestProfiler>(TEST_PROFILE_OUTPUT);
+	if (!sampler->is_available()) sampler = nullptr;
+	profiler = sampler.get();
+	#endif
+	#if defined(TEST_LOCK_PROFILE) && defined(Q_TEST__HAS_LOCK_HOOKS)
+	profile_locks = true;
+	#endif
+	#ifdef TEST_REPORT_JUNIT
+	add_reporter(std::make_shared<QTestJUnitReporter>(TEST_REPORT_JUNIT));
+	#endif
+	#ifdef TEST_REPORT_JSONL
+	add_reporter(std::make_shared<QTestJsonReporter>(TEST_REPORT_JSONL));
+	#endif
+	#ifdef TEST_REPORT_TAP
+	add_reporter(std::make_shared<QTestTapReporter>(TEST_REPORT_TAP));
+	#endif
+	#ifdef TEST_JOURNAL
+	bool resume = false;
+	#ifdef TEST_JOURNAL_RESUME
+	resume = true;
+	#endif
+	results_journal = std::make_unique<QTestJournal>(TEST_JOURNAL, resume);
+	journal = results_journal.get();
+	#endif
+	#ifdef TEST_FAILED_STATE
+	failed_state = std::make_unique<QTestRerunState>(TEST_FAILED_STATE);
+	rerun = failed_state.get();
+	#endif
+	#ifdef TEST_IMPACT_MAP
+	impact_map = std::make_unique<QTestImpactMap>(TEST_IMPACT_MAP);
+	impact = impact_map.get();
+	#ifdef TEST_IMPACT_CHANGED
+	impact->select(TEST_IMPACT_CHANGED);
+	#endif
+	#endif
+	#ifdef TEST_FAILED_FIRST
+	failed_first = true;
+	#endif
+	#ifdef TEST_FAILED_ONLY
+	failed_first = true;
+	failed_only = true;
+	#endif
+	#ifdef TEST_METRICS_OUTPUT
+	add_reporter(std::make_shared<QTestMetricsReporter>(TEST_METRICS_OUTPUT));
+	#endif
+	#ifdef TEST_PERF_COUNTERS
+	perf = std::make_unique<QTestPerf>();
+	if (!perf->is_available()) perf = nullptr;
+	#endif
 	P = std::make_unique<QTestPrint>();
 	show_start();
 }
@@ -151,6 +286,27 @@ inline QTestBase::QTestBase()
 inline QTestBase::~QTestBase()
 {
 	run_scenarios();
+	// Closed before the exit call, which doesn't destroy the members.
+	trace = nullptr;
+	tracer = nullptr;
+	profiler = nullptr;
+	sampler = nullptr;
+	journal = nullptr;
+	results_journal = nullptr;
+	if (baseline) {
+		baseline->save();
+	}
+	if (rerun) {
+		rerun->save();
+	}
+	if (impact) {
+		impact->save();
+	}
+	RunStatistics stats = {tests_count, tests_failed, tests_skipped, std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - run_start).count(), hooks_duration};
+	for (auto& r : reporters) {
+		r->statistics(stats);
+	}
+	reporters.clear();
 	show_statistics();
 	if(tests_failed) {
 		exit(1);
@@ -164,37 +320,100 @@ inline void QTestBase::script(std::function<void()> fn)
 
 inline void QTestBase::describe(std::string str, describe_function_cb_t fn, int param, std::string_view file)
 {
+	TraceSpan span(str, "describe");
 	describes.push_back(std::make_shared<Describe>(str, file, param));
 	describes_changed = true;
+	for (auto& r : reporters) {
+		r->describe_enter(str);
+	}
 
-	fn([this]{ if (current_describe_ran()) call_after_all(current_describe()); });
+	fn([this]{
+		run_deferred(current_describe());
+		if (current_describe_ran()) call_after_all(current_describe());
+	});
 
+	if (current_describe().resources.available) {
+		P->print_describe_stats(generate_describes_text(describes), generate_resource_usage_text(current_describe().resources));
+	}
+	for (auto& r : reporters) {
+		r->describe_leave(str);
+	}
 	describes.pop_back();
 	describes_changed = true;
 }
 
+// Every type gets its own instantiation of the describe body.
+template<typename... Ts, typename F>
+inline void QTestBase::describe_types(std::string str, TypeList<Ts...>, F fn, int param, std::string_view file)
+{
+	(describe(str + " <" + type_name<Ts>() + ">", [&fn](std::function<void()> callback){ fn(TypeTag<Ts>{}, callback); }, param, file), ...);
+}
+
 inline void QTestBase::it(std::string str, function_cb_t fn, int param, int line)
 {
+	std::string test_id = (rerun || impact) ? rerun_test_id(generate_describes_text(describes), str, line) : "";
+	bool rerun_filtered = rerun && rerun->filtered(test_id);
 	// Don't call if the TEST_ONLY mode is on and only param is not set
-	if (tests_only && param != QTEST_ONLY_PARAM_ID && !in_only_describe()) return;
-
-	// Print test describes
-	if (describes_changed) {
-		std::string descr = generate_describes_text(describes);
-		P->print_description(descr);
+	if (filtered_by_only(param) || rerun_filtered) return;
+	if (impact && impact->filtered(test_id)) return;
+	if (rerun && !replaying && !describes.empty() && rerun->deferred(test_id)) {
+		current_describe().deferred.push_back({str, fn, param, line});
+		return;
 	}
 
+	show_describes();
+
 	tests_count++;
 
 	current_test = std::make_shared<Test>(str, line);
 
 	bool is_skip = (param == QTEST_SKIP_PARAM_ID || in_skip_describe());
-	if (!is_skip) {
+	bool is_replay = !is_skip && journal && replay_test(str);
+	if (!is_skip && !is_replay) {
+		TraceSpan span(str, "it");
+		auto start = std::chrono::steady_clock::now();
+		ResourceUsage resources_start;
+		if (track_resources) resources_start = read_resource_usage();
+
+		// Allocations are tracked from the first BEFORE_EACH till the last AFTER_EACH.
+		bool track_allocations = allocation_tracker.is_installed();
+		if (track_allocations) allocation_tracker.begin();
+		if (impact) impact->begin();
+
 		test_precalls();
 
+		if (sampler) sampler->start();
+		if (perf) perf->start();
+		if (profile_locks) lock_profile_begin();
 		fn();
+		if (profile_locks) lock_profile_end();
+		if (perf) {
+			AllocationPause pause;
+			current_test->perf_counters = std::make_shared<PerfCounters>(perf->stop());
+		}
+		if (profile_locks) {
+			AllocationPause pause;
+			current_test->locks = std::make_shared<LockContention>(read_lock_contention());
+		}
+		if (sampler) {
+			sampler->stop();
+			AllocationPause pause;
+			current_test->profile_samples = sampler->write(generate_describes_text(describes) + str);
+		}
 
 		test_postcalls();
+		merge_thread_failures();
+
+		if (impact) {
+			for (auto& d : describes) {
+				impact->add(d->impact_fixture);
+			}
+			impact->end(test_id);
+		}
+		if (track_allocations) check_allocations(allocation_tracker.end());
+		if (track_resources) add_resource_usage(read_resource_usage() - resources_start);
+		current_test->duration = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		if (journal) journal->record(generate_describes_text(describes) + str, current_test->result, current_test->duration);
 		current_describe_ran_inc();
 	}
 
@@ -210,13 +429,207 @@ inline void QTestBase::it(std::string str, function_cb_t fn, int param, int line
 			failed_tests.back().tests.push_back(current_test);
 		}
 	}
+	if (rerun && !is_skip) {
+		rerun->record(test_id, current_test->result);
+	}
 
 	// Print test
+	report_test_results(*current_test, is_skip);
 	show_test_results(*current_test, is_skip);
 
 	describes_changed = false;
 }
 
+// Assertions of the static test are checked by the compiler when the body
+// lambda is instantiated, so the body is never called and no hooks are ran.
+template<typename F>
+inline void QTestBase::static_it(std::string str, F&&, int param, int line)
+{
+	std::string test_id = (rerun || impact) ? rerun_test_id(generate_describes_text(describes), str, line) : "";
+	bool rerun_filtered = rerun && rerun->filtered(test_id);
+	if (filtered_by_only(param) || rerun_filtered) return;
+	if (impact && impact->filtered(test_id)) return;
+
+	show_describes();
+
+	tests_count++;
+
+	current_test = std::make_shared<Test>(str, line);
+
+	bool is_skip = (param == QTEST_SKIP_PARAM_ID || in_skip_describe());
+	if (is_skip) {
+		++tests_skipped;
+	}
+
+	report_test_results(*current_test, is_skip);
+	show_test_results(*current_test, is_skip);
+
+	describes_changed = false;
+}
+
+// Rows are pulled one by one and every row runs as a separate test right away,
+// so neither the table nor the generated tests are ever materialized.
+template<typename Table, typename F>
+inline void QTestBase::it_each(Table&& table, std::string str, F fn, int param, int line)
+{
+	size_t index = 0;
+	if constexpr (std::is_invocable_v<Table&>) {
+		while (auto row = table()) {
+			it(generate_row_text(str, *row, index++), [fn, row]() mutable { fn(*row); }, param, line);
+		}
+	} else {
+		for (auto&& row : table) {
+			it(generate_row_text(str, row, index++), [fn, row]() mutable { fn(row); }, param, line);
+		}
+	}
+}
+
+// Benchmark runs as a regular test, so the hooks and EXPECT work as usual,
+// and the failed EXPECT stops the measurements.
+template<typename F>
+inline void QTestBase::benchmark(std::string str, F fn, int param, int line)
+{
+	it(str, [this, str, fn]() mutable {
+		// The body runs thousands of times, so its allocations are not tracked.
+		AllocationPause pause;
+		bench_bytes = 0;
+		bench_items = 0;
+		QTestBenchmark bench([this]{ return !current_test->result; });
+		BenchmarkStats stats = bench.run(fn);
+		stats.bytes = bench_bytes;
+		stats.items = bench_items;
+		if (baseline && current_test->result) {
+			check_benchmark_baseline(str, stats);
+		}
+		current_test->benchmark = std::make_shared<BenchmarkStats>(std::move(stats));
+	}, param, line);
+}
+
+// The candidate fails only if it is slower and the difference is significant,
+// so the noise never fails the test.
+template<typename F, typename G>
+inline void QTestBase::benchmark_compare(std::string str, F baseline, G candidate, int param, int line)
+{
+	it(str, [this, baseline, candidate]() mutable {
+		AllocationPause pause;
+		QTestBenchmark bench([this]{ return !current_test->result; });
+		CompareStats stats = bench.compare(baseline, candidate);
+		if (!current_test->result) return;
+		if (stats.speedup < 1 && stats.p_value < TEST_BENCHMARK_ALPHA) {
+			char speedup[32];
+			std::snprintf(speedup, sizeof(speedup), "%.2fx", stats.speedup);
+			current_test->result = false;
+			current_test->expect_str = "candidate speedup";
+			current_test->error = {};
+			current_test->error.func = "toBeSignificantlySlower";
+			current_test->error.inverse = true;
+			current_test->error.value_substituted = true;
+			current_test->error.value = speedup;
+			current_test->error.hint = generate_comparison_text(stats);
+		}
+		current_test->comparison = std::make_shared<CompareStats>(std::move(stats));
+	}, param, line);
+}
+
+// Known benchmarks are compared with the baseline (or overwritten in the
+// TEST_BENCHMARK_BASELINE_UPDATE mode), new ones are recorded if it is written.
+inline void QTestBase::check_benchmark_baseline(std::string& str, BenchmarkStats& stats)
+{
+	std::string key = generate_describes_text(describes) + str;
+	BaselineEntry* entry = baseline->find(key);
+	#ifdef TEST_BENCHMARK_BASELINE_UPDATE
+	entry = nullptr;
+	#endif
+	if (!entry) {
+		baseline->record(key, stats);
+		return;
+	}
+	stats.baseline = entry->median;
+	if (baseline->is_regression(*entry, stats)) {
+		current_test->result = false;
+		current_test->expect_str = "benchmark median";
+		current_test->error = {};
+		current_test->error.func = "toBeWithinBaseline";
+		current_test->error.has_compare = true;
+		current_test->error.value_substituted = true;
+		current_test->error.value = format_duration(stats.median);
+		current_test->error.compare_substituted = true;
+		current_test->error.compare = format_duration(entry->median) + ", " + format_percent(TEST_BENCHMARK_TOLERANCE);
+		current_test->error.hint = generate_benchmark_text(stats);
+	}
+}
+
+// Memory still allocated after AFTER_EACH is reported, and fails the test with
+// TEST_FAIL_ON_LEAKS. The failed test keeps the error it failed with.
+inline void QTestBase::check_allocations(AllocationStats stats)
+{
+	current_test->allocations = std::make_shared<AllocationStats>(stats);
+	allocating_tests.push_back({generate_describes_text(describes) + current_test->text, current_test->allocations});
+	if (fail_on_leaks && stats.live_count && current_test->result) {
+		current_test->result = false;
+		current_test->expect_str = "not released allocations";
+		current_test->error = {};
+		current_test->error.func = "toBe";
+		current_test->error.has_compare = true;
+		current_test->error.value_substituted = true;
+		current_test->error.value = std::to_string(stats.live_count);
+		current_test->error.compare_substituted = true;
+		current_test->error.compare = "0";
+		current_test->error.hint = format_bytes(stats.live_bytes) + " allocated by the test are not released";
+	}
+}
+
+// The usage of the test is rolled up into all of its describes.
+inline void QTestBase::add_resource_usage(ResourceUsage usage)
+{
+	current_test->resources = std::make_shared<ResourceUsage>(usage);
+	for (auto& d : describes) {
+		d->resources += usage;
+	}
+}
+
+// The test finished by the interrupted run is not ran again, its result is
+// taken from the journal.
+inline bool QTestBase::replay_test(std::string& str)
+{
+	JournalEntry entry;
+	if (!journal->replay(generate_describes_text(describes) + str, entry)) return false;
+	current_test->replayed = true;
+	current_test->duration = entry.duration;
+	if (!entry.passed) {
+		current_test->result = false;
+		current_test->expect_str = "journaled result";
+		current_test->error = {};
+		current_test->error.func = "toBePassed";
+		current_test->error.value_substituted = true;
+		current_test->error.value = "failed";
+		current_test->error.hint = "the test failed before the run was resumed";
+	}
+	return true;
+}
+
+// The reporter added while the tests run gets the run start and the open
+// describes first, so its events stay balanced.
+inline void QTestBase::add_reporter(std::shared_ptr<QTestReporter> reporter)
+{
+	reporters.push_back(reporter);
+	if (!running) return;
+	reporter->run_start();
+	for (auto& d : describes) {
+		reporter->describe_enter(d->text);
+	}
+}
+
+inline void QTestBase::benchmark_bytes(uint64_t bytes)
+{
+	bench_bytes = bytes;
+}
+
+inline void QTestBase::benchmark_items(uint64_t items)
+{
+	bench_items = items;
+}
+
 inline void QTestBase::before(function_cb_t fn)
 {
 	current_describe().before_alls.push_back(fn);
@@ -240,12 +653,14 @@ inline void QTestBase::after_each(function_cb_t fn)
 template<typename T>
 inline std::basic_ostream<char>& QTestBase::info_print(T&& str)
 {
+	AllocationPause pause;
 	current_test->info_prints.push_back(std::stringstream{});
 	return current_test->info_prints.back() << str;
 }
 
 inline std::basic_ostream<char>& QTestBase::info_print()
 {
+	AllocationPause pause;
 	current_test->info_prints.push_back(std::stringstream{});
 	return current_test->info_prints.back();
 }
@@ -253,17 +668,178 @@ inline std::basic_ostream<char>& QTestBase::info_print()
 template<typename T>
 QTestExpect<T> QTestBase::expect(T&& a, std::string_view s)
 {
-	current_test->expect_str = s;
-	current_test->error = {};
-	return QTestExpect<T>(std::move(a), &(current_test->result), &current_test->error);
+	ExpectTarget target = expect_target(s);
+	return QTestExpect<T>(std::move(a), target.result, target.error);
 }
 
 template<typename T>
 QTestExpect<T> QTestBase::expect(T& a, std::string_view s)
 {
-	current_test->expect_str = s;
-	current_test->error = {};
-	return QTestExpect<T>(a, &(current_test->result), &current_test->error);
+	ExpectTarget target = expect_target(s);
+	return QTestExpect<T>(a, target.result, target.error);
+}
+
+// Only the call itself is inside of the measured interval, the histogram
+// recording takes a few nanoseconds and stays outside.
+template<typename F>
+QTestLatency QTestBase::expect_latency(std::string_view s, F&& fn, uint64_t iterations)
+{
+	ExpectTarget target = expect_target(s, "EXPECT_LATENCY");
+	LatencyHistogram histogram;
+	for (uint64_t i=0;i<iterations;i++) {
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		auto end = std::chrono::steady_clock::now();
+		histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	}
+	return QTestLatency(std::move(histogram), target.result, target.error);
+}
+
+// Allocations are detected only if the replacement operators are defined
+// (TEST_TRACK_ALLOCATIONS or TEST_REALTIME_SAFETY), locks and sleeps only with
+// TEST_REALTIME_SAFETY. Blocking in the kernel is always detected on Linux.
+template<typename F>
+bool QTestBase::expect_realtime_safe(std::string_view s, F&& fn)
+{
+	ExpectTarget target = expect_target(s, "EXPECT_REALTIME_SAFE");
+	RealtimeScope scope;
+	scope.run(fn);
+	if (!(*target.result &= scope.is_safe())) {
+		AllocationPause pause;
+		target.error->func = "toBeRealtimeSafe";
+		target.error->value_substituted = true;
+		target.error->value = scope.count() ? scope.violation(0).call : "blocked";
+		target.error->hint = generate_realtime_hint(scope);
+	}
+	return *target.result;
+}
+
+// Locks are profiled only if the hooks are defined (TEST_LOCK_PROFILE or
+// TEST_REALTIME_SAFETY), otherwise every check fails as not measured.
+template<typename F>
+QTestLockContention QTestBase::expect_lock_contention(std::string_view s, F&& fn)
+{
+	ExpectTarget target = expect_target(s, "EXPECT_LOCK_CONTENTION");
+	return QTestLockContention(measure_lock_contention(fn), target.result, target.error);
+}
+
+// The scaling table is printed with the test infos, so it is visible for the
+// passed tests as well.
+template<typename F>
+QTestScaling QTestBase::expect_scaling(std::string_view s, F&& fn, unsigned max_threads)
+{
+	ExpectTarget target = expect_target(s, "EXPECT_SCALING");
+	std::vector<ScalingPoint> points = measure_scaling(fn, max_threads);
+	std::stringstream table(generate_scaling_table(points));
+	std::string line;
+	while (std::getline(table, line)) {
+		info_print(line);
+	}
+	return QTestScaling(std::move(points), target.result, target.error);
+}
+
+// The amount is the iterations of every thread, or the std::chrono duration of
+// the run. The threads are released together from the spin barrier, and all of
+// them stop at the first failed EXPECT of the body.
+template<typename A, typename F>
+bool QTestBase::stress(unsigned threads, A amount, F&& fn)
+{
+	using clock = std::chrono::steady_clock;
+	AllocationPause pause;
+	threads = std::max(1u, threads);
+	uint64_t iterations = UINT64_MAX;
+	if constexpr (std::is_integral_v<A>) iterations = amount;
+	SpinBarrier barrier;
+	std::atomic<bool> stop{false};
+	std::atomic<unsigned> failed{0};
+	std::vector<uint64_t> ops(threads, 0);
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+	for (unsigned t=0;t<threads;t++) {
+		workers.emplace_back([&, t]{
+			stress_thread = t;
+			pin_stress_thread(t);
+			ThreadFailure& node = thread_failures.node();
+			barrier.arrive();
+			barrier.wait_start();
+			uint64_t count = 0;
+			while (count < iterations && !stop.load(std::memory_order_relaxed)) {
+				fn();
+				count++;
+				if (!node.result) {
+					failed.fetch_add(1, std::memory_order_relaxed);
+					stop.store(true, std::memory_order_relaxed);
+				}
+			}
+			ops[t] = count;
+		});
+	}
+	barrier.start(threads);
+	auto start = clock::now();
+	if constexpr (!std::is_integral_v<A>) {
+		while (clock::now() - start < amount && !stop.load(std::memory_order_relaxed)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		stop.store(true, std::memory_order_relaxed);
+	}
+	for (auto& w : workers) {
+		w.join();
+	}
+
+	StressStats stats;
+	stats.threads = threads;
+	stats.duration = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+	for (uint64_t n : ops) {
+		stats.iterations += n;
+	}
+	stats.throughput = stats.duration > 0 ? stats.iterations / (stats.duration / 1e9) : 0;
+	stats.failed_threads = failed.load();
+	current_test->stress = std::make_shared<StressStats>(stats);
+	merge_thread_failures();
+	return current_test->result;
+}
+
+// The checks of the other threads go to their own nodes. The first failure
+// of the thread is kept, the later checks of the thread fail into the
+// discarded report.
+inline QTestBase::ExpectTarget QTestBase::expect_target(std::string_view s, std::string_view macro)
+{
+	AllocationPause pause;
+	if (std::this_thread::get_id() == test_thread) {
+		current_test->expect_str = s;
+		current_test->error = {};
+		current_test->error.macro = macro;
+		return {&(current_test->result), &current_test->error};
+	}
+	static thread_local ErrorReport discarded;
+	ThreadFailure& node = thread_failures.node();
+	if (!node.result) return {&node.result, &discarded};
+	node.expect_str = s;
+	node.error = {};
+	node.error.macro = macro;
+	return {&node.result, &node.error};
+}
+
+// The first failure of the threads becomes the error of the test, unless the
+// test thread failed itself, and the rest are added to its hint.
+inline void QTestBase::merge_thread_failures()
+{
+	std::vector<ThreadFailure*> failures = thread_failures.take();
+	AllocationPause pause;
+	for (auto& f : failures) {
+		if (f->result) continue;
+		std::stringstream thread;
+		thread << f->thread;
+		if (current_test->result) {
+			current_test->result = false;
+			current_test->expect_str = f->expect_str;
+			current_test->error = f->error;
+			current_test->error.hint = "failed in the thread " + thread.str() + (f->error.hint.empty() ? "" : "\n" + f->error.hint);
+		} else {
+			std::string& hint = current_test->error.hint;
+			hint += (hint.empty() ? "" : "\n") + std::string("the thread ") + thread.str() + " failed as well: " + generate_test_error(f->expect_str, f->error);
+		}
+	}
 }
 
 inline std::string QTestBase::generate_describes_text(std::vector<std::shared_ptr<Describe>>& descrs)
@@ -276,6 +852,24 @@ inline std::string QTestBase::generate_describes_text(std::vector<std::shared_pt
 	return res;
 }
 
+template<typename R>
+std::string QTestBase::generate_row_text(std::string_view str, R& row, size_t index)
+{
+	std::string row_str;
+	if constexpr (is_streamable<R>::value) {
+		std::stringstream ss;
+		ss << row;
+		row_str = ss.str();
+	} else {
+		row_str = "#" + std::to_string(index);
+	}
+	size_t pos = str.find("{}");
+	if (pos == std::string_view::npos) {
+		return std::string(str) + " [" + row_str + "]";
+	}
+	return std::string(str.substr(0, pos)) + row_str + std::string(str.substr(pos + 2));
+}
+
 inline bool QTestBase::current_describe_ran()
 {
 	return current_describe().tests_ran > 0;
@@ -301,6 +895,20 @@ inline void QTestBase::test_postcalls()
 	}
 }
 
+inline bool QTestBase::filtered_by_only(int param)
+{
+	return tests_only && param != QTEST_ONLY_PARAM_ID && !in_only_describe();
+}
+
+inline void QTestBase::show_describes()
+{
+	// Print test describes
+	if (describes_changed) {
+		std::string descr = generate_describes_text(describes);
+		P->print_description(descr);
+	}
+}
+
 inline bool QTestBase::in_skip_describe()
 {
 	for (auto &d : describes) {
@@ -317,6 +925,20 @@ inline bool QTestBase::in_only_describe()
 	return false;
 }
 
+// The tests deferred by the failed-first order run at the end of the describe
+// body, while its variables are still alive, and before its AFTER_ALL. So the
+// failed tests only run ahead of their own describe, not of the whole suite.
+inline void QTestBase::run_deferred(Describe& d)
+{
+	std::vector<DeferredTest> tests = std::move(d.deferred);
+	d.deferred.clear();
+	replaying = true;
+	for (auto& t : tests) {
+		it(t.text, t.fn, t.param, t.line);
+	}
+	replaying = false;
+}
+
 inline QTestBase::Describe& QTestBase::current_describe()
 {
 	return *describes.back();
@@ -324,41 +946,76 @@ inline QTestBase::Describe& QTestBase::current_describe()
 
 inline void QTestBase::run_scenarios()
 {
-	for (auto& fn : scenarios) {
-		fn();
+	run_start = std::chrono::steady_clock::now();
+	for (auto& r : reporters) {
+		r->run_start();
+	}
+	running = true;
+	auto run = [this]{
+		for (auto& fn : scenarios) {
+			TraceSpan span("SCENARIO", "scenario");
+			fn();
+		}
+	};
+	bool rerun_failed = failed_first && rerun && rerun->has_failed();
+	if (rerun_failed) {
+		rerun->set_pass(failed_only ? QTestRerunState::Pass::Failed : QTestRerunState::Pass::First);
+	}
+	run();
+	// None of the failed tests is found (they were moved or renamed), so nothing
+	// ran, and the whole suite runs instead. The scenarios are called again, so
+	// the describe bodies and the ADD_REPORTER calls in them run twice, and the
+	// reporters get the describe events of both passes.
+	if (rerun_failed && failed_only && !rerun->has_matched()) {
+		rerun->set_pass(QTestRerunState::Pass::All);
+		run();
 	}
 }
 
 inline void QTestBase::call_before_all(Describe& d)
 {
-	for (auto fn : d.before_alls) {
-		fn();
+	AllocationPause pause;
+	bool record_fixture = impact && !d.before_alls.empty();
+	if (record_fixture) impact->fixture_begin();
+	for (auto& fn : d.before_alls) {
+		call_hook(fn, "BEFORE_ALL");
 	}
+	if (record_fixture) d.impact_fixture = impact->fixture_end();
 	d.before_alls.clear();
 }
 
 inline void QTestBase::call_after_all(Describe& d)
 {
-	for (auto fn : d.after_alls) {
-		fn();
+	AllocationPause pause;
+	for (auto& fn : d.after_alls) {
+		call_hook(fn, "AFTER_ALL");
 	}
 	d.after_alls.clear();
 }
 
 inline void QTestBase::call_before_each(Describe& d)
 {
-	for (auto fn : d.before_eachs) {
-		fn();
+	for (auto& fn : d.before_eachs) {
+		call_hook(fn, "BEFORE_EACH");
 	}
 }
 
 inline void QTestBase::call_after_each(Describe& d)
 {
-	for (auto fn : d.after_eachs) {
-		fn();
+	for (auto& fn : d.after_eachs) {
+		call_hook(fn, "AFTER_EACH");
 	}
 }
 
+// Hook time is summed up for the metrics.
+inline void QTestBase::call_hook(function_cb_t& fn, std::string_view name)
+{
+	TraceSpan span(name, "hook");
+	auto start = std::chrono::steady_clock::now();
+	fn();
+	hooks_duration += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
 inline std::string QTestBase::generate_test_error(std::string_view expect_str, ErrorReport& error)
 {
 	std::string res;
@@ -382,10 +1039,39 @@ inline std::string QTestBase::generate_test_error(std::string_view expect_str, E
 		compare_str = (error.compare_substituted ? error.compare : "...");
 	}
 	std::string not_str = error.inverse ? ".NOT()" : "";
-	res += "EXPECT(" + std::string(expect_str) + value_str + ")" + not_str + "." + std::string(error.func) + "(" + compare_str + ") FAILED!";
+	std::string macro = error.macro.empty() ? "EXPECT" : std::string(error.macro);
+	res += macro + "(" + std::string(expect_str) + value_str + ")" + not_str + "." + std::string(error.func) + "(" + compare_str + ") FAILED!";
 	return res;
 }
 
+inline std::string QTestBase::generate_benchmark_text(BenchmarkStats& stats)
+{
+	std::string res = "mean " + format_duration(stats.mean) + ", median " + format_duration(stats.median)
+		+ ", stddev " + format_duration(stats.stddev) + ", min " + format_duration(stats.min)
+		+ " (" + std::to_string(stats.samples.size()) + " x " + std::to_string(stats.iterations) + " iterations)";
+	double seconds = stats.median / 1e9;
+	if (stats.bytes && seconds > 0) {
+		res += ", " + format_rate(stats.bytes / seconds, "B/s");
+	}
+	if (stats.items && seconds > 0) {
+		res += ", " + format_rate(stats.items / seconds, " items/s");
+	}
+	if (stats.baseline > 0) {
+		char diff[32];
+		std::snprintf(diff, sizeof(diff), "%+.1f%%", (stats.median / stats.baseline - 1) * 100);
+		res += ", baseline " + format_duration(stats.baseline) + " (" + diff + ")";
+	}
+	return res;
+}
+
+inline std::string QTestBase::generate_comparison_text(CompareStats& stats)
+{
+	char buf[128];
+	std::snprintf(buf, sizeof(buf), "speedup %.2fx [%.2fx, %.2fx], p=%.4f", stats.speedup, stats.speedup_low, stats.speedup_high, stats.p_value);
+	return std::string(buf) + ", baseline median " + format_duration(stats.baseline.median)
+		+ ", candidate median " + format_duration(stats.candidate.median);
+}
+
 inline void QTestBase::show_failed_tests()
 {
 	P->print_failure_message();
@@ -409,6 +1095,9 @@ inline void QTestBase::show_start()
 inline void QTestBase::show_statistics()
 {
 	P->print_statistics(tests_count, tests_failed, tests_skipped);
+	if (allocating_tests.size()) {
+		show_top_allocations();
+	}
 	if(tests_failed){
 		show_failed_tests();
 	} else{
@@ -417,6 +1106,18 @@ inline void QTestBase::show_statistics()
 	P->print_delimeter("_");
 }
 
+inline void QTestBase::show_top_allocations()
+{
+	constexpr size_t top = 5;
+	std::vector<AllocatingTest> tests = allocating_tests;
+	std::sort(tests.begin(), tests.end(), [](auto& a, auto& b){ return a.allocations->bytes > b.allocations->bytes; });
+	std::vector<std::string> lines;
+	for (size_t i=0;i<tests.size() && i<top;i++) {
+		lines.push_back(tests[i].text + ": " + generate_allocations_text(*tests[i].allocations));
+	}
+	P->print_top_allocations(lines);
+}
+
 inline void QTestBase::show_test_infos(Test& t)
 {
 	for (auto &s : t.info_prints) {
@@ -425,15 +1126,84 @@ inline void QTestBase::show_test_infos(Test& t)
 	if (!t.result) {
 		std::string error_text = generate_test_error(t.expect_str, t.error);
 		P->print_test_error(error_text);
+		show_test_hint(t.error.hint);
+	}
+}
+
+inline void QTestBase::show_test_hint(std::string& hint)
+{
+	std::stringstream ss(hint);
+	std::string line;
+	while (std::getline(ss, line)) {
+		P->print_test_info(sanitize(line));
 	}
 }
 
 inline void QTestBase::show_test_results(Test& t, bool is_skip)
 {
 	P->print_test(t.text, t.result, is_skip);
+	if (t.benchmark && t.result) {
+		P->print_benchmark(generate_benchmark_text(*t.benchmark));
+	}
+	if (t.comparison && t.result) {
+		P->print_benchmark(generate_comparison_text(*t.comparison));
+	}
+	if (t.perf_counters) {
+		P->print_test_stats(generate_perf_counters_text(*t.perf_counters));
+	}
+	if (t.allocations && t.allocations->count) {
+		P->print_test_stats(generate_allocations_text(*t.allocations));
+	}
+	if (t.resources && t.resources->available) {
+		P->print_test_stats(generate_resource_usage_text(*t.resources));
+	}
+	if (t.locks) {
+		for (auto& line : generate_lock_contention_lines(*t.locks)) {
+			P->print_test_stats(line);
+		}
+	}
+	if (t.stress) {
+		P->print_test_stats(generate_stress_text(*t.stress));
+	}
+	if (t.profile_samples) {
+		P->print_test_stats("profile samples " + std::to_string(t.profile_samples));
+	}
+	if (t.replayed) {
+		P->print_test_stats("result from the journal");
+	}
 	show_test_infos(t);
 }
 
+// Called before the print, which shortens the error values.
+inline void QTestBase::report_test_results(Test& t, bool is_skip)
+{
+	if (reporters.empty()) return;
+	std::string suite = generate_describes_text(describes);
+	if (!suite.empty()) suite.pop_back();
+	TestResult result;
+	result.suite = suite;
+	result.name = t.text;
+	result.file = describes.empty() ? "" : describes[0]->file;
+	result.line = t.line;
+	result.passed = t.result;
+	result.skipped = is_skip;
+	result.duration = t.duration;
+	result.benchmark = t.benchmark.get();
+	result.resources = t.resources.get();
+	result.allocations = t.allocations.get();
+	std::string message;
+	if (!t.result) {
+		ErrorReport error = t.error;
+		message = generate_test_error(t.expect_str, error);
+		result.expect = t.expect_str;
+		result.error = &t.error;
+		result.message = message;
+	}
+	for (auto& r : reporters) {
+		r->test_result(result);
+	}
+}
+
 inline void QTestBase::show_failed_test_results(Test& t, std::string_view file)
 {
 	P->print_failed_test(t.text, file, t.line);
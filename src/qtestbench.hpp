@@ -0,0 +1,399 @@
+#ifndef QTESTBENCH_H
+#define QTESTBENCH_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <numeric>
+#include <functional>
+#include <map>
+#include <fstream>
+#include <sstream>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifndef TEST_BENCHMARK_MIN_TIME_MS
+#define TEST_BENCHMARK_MIN_TIME_MS 10
+#endif
+
+#ifndef TEST_BENCHMARK_WARMUP_MS
+#define TEST_BENCHMARK_WARMUP_MS 10
+#endif
+
+#ifndef TEST_BENCHMARK_SAMPLES
+#define TEST_BENCHMARK_SAMPLES 10
+#endif
+
+#ifndef TEST_BENCHMARK_TOLERANCE
+#define TEST_BENCHMARK_TOLERANCE 0.1
+#endif
+
+#ifndef TEST_BENCHMARK_ALPHA
+#define TEST_BENCHMARK_ALPHA 0.05
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+template<typename T>
+inline void do_not_optimize(T& value)
+{
+	#ifdef _MSC_VER
+	const volatile void* ptr = &value;
+	(void)ptr;
+	_ReadWriteBarrier();
+	#else
+	asm volatile("" : : "r,m"(value) : "memory");
+	#endif
+}
+
+template<typename T>
+inline void do_not_optimize(const T& value)
+{
+	#ifdef _MSC_VER
+	const volatile void* ptr = &value;
+	(void)ptr;
+	_ReadWriteBarrier();
+	#else
+	asm volatile("" : : "r,m"(value) : "memory");
+	#endif
+}
+
+inline void clobber_memory()
+{
+	#ifdef _MSC_VER
+	_ReadWriteBarrier();
+	#else
+	asm volatile("" : : : "memory");
+	#endif
+}
+
+// All of the times are nanoseconds per one iteration.
+struct BenchmarkStats {
+	double mean = 0;
+	double median = 0;
+	double stddev = 0;
+	double min = 0;
+	uint64_t iterations = 0;
+	std::vector<double> samples = {};
+	uint64_t bytes = 0;
+	uint64_t items = 0;
+	double baseline = 0;
+};
+
+// Speedup is the baseline time divided by the candidate time, with the 95% confidence interval.
+struct CompareStats {
+	BenchmarkStats baseline = {};
+	BenchmarkStats candidate = {};
+	double speedup = 0;
+	double speedup_low = 0;
+	double speedup_high = 0;
+	double p_value = 1;
+};
+
+struct BaselineEntry {
+	double median = 0;
+	double stddev = 0;
+	size_t samples = 0;
+};
+
+// Benchmark results of the previous runs, keyed by describe path and benchmark name.
+// Stored as the text file with one `median stddev samples key` line per benchmark.
+class QTestBaseline
+{
+	public:
+		QTestBaseline(std::string path);
+		BaselineEntry* find(const std::string& key);
+		void record(const std::string& key, BenchmarkStats& stats);
+		bool is_regression(BaselineEntry& entry, BenchmarkStats& stats);
+		void save();
+
+	private:
+		std::string path;
+		std::map<std::string, BaselineEntry> entries;
+		bool writable = false;
+		bool changed = false;
+};
+
+class QTestBenchmark
+{
+	using clock = std::chrono::steady_clock;
+
+	public:
+		QTestBenchmark(std::function<bool()> should_stop) : should_stop(should_stop) {}
+		template<typename F> BenchmarkStats run(F&& fn);
+		template<typename F, typename G> CompareStats compare(F& baseline, G& candidate);
+		template<typename F> double run_batch(F& fn, uint64_t iterations);
+		template<typename F> uint64_t calibrate(F& fn);
+
+		static BenchmarkStats calculate_stats(std::vector<double> samples);
+		static CompareStats calculate_comparison(std::vector<double> baseline, std::vector<double> candidate);
+
+	private:
+		std::function<bool()> should_stop;
+};
+
+template<typename F>
+BenchmarkStats QTestBenchmark::run(F&& fn)
+{
+	BenchmarkStats stats;
+	uint64_t iterations = calibrate(fn);
+	if (should_stop()) return stats;
+
+	std::vector<double> samples;
+	samples.reserve(TEST_BENCHMARK_SAMPLES);
+	for (int i=0;i<TEST_BENCHMARK_SAMPLES && !should_stop();i++) {
+		samples.push_back(run_batch(fn, iterations) / iterations);
+	}
+	stats = calculate_stats(std::move(samples));
+	stats.iterations = iterations;
+	return stats;
+}
+
+// Samples of both functions are interleaved, and the order inside of the pair
+// alternates, so the frequency scaling and other drifts affect both equally.
+template<typename F, typename G>
+CompareStats QTestBenchmark::compare(F& baseline, G& candidate)
+{
+	uint64_t baseline_iterations = calibrate(baseline);
+	uint64_t candidate_iterations = calibrate(candidate);
+	if (should_stop()) return {};
+
+	std::vector<double> baseline_samples, candidate_samples;
+	baseline_samples.reserve(TEST_BENCHMARK_SAMPLES);
+	candidate_samples.reserve(TEST_BENCHMARK_SAMPLES);
+	for (int i=0;i<TEST_BENCHMARK_SAMPLES && !should_stop();i++) {
+		if (i % 2) {
+			candidate_samples.push_back(run_batch(candidate, candidate_iterations) / candidate_iterations);
+			baseline_samples.push_back(run_batch(baseline, baseline_iterations) / baseline_iterations);
+		} else {
+			baseline_samples.push_back(run_batch(baseline, baseline_iterations) / baseline_iterations);
+			candidate_samples.push_back(run_batch(candidate, candidate_iterations) / candidate_iterations);
+		}
+	}
+	CompareStats stats = calculate_comparison(std::move(baseline_samples), std::move(candidate_samples));
+	stats.baseline.iterations = baseline_iterations;
+	stats.candidate.iterations = candidate_iterations;
+	return stats;
+}
+
+template<typename F>
+double QTestBenchmark::run_batch(F& fn, uint64_t iterations)
+{
+	auto start = clock::now();
+	for (uint64_t i=0;i<iterations;i++) {
+		fn();
+	}
+	auto end = clock::now();
+	return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// Warms the code up and finds the iterations count that makes one sample
+// take at least TEST_BENCHMARK_MIN_TIME_MS.
+template<typename F>
+uint64_t QTestBenchmark::calibrate(F& fn)
+{
+	constexpr double warmup_ns = TEST_BENCHMARK_WARMUP_MS * 1e6;
+	constexpr double min_time_ns = TEST_BENCHMARK_MIN_TIME_MS * 1e6;
+
+	double warmed = 0;
+	uint64_t iterations = 1;
+	while (warmed < warmup_ns && !should_stop()) {
+		double took = run_batch(fn, iterations);
+		warmed += took;
+		if (took >= min_time_ns) break;
+		iterations *= 2;
+	}
+
+	while (!should_stop()) {
+		double took = run_batch(fn, iterations);
+		if (took >= min_time_ns) break;
+		// Grow towards the target time, but not more than 10x at once.
+		double factor = took > 0 ? std::min(10.0, 1.2 * min_time_ns / took) : 10.0;
+		iterations = std::max(iterations + 1, (uint64_t)(iterations * factor));
+	}
+	return iterations;
+}
+
+inline BenchmarkStats QTestBenchmark::calculate_stats(std::vector<double> samples)
+{
+	BenchmarkStats stats;
+	if (samples.empty()) return stats;
+
+	size_t n = samples.size();
+	stats.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / n;
+	double sq = 0;
+	for (double s : samples) {
+		sq += (s - stats.mean) * (s - stats.mean);
+	}
+	stats.stddev = n > 1 ? std::sqrt(sq / (n - 1)) : 0;
+
+	std::vector<double> sorted = samples;
+	std::sort(sorted.begin(), sorted.end());
+	stats.min = sorted.front();
+	stats.median = n % 2 ? sorted[n/2] : (sorted[n/2 - 1] + sorted[n/2]) / 2;
+	stats.samples = std::move(samples);
+	return stats;
+}
+
+// Two-sided p-value of the Mann-Whitney U test (normal approximation with the
+// ties correction), so no assumptions about the timings distribution are made.
+inline double mann_whitney_p(const std::vector<double>& a, const std::vector<double>& b)
+{
+	size_t n1 = a.size(), n2 = b.size(), n = n1 + n2;
+	if (!n1 || !n2) return 1;
+	std::vector<std::pair<double, bool>> all;
+	all.reserve(n);
+	for (double v : a) all.push_back({v, true});
+	for (double v : b) all.push_back({v, false});
+	std::sort(all.begin(), all.end());
+
+	double rank_sum = 0, ties = 0;
+	for (size_t i=0;i<n;) {
+		size_t j = i;
+		while (j < n && all[j].first == all[i].first) j++;
+		double rank = (i + j + 1) / 2.0;
+		for (size_t k=i;k<j;k++) {
+			if (all[k].second) rank_sum += rank;
+		}
+		double t = j - i;
+		ties += t * t * t - t;
+		i = j;
+	}
+	double u = rank_sum - n1 * (n1 + 1) / 2.0;
+	double mu = n1 * n2 / 2.0;
+	double sigma = std::sqrt(n1 * n2 / 12.0 * ((n + 1) - ties / (n * (n - 1.0))));
+	if (sigma == 0) return 1;
+	double z = std::max(0.0, std::abs(u - mu) - 0.5) / sigma;
+	return std::erfc(z / std::sqrt(2.0));
+}
+
+inline CompareStats QTestBenchmark::calculate_comparison(std::vector<double> baseline, std::vector<double> candidate)
+{
+	CompareStats stats;
+	stats.p_value = mann_whitney_p(baseline, candidate);
+
+	// Hodges-Lehmann estimate of the log ratio: median of all pairwise differences,
+	// the confidence interval bounds are taken from the same sorted differences.
+	std::vector<double> diffs;
+	for (double b : baseline) {
+		for (double c : candidate) {
+			if (b > 0 && c > 0) diffs.push_back(std::log(b) - std::log(c));
+		}
+	}
+	if (!diffs.empty()) {
+		std::sort(diffs.begin(), diffs.end());
+		size_t m = diffs.size();
+		double n1 = baseline.size(), n2 = candidate.size();
+		double k = m / 2.0 - 1.96 * std::sqrt(n1 * n2 * (n1 + n2 + 1) / 12.0);
+		size_t low = k > 0 ? (size_t)k : 0;
+		double median = m % 2 ? diffs[m/2] : (diffs[m/2 - 1] + diffs[m/2]) / 2;
+		stats.speedup = std::exp(median);
+		stats.speedup_low = std::exp(diffs[low]);
+		stats.speedup_high = std::exp(diffs[m - 1 - low]);
+	}
+	stats.baseline = calculate_stats(std::move(baseline));
+	stats.candidate = calculate_stats(std::move(candidate));
+	return stats;
+}
+
+inline QTestBaseline::QTestBaseline(std::string path) : path(path)
+{
+	std::ifstream in(path);
+	std::string line;
+	while (std::getline(in, line)) {
+		std::stringstream ss(line);
+		BaselineEntry entry;
+		std::string key;
+		if (!(ss >> entry.median >> entry.stddev >> entry.samples)) continue;
+		ss.get();
+		std::getline(ss, key);
+		entries[key] = entry;
+	}
+	// The missing file is created by the first run, the existing one is only
+	// written in the TEST_BENCHMARK_BASELINE_UPDATE mode.
+	writable = !in.is_open();
+	#ifdef TEST_BENCHMARK_BASELINE_UPDATE
+	writable = true;
+	#endif
+}
+
+inline BaselineEntry* QTestBaseline::find(const std::string& key)
+{
+	auto it = entries.find(key);
+	return it == entries.end() ? nullptr : &it->second;
+}
+
+inline void QTestBaseline::record(const std::string& key, BenchmarkStats& stats)
+{
+	if (!writable) return;
+	entries[key] = {stats.median, stats.stddev, stats.samples.size()};
+	changed = true;
+}
+
+// The candidate regressed if it is slower than the tolerance allows, and the
+// difference is not explained by the noise: it is larger than three standard
+// errors of the difference between the two measurements.
+inline bool QTestBaseline::is_regression(BaselineEntry& entry, BenchmarkStats& stats)
+{
+	if (stats.median <= entry.median * (1 + TEST_BENCHMARK_TOLERANCE)) return false;
+	double n_base = std::max<size_t>(entry.samples, 1);
+	double n_cur = std::max<size_t>(stats.samples.size(), 1);
+	double noise = std::sqrt(entry.stddev * entry.stddev / n_base + stats.stddev * stats.stddev / n_cur);
+	return stats.median - entry.median > 3 * noise;
+}
+
+inline void QTestBaseline::save()
+{
+	if (!changed) return;
+	std::ofstream out(path, std::ios::trunc);
+	out.precision(17);
+	for (auto& [key, entry] : entries) {
+		out << entry.median << ' ' << entry.stddev << ' ' << entry.samples << ' ' << key << '\n';
+	}
+}
+
+inline std::string format_number(double value, const char* unit)
+{
+	char buf[64];
+	std::snprintf(buf, sizeof(buf), "%.2f %s", value, unit);
+	return buf;
+}
+
+// The fraction as the percent, 0.29 is "29%" and 0.125 is "12.5%".
+inline std::string format_percent(double fraction)
+{
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%g%%", fraction * 100);
+	return buf;
+}
+
+inline std::string format_duration(double ns)
+{
+	if (ns < 1e3) return format_number(ns, "ns");
+	if (ns < 1e6) return format_number(ns / 1e3, "us");
+	if (ns < 1e9) return format_number(ns / 1e6, "ms");
+	return format_number(ns / 1e9, "s");
+}
+
+inline std::string format_rate(double per_second, const char* unit)
+{
+	const char* prefixes[] = {"", "k", "M", "G", "T"};
+	int i = 0;
+	while (per_second >= 1000 && i < 4) {
+		per_second /= 1000;
+		i++;
+	}
+	std::string full_unit = std::string(prefixes[i]) + unit;
+	if (full_unit[0] == ' ') full_unit.erase(0, 1);
+	return format_number(per_second, full_unit.c_str());
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTBENCH_H
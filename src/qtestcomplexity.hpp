@@ -0,0 +1,169 @@
+#ifndef QTESTCOMPLEXITY_H
+#define QTESTCOMPLEXITY_H
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <algorithm>
+
+#include "qtestbench.hpp"
+
+#ifndef TEST_COMPLEXITY_BUDGET_MS
+#define TEST_COMPLEXITY_BUDGET_MS 500
+#endif
+
+#ifndef TEST_COMPLEXITY_MIN_N
+#define TEST_COMPLEXITY_MIN_N 256
+#endif
+
+#ifndef TEST_COMPLEXITY_MAX_N
+#define TEST_COMPLEXITY_MAX_N (1 << 20)
+#endif
+
+#ifndef TEST_COMPLEXITY_MIN_POINTS
+#define TEST_COMPLEXITY_MIN_POINTS 4
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+enum class Complexity { O1, LogN, N, NLogN, N2 };
+
+struct ComplexityPoint {
+	double n = 0;
+	double ns = 0;
+};
+
+struct ComplexityFit {
+	Complexity best = Complexity::O1;
+	std::vector<ComplexityPoint> points = {};
+	double coefficients[5] = {};
+	double rms[5] = {};
+};
+
+inline const char* complexity_name(Complexity c)
+{
+	switch (c) {
+		case Complexity::O1: return "O(1)";
+		case Complexity::LogN: return "O(log n)";
+		case Complexity::N: return "O(n)";
+		case Complexity::NLogN: return "O(n log n)";
+		case Complexity::N2: return "O(n^2)";
+	}
+	return "";
+}
+
+inline double complexity_curve(Complexity c, double n)
+{
+	switch (c) {
+		case Complexity::O1: return 1;
+		case Complexity::LogN: return std::log2(n);
+		case Complexity::N: return n;
+		case Complexity::NLogN: return n * std::log2(n);
+		case Complexity::N2: return n * n;
+	}
+	return 1;
+}
+
+// Fits t = a * f(n) for every class with the least squares on the relative
+// errors, so the small sizes weigh as much as the big ones, and picks the
+// class with the minimal normalized RMS.
+inline ComplexityFit fit_complexity(std::vector<ComplexityPoint> points)
+{
+	ComplexityFit fit;
+	double best_rms = std::numeric_limits<double>::max();
+	for (int i=0;i<5;i++) {
+		Complexity c = (Complexity)i;
+		// Minimizes sum((1 - a * f / t)^2)
+		double num = 0, den = 0;
+		for (auto& p : points) {
+			double x = complexity_curve(c, p.n) / p.ns;
+			num += x;
+			den += x * x;
+		}
+		double a = den > 0 ? num / den : 0;
+		double sq = 0;
+		for (auto& p : points) {
+			double r = 1 - a * complexity_curve(c, p.n) / p.ns;
+			sq += r * r;
+		}
+		fit.coefficients[i] = a;
+		fit.rms[i] = points.empty() ? 0 : std::sqrt(sq / points.size());
+		if (fit.rms[i] < best_rms) {
+			best_rms = fit.rms[i];
+			fit.best = c;
+		}
+	}
+	fit.points = std::move(points);
+	return fit;
+}
+
+// Sizes grow twice per step while the next step (assuming up to the quadratic
+// growth) fits into the TEST_COMPLEXITY_BUDGET_MS. Every size is timed three
+// times, and the fastest time is used.
+template<typename F>
+ComplexityFit measure_complexity(F& fn)
+{
+	using clock = std::chrono::steady_clock;
+	constexpr double budget_ns = TEST_COMPLEXITY_BUDGET_MS * 1e6;
+	constexpr double min_time_ns = 1e5;
+
+	std::vector<ComplexityPoint> points;
+	double spent = 0;
+	for (size_t n = TEST_COMPLEXITY_MIN_N; n <= (size_t)TEST_COMPLEXITY_MAX_N; n *= 2) {
+		double best = std::numeric_limits<double>::max();
+		double step = 0;
+		for (int rep=0;rep<3;rep++) {
+			uint64_t calls = 0;
+			double took = 0;
+			auto start = clock::now();
+			do {
+				fn(n);
+				calls++;
+				took = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+			} while (took < min_time_ns);
+			best = std::min(best, took / calls);
+			step += took;
+		}
+		points.push_back({(double)n, best});
+		spent += step;
+		if (spent + step * 4 > budget_ns) break;
+	}
+	return fit_complexity(std::move(points));
+}
+
+inline std::string generate_complexity_hint(ComplexityFit& fit, Complexity expected)
+{
+	char buf[128];
+	std::string res;
+	for (int i=0;i<5;i++) {
+		std::snprintf(buf, sizeof(buf), "%s%s rms %.1f%%", i ? ", " : "fit: ", complexity_name((Complexity)i), fit.rms[i] * 100);
+		res += buf;
+	}
+	int e = (int)expected;
+	for (auto& p : fit.points) {
+		double predicted = fit.coefficients[e] * complexity_curve(expected, p.n);
+		std::snprintf(buf, sizeof(buf), "\nn=%.0f: ", p.n);
+		res += buf + format_duration(p.ns) + ", " + complexity_name(expected) + " predicts " + format_duration(predicted);
+		if (predicted > 0) {
+			std::snprintf(buf, sizeof(buf), " (%+.1f%%)", (p.ns / predicted - 1) * 100);
+			res += buf;
+		}
+	}
+	return res;
+}
+
+} // Q_TEST_NS_DETAIL
+
+namespace QTest {
+	using Complexity = Q_TEST_NS_DETAIL::Complexity;
+	constexpr Complexity O1 = Complexity::O1;
+	constexpr Complexity LogN = Complexity::LogN;
+	constexpr Complexity N = Complexity::N;
+	constexpr Complexity NLogN = Complexity::NLogN;
+	constexpr Complexity N2 = Complexity::N2;
+}
+
+#endif // QTESTCOMPLEXITY_H
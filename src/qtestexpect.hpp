@@ -8,12 +8,19 @@
 #include <type_traits>
 #include <iomanip>
 
+#include "qtestmatch.hpp"
+#include "qtestsnapshot.hpp"
+#include "qtestcomplexity.hpp"
+#include "qtestalloc.hpp"
+
 namespace Q_TEST_NS_DETAIL {
 
 struct ErrorReport {
 	std::string value = {};
 	std::string compare = {};
+	std::string hint = {};
 	std::string_view func = {};
+	std::string_view macro = {};
 	bool inverse = false;
 	bool has_compare = false;
 	bool value_substituted = false;
@@ -33,6 +40,14 @@ struct is_streamable<T, std::enable_if_t<
 	>
 >> : std::true_type {};
 
+// The message of TEST_FAILED is a part of the report, not of the test memory.
+template<typename... A>
+std::string failure_message(A&&... a)
+{
+	AllocationPause pause;
+	return std::string{std::forward<A>(a)...};
+}
+
 template<typename T>
 class QTestExpect
 {
@@ -57,6 +72,12 @@ class QTestExpect
 		template<typename E> bool toThrowError();
 		bool toReturnTrue();
 		template<typename V> bool toReturn(V&& compare);
+		template<typename C> bool toContain(C&& compare);
+		bool toStartWith(std::string_view compare);
+		bool toEndWith(std::string_view compare);
+		bool toMatch(std::string_view pattern);
+		bool toMatchSnapshot(const std::string& path);
+		bool toScaleAs(Complexity complexity);
 		QTestExpect<T> NOT();
 		bool fail();
 
@@ -77,12 +98,19 @@ class QTestExpect
 		template<typename E> bool to_throw_error(){ return toThrowError<E>(); }
 		bool to_return_true(){ return toReturnTrue(); }
 		template<typename V> bool to_return(V&& compare) { return toReturn(compare); }
+		template<typename C> bool to_contain(C&& compare) { return toContain(std::forward<C>(compare)); }
+		bool to_start_with(std::string_view compare) { return toStartWith(compare); }
+		bool to_end_with(std::string_view compare) { return toEndWith(compare); }
+		bool to_match(std::string_view pattern) { return toMatch(pattern); }
+		bool to_match_snapshot(const std::string& path) { return toMatchSnapshot(path); }
+		bool to_scale_as(Complexity complexity) { return toScaleAs(complexity); }
 
 	private:
 		bool proceed_result(bool result);
 		void report_error_resolved(std::string_view func, std::string_view value, std::string_view compare);
 		template<typename V, typename C> void report_error(std::string_view func, V&& value, C&& compare);
 		template<typename V> void report_error(std::string_view func, V&& value);
+		void report_string_error(std::string_view func, std::string_view value, std::string_view compare, std::string hint);
 		template<typename CT> std::string iterable_to_str(CT&& value);
 		template<typename CT> std::string streamable_to_str(CT&& value);
 
@@ -125,6 +153,7 @@ bool QTestExpect<T>::toBeCloseTo(T compare, T precision)
 {
 	T v = val;
 	if (!(*result &= proceed_result(std::abs(v-compare) <= std::abs(precision)))) {
+		AllocationPause pause;
 		report_error_resolved(__func__, streamable_to_str(val), streamable_to_str(compare) + ", " + streamable_to_str(precision));
 	}
 	return *result;
@@ -264,6 +293,137 @@ bool QTestExpect<T>::toReturn(V&& compare)
 	return *result;
 }
 
+template<typename T>
+template<typename C>
+bool QTestExpect<T>::toContain(C&& compare)
+{
+	if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+		std::string_view haystack = val;
+		std::string_view needle = compare;
+		size_t pos = find_substring(haystack, needle);
+		if (!(*result &= proceed_result(pos != std::string_view::npos))) {
+			AllocationPause pause;
+			std::string hint;
+			if (pos != std::string_view::npos) {
+				hint = "found at offset " + std::to_string(pos) + ": " + excerpt_region(haystack, pos, needle.size());
+			} else {
+				auto [near_pos, near_len] = find_nearest_match(haystack, needle);
+				if (near_len) {
+					hint = "nearest match (" + std::to_string(near_len) + " of " + std::to_string(needle.size()) + " chars) at offset "
+						+ std::to_string(near_pos) + ": " + excerpt_region(haystack, near_pos, near_len);
+				} else {
+					hint = "no partial match in " + std::to_string(haystack.size()) + " chars";
+				}
+			}
+			report_string_error(__func__, haystack, needle, std::move(hint));
+		}
+	} else {
+		bool found = std::find(std::begin(val), std::end(val), compare) != std::end(val);
+		if (!(*result &= proceed_result(found))) {
+			report_error(__func__, val, compare);
+		}
+	}
+	return *result;
+}
+
+template<typename T>
+bool QTestExpect<T>::toStartWith(std::string_view compare)
+{
+	std::string_view str = val;
+	if (!(*result &= proceed_result(str.substr(0, compare.size()) == compare))) {
+		AllocationPause pause;
+		auto diff = std::mismatch(compare.begin(), compare.end(), str.begin(), str.end());
+		size_t pos = diff.first - compare.begin();
+		report_string_error(__func__, str, compare, "differs at offset " + std::to_string(pos) + ": " + excerpt_region(str, pos, 1));
+	}
+	return *result;
+}
+
+template<typename T>
+bool QTestExpect<T>::toEndWith(std::string_view compare)
+{
+	std::string_view str = val;
+	bool res = str.size() >= compare.size() && str.substr(str.size() - compare.size()) == compare;
+	if (!(*result &= proceed_result(res))) {
+		AllocationPause pause;
+		auto diff = std::mismatch(compare.rbegin(), compare.rend(), str.rbegin(), str.rend());
+		size_t pos = str.size() - std::min(str.size(), (size_t)(diff.second - str.rbegin()) + 1);
+		report_string_error(__func__, str, compare, "differs at offset " + std::to_string(pos) + ": " + excerpt_region(str, pos, 1));
+	}
+	return *result;
+}
+
+template<typename T>
+bool QTestExpect<T>::toMatch(std::string_view pattern)
+{
+	std::string_view str = val;
+	std::cmatch match;
+	bool res;
+	try {
+		res = std::regex_search(str.data(), str.data() + str.size(), match, cached_regex(pattern));
+	} catch (std::regex_error& e) {
+		AllocationPause pause;
+		*result = false;
+		report_string_error(__func__, str, pattern, std::string("invalid pattern: ") + e.what());
+		return *result;
+	}
+	if (!(*result &= proceed_result(res))) {
+		AllocationPause pause;
+		std::string hint = "no match in " + std::to_string(str.size()) + " chars";
+		if (res) {
+			hint = "matched at offset " + std::to_string(match.position(0)) + ": " + excerpt_region(str, match.position(0), match.length(0));
+		}
+		report_string_error(__func__, str, pattern, std::move(hint));
+	}
+	return *result;
+}
+
+template<typename T>
+bool QTestExpect<T>::toMatchSnapshot(const std::string& path)
+{
+	AllocationPause pause;
+	std::string_view str = val;
+	SnapshotResult snapshot = compare_snapshot(str, path);
+	#ifdef TEST_SNAPSHOT_UPDATE
+	if (!snapshot.equal && !inv) {
+		snapshot.equal = write_snapshot(str, path);
+		snapshot.hint = "snapshot " + path + " can't be written";
+	}
+	#else
+	if (!snapshot.exists) {
+		snapshot.hint += ", define TEST_SNAPSHOT_UPDATE to write it";
+	}
+	#endif
+	if (!(*result &= proceed_result(snapshot.equal))) {
+		report_string_error(__func__, str, path, std::move(snapshot.hint));
+	}
+	return *result;
+}
+
+// Neighbour classes are hard to tell apart on the noisy timings, so the
+// expected class passes if it fits almost as well as the best one. Every class
+// fits the few points, so the check fails with the fewer than
+// TEST_COMPLEXITY_MIN_POINTS sizes measured, even with NOT.
+template<typename T>
+bool QTestExpect<T>::toScaleAs(Complexity complexity)
+{
+	AllocationPause pause;
+	ComplexityFit fit = measure_complexity(val);
+	if (fit.points.size() < TEST_COMPLEXITY_MIN_POINTS) {
+		*result = false;
+		report_error_resolved(__func__, "not enough points", complexity_name(complexity));
+		error->hint = "not enough points: " + std::to_string(fit.points.size()) + " sizes measured within TEST_COMPLEXITY_BUDGET_MS, "
+			+ std::to_string(TEST_COMPLEXITY_MIN_POINTS) + " needed";
+		return *result;
+	}
+	bool scales = fit.best == complexity || fit.rms[(int)complexity] <= fit.rms[(int)fit.best] + 0.05;
+	if (!(*result &= proceed_result(scales))) {
+		report_error_resolved(__func__, complexity_name(fit.best), complexity_name(complexity));
+		error->hint = generate_complexity_hint(fit, complexity);
+	}
+	return *result;
+}
+
 template<typename T>
 bool QTestExpect<T>::fail()
 {
@@ -293,6 +453,7 @@ bool QTestExpect<T>::proceed_result(bool result)
 template<typename T>
 void QTestExpect<T>::report_error_resolved(std::string_view func, std::string_view value, std::string_view compare)
 {
+	AllocationPause pause;
 	error->func = func;
 	error->inverse = inv;
 	error->has_compare = true;
@@ -302,10 +463,20 @@ void QTestExpect<T>::report_error_resolved(std::string_view func, std::string_vi
 	error->compare = compare;
 }
 
+template<typename T>
+void QTestExpect<T>::report_string_error(std::string_view func, std::string_view value, std::string_view compare, std::string hint)
+{
+	AllocationPause pause;
+	// Only the head of the value is shown, so don't copy the whole string.
+	report_error_resolved(func, streamable_to_str(value.substr(0, 32)), streamable_to_str(compare));
+	error->hint = std::move(hint);
+}
+
 template<typename T>
 template<typename V, typename C>
 void QTestExpect<T>::report_error(std::string_view func, V&& value, C&& compare)
 {
+	AllocationPause pause;
 	error->func = func;
 	error->inverse = inv;
 	error->has_compare = true;
@@ -323,6 +494,7 @@ template<typename T>
 template<typename V>
 void QTestExpect<T>::report_error(std::string_view func, V&& value)
 {
+	AllocationPause pause;
 	error->func = func;
 	error->inverse = inv;
 	if constexpr (is_streamable<V>::value) {
@@ -335,6 +507,7 @@ template<typename T>
 template<typename CT>
 std::string QTestExpect<T>::iterable_to_str(CT&& value)
 {
+	AllocationPause pause;
 	std::stringstream ss;
 	std::string value_str = "{";
 	for (auto &v : value) {
@@ -354,6 +527,7 @@ template<typename T>
 template<typename CT>
 std::string QTestExpect<T>::streamable_to_str(CT&& value)
 {
+	AllocationPause pause;
 	std::stringstream ss;
 	ss << value;
 	if constexpr (std::is_convertible_v<CT, std::string_view>) {
@@ -0,0 +1,308 @@
+#ifndef QTESTIMPACT_H
+#define QTESTIMPACT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <set>
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+
+#include "qtestalloc.hpp"
+
+#if defined(__GNUC__) && defined(__linux__) && defined(__GLIBC__)
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define Q_TEST__HAS_IMPACT
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+// Functions entered while the test runs, filled by the -finstrument-functions
+// hook. The hook may run in any thread and must not call any instrumented
+// function, so the set is the lock-free open addressing table updated with
+// the compiler builtins only.
+inline constexpr size_t impact_slots_count = 1 << 16;
+inline void* impact_slots[impact_slots_count] = {};
+inline int impact_active = 0;
+// Set if the function didn't fit into the table, the test is never deselected then.
+inline int impact_overflow = 0;
+
+#ifdef Q_TEST__HAS_IMPACT
+__attribute__((no_instrument_function))
+inline void impact_record(void* fn)
+{
+	if (!__atomic_load_n(&impact_active, __ATOMIC_RELAXED)) return;
+	size_t i = ((uintptr_t)fn >> 4) * 0x9E3779B97F4A7C15ull >> 48;
+	for (size_t probe=0;probe<64;probe++, i=(i + 1) & (impact_slots_count - 1)) {
+		void* slot = __atomic_load_n(&impact_slots[i], __ATOMIC_RELAXED);
+		if (slot == fn) return;
+		void* empty = nullptr;
+		if (!slot && __atomic_compare_exchange_n(&impact_slots[i], &empty, fn, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) return;
+		if (empty == fn) return;
+	}
+	__atomic_store_n(&impact_overflow, 1, __ATOMIC_RELAXED);
+}
+#endif
+
+struct ImpactLocation {
+	std::string file;
+	std::string function;
+};
+
+// The functions entered by the BEFORE_ALL of a describe. It runs once, in the
+// first test of the describe, so they are added to every test of it.
+struct ImpactFixture {
+	std::vector<void*> fns;
+	bool overflow = false;
+};
+
+// The map of every test to the source files and functions it ran, stored as
+// text: the "test <id>" line followed by the "<file>\t<function>" lines. Tests
+// with nothing recorded are not stored, so they always run.
+class QTestImpactMap
+{
+	public:
+		QTestImpactMap(std::string path);
+
+		void select(std::string changed_path);
+		bool filtered(const std::string& id);
+		void begin();
+		void fixture_begin();
+		ImpactFixture fixture_end();
+		void add(const ImpactFixture& fixture);
+		void end(const std::string& id);
+		void save();
+
+	private:
+		bool is_impacted(const std::vector<ImpactLocation>& locations);
+		bool drain(std::vector<void*>& fns);
+		std::map<void*, ImpactLocation> symbolize();
+
+		std::string path;
+		std::map<std::string, std::vector<ImpactLocation>> previous;
+		std::map<std::string, std::vector<void*>> recorded;
+		std::vector<std::string> changed;
+		std::vector<void*> collected;
+		bool overflowed = false;
+		bool selecting = false;
+};
+
+inline QTestImpactMap* impact = nullptr;
+
+inline QTestImpactMap::QTestImpactMap(std::string path) : path(path)
+{
+	std::ifstream in(path);
+	std::string line;
+	std::vector<ImpactLocation>* test = nullptr;
+	while (std::getline(in, line)) {
+		if (line.rfind("test ", 0) == 0) {
+			test = &previous[line.substr(5)];
+		} else if (test && !line.empty()) {
+			size_t tab = line.find('\t');
+			test->push_back({line.substr(0, tab), tab == std::string::npos ? "" : line.substr(tab + 1)});
+		}
+	}
+}
+
+// The changed files are listed one per line, as `git diff --name-only` does,
+// relative to any directory of the recorded paths.
+inline void QTestImpactMap::select(std::string changed_path)
+{
+	std::ifstream in(changed_path);
+	std::string line;
+	while (std::getline(in, line)) {
+		if (!line.empty()) changed.push_back(line);
+	}
+	selecting = true;
+}
+
+inline bool QTestImpactMap::is_impacted(const std::vector<ImpactLocation>& locations)
+{
+	for (auto& l : locations) {
+		for (auto& c : changed) {
+			if (l.file == c || (l.file.size() > c.size() && l.file.compare(l.file.size() - c.size(), c.size(), c) == 0 && l.file[l.file.size() - c.size() - 1] == '/')) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+// The tests that are not in the map are new, so they always run.
+inline bool QTestImpactMap::filtered(const std::string& id)
+{
+	if (!selecting) return false;
+	auto it = previous.find(id);
+	return it != previous.end() && !is_impacted(it->second);
+}
+
+inline void QTestImpactMap::begin()
+{
+	collected.clear();
+	overflowed = false;
+	#ifdef Q_TEST__HAS_IMPACT
+	__atomic_store_n(&impact_overflow, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&impact_active, 1, __ATOMIC_RELAXED);
+	#endif
+}
+
+// Moves the functions out of the table, true if any of them didn't fit. The
+// hooks of the other threads may still run, so every slot is swapped.
+inline bool QTestImpactMap::drain(std::vector<void*>& fns)
+{
+	bool overflow = false;
+	#ifdef Q_TEST__HAS_IMPACT
+	for (auto& slot : impact_slots) {
+		if (!__atomic_load_n(&slot, __ATOMIC_RELAXED)) continue;
+		void* fn = __atomic_exchange_n(&slot, nullptr, __ATOMIC_RELAXED);
+		if (fn) fns.push_back(fn);
+	}
+	overflow = __atomic_exchange_n(&impact_overflow, 0, __ATOMIC_RELAXED);
+	#else
+	(void)fns;
+	#endif
+	return overflow;
+}
+
+// The test keeps what it recorded so far, and the table is left to the
+// BEFORE_ALL.
+inline void QTestImpactMap::fixture_begin()
+{
+	AllocationPause pause;
+	overflowed |= drain(collected);
+}
+
+inline ImpactFixture QTestImpactMap::fixture_end()
+{
+	AllocationPause pause;
+	ImpactFixture fixture;
+	fixture.overflow = drain(fixture.fns);
+	return fixture;
+}
+
+inline void QTestImpactMap::add(const ImpactFixture& fixture)
+{
+	AllocationPause pause;
+	collected.insert(collected.end(), fixture.fns.begin(), fixture.fns.end());
+	overflowed |= fixture.overflow;
+}
+
+inline void QTestImpactMap::end(const std::string& id)
+{
+	#ifdef Q_TEST__HAS_IMPACT
+	__atomic_store_n(&impact_active, 0, __ATOMIC_RELAXED);
+	#endif
+	AllocationPause pause;
+	overflowed |= drain(collected);
+	// The incomplete map could deselect the impacted test, so the test is
+	// stored with no locations, which drops it from the map.
+	if (overflowed) {
+		recorded[id] = {};
+	} else if (!collected.empty()) {
+		recorded[id] = std::move(collected);
+	}
+	collected.clear();
+}
+
+// Every object file is resolved with one addr2line call per batch of
+// addresses. Position independent objects are resolved by the offset.
+inline std::map<void*, ImpactLocation> QTestImpactMap::symbolize()
+{
+	std::map<void*, ImpactLocation> res;
+	#ifdef Q_TEST__HAS_IMPACT
+	std::map<std::string, std::vector<std::pair<void*, uintptr_t>>> objects;
+	for (auto& [id, fns] : recorded) {
+		for (void* fn : fns) {
+			if (res.count(fn)) continue;
+			res[fn] = {};
+			Dl_info info;
+			if (!dladdr(fn, &info) || !info.dli_fname) continue;
+			objects[info.dli_fname].push_back({fn, (uintptr_t)fn - (uintptr_t)info.dli_fbase});
+		}
+	}
+	for (auto& [file, fns] : objects) {
+		// ET_EXEC objects are not relocated, so their addresses are used as is
+		uint16_t type = 0;
+		int fd = open(file.c_str(), O_RDONLY);
+		if (fd >= 0 && pread(fd, &type, sizeof(type), 16) != sizeof(type)) type = 0;
+		if (fd >= 0) close(fd);
+		std::string quoted = "'";
+		for (char c : file) {
+			quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+		}
+		quoted += "'";
+		for (size_t start=0;start<fns.size();start+=512) {
+			std::string cmd = "addr2line -f -C -e " + quoted;
+			size_t end = std::min(fns.size(), start + 512);
+			for (size_t i=start;i<end;i++) {
+				char buf[32];
+				std::snprintf(buf, sizeof(buf), " 0x%zx", type == 2 ? (size_t)fns[i].first : (size_t)fns[i].second);
+				cmd += buf;
+			}
+			std::FILE* out = popen(cmd.c_str(), "r");
+			if (!out) continue;
+			char function[4096], location[4096];
+			for (size_t i=start;i<end && std::fgets(function, sizeof(function), out) && std::fgets(location, sizeof(location), out);i++) {
+				std::string loc = location;
+				loc = loc.substr(0, loc.rfind(':'));
+				std::string name = function;
+				if (!name.empty() && name.back() == '\n') name.pop_back();
+				if (loc != "??") res[fns[i].first] = {loc, name};
+			}
+			pclose(out);
+		}
+	}
+	#endif
+	return res;
+}
+
+// The tests that didn't run keep their previous entries. Nothing is saved if
+// nothing was recorded (the code is not built with -finstrument-functions),
+// so the map is never wiped out.
+inline void QTestImpactMap::save()
+{
+	if (recorded.empty()) return;
+	std::map<void*, ImpactLocation> symbols = symbolize();
+	for (auto& [id, fns] : recorded) {
+		std::set<std::pair<std::string, std::string>> locations;
+		for (void* fn : fns) {
+			ImpactLocation& l = symbols[fn];
+			if (!l.file.empty()) locations.insert({l.file, l.function});
+		}
+		std::vector<ImpactLocation>& test = previous[id];
+		test.clear();
+		for (auto& [file, function] : locations) {
+			test.push_back({file, function});
+		}
+	}
+	std::ofstream out(path, std::ios::trunc);
+	for (auto& [id, locations] : previous) {
+		if (locations.empty()) continue;
+		out << "test " << id << '\n';
+		for (auto& l : locations) {
+			out << l.file << '\t' << l.function << '\n';
+		}
+	}
+}
+
+} // Q_TEST_NS_DETAIL
+
+// The hooks are defined only in the translation unit that defines
+// TEST_IMPACT_MAP, the code under test is built with -finstrument-functions.
+#if defined(TEST_IMPACT_MAP) && defined(Q_TEST__HAS_IMPACT)
+extern "C" __attribute__((no_instrument_function)) void __cyg_profile_func_enter(void* fn, void*)
+{
+	Q_TEST_NS_DETAIL::impact_record(fn);
+}
+
+extern "C" __attribute__((no_instrument_function)) void __cyg_profile_func_exit(void*, void*)
+{
+}
+#endif
+
+#endif // QTESTIMPACT_H
@@ -0,0 +1,176 @@
+#ifndef QTESTJOURNAL_H
+#define QTESTJOURNAL_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <deque>
+#include <fstream>
+#include <iterator>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef TEST_JOURNAL_SYNC_COUNT
+#define TEST_JOURNAL_SYNC_COUNT 32
+#endif
+#ifndef TEST_JOURNAL_SYNC_MS
+#define TEST_JOURNAL_SYNC_MS 1000
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+struct JournalEntry {
+	bool passed = true;
+	double duration = 0;
+};
+
+// The journal is the magic followed by the records:
+//   uint32 payload size, uint32 payload checksum,
+//   payload: uint8 passed, uint64 duration in ns, the test key.
+// Every record is written with its own write call, so it survives the crash of
+// the process; fsync is batched by TEST_JOURNAL_SYNC_COUNT records and
+// TEST_JOURNAL_SYNC_MS, so it survives the machine going down with at most one
+// batch lost. The torn record at the end is cut off when the journal is resumed.
+class QTestJournal
+{
+	static constexpr char magic[] = {'Q', 'T', 'J', '1'};
+
+	public:
+		QTestJournal(std::string path, bool resume);
+		~QTestJournal();
+		QTestJournal(const QTestJournal&) = delete;
+		QTestJournal& operator=(const QTestJournal&) = delete;
+
+		bool replay(const std::string& key, JournalEntry& entry);
+		void record(const std::string& key, bool passed, double duration);
+
+	private:
+		size_t load(std::string& path);
+		void sync();
+
+		int fd = -1;
+		std::unordered_map<std::string, std::deque<JournalEntry>> entries;
+		int unsynced = 0;
+		std::chrono::steady_clock::time_point last_sync = std::chrono::steady_clock::now();
+};
+
+inline QTestJournal* journal = nullptr;
+
+inline uint32_t journal_checksum(const char* data, size_t size)
+{
+	uint32_t hash = 2166136261u;
+	for (size_t i=0;i<size;i++) {
+		hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+	}
+	return hash;
+}
+
+inline QTestJournal::QTestJournal(std::string path, bool resume)
+{
+	size_t valid = resume ? load(path) : 0;
+	#ifdef _WIN32
+	fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_BINARY, 0644);
+	if (fd < 0) return;
+	_chsize_s(fd, valid);
+	_lseek(fd, 0, SEEK_END);
+	if (!valid) _write(fd, magic, sizeof(magic));
+	#else
+	fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0) return;
+	if (ftruncate(fd, valid) != 0 || lseek(fd, 0, SEEK_END) < 0 || (!valid && ::write(fd, magic, sizeof(magic)) != sizeof(magic))) {
+		close(fd);
+		fd = -1;
+	}
+	#endif
+}
+
+inline QTestJournal::~QTestJournal()
+{
+	if (fd < 0) return;
+	sync();
+	#ifdef _WIN32
+	_close(fd);
+	#else
+	close(fd);
+	#endif
+}
+
+// Returns the size of the valid part of the journal.
+inline size_t QTestJournal::load(std::string& path)
+{
+	std::ifstream in(path, std::ios::binary);
+	std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	if (data.size() < sizeof(magic) || std::memcmp(data.data(), magic, sizeof(magic)) != 0) return 0;
+	size_t pos = sizeof(magic);
+	constexpr size_t fixed = sizeof(uint8_t) + sizeof(uint64_t);
+	while (data.size() - pos >= 2 * sizeof(uint32_t)) {
+		uint32_t size, checksum;
+		std::memcpy(&size, data.data() + pos, sizeof(size));
+		std::memcpy(&checksum, data.data() + pos + sizeof(size), sizeof(checksum));
+		const char* payload = data.data() + pos + 2 * sizeof(uint32_t);
+		if (size < fixed || data.size() - pos - 2 * sizeof(uint32_t) < size || journal_checksum(payload, size) != checksum) break;
+		uint64_t duration;
+		std::memcpy(&duration, payload + 1, sizeof(duration));
+		entries[std::string(payload + fixed, size - fixed)].push_back({payload[0] != 0, (double)duration});
+		pos += 2 * sizeof(uint32_t) + size;
+	}
+	return pos;
+}
+
+// The test names may repeat, so every recorded run of the key is replayed once.
+inline bool QTestJournal::replay(const std::string& key, JournalEntry& entry)
+{
+	auto it = entries.find(key);
+	if (it == entries.end() || it->second.empty()) return false;
+	entry = it->second.front();
+	it->second.pop_front();
+	return true;
+}
+
+inline void QTestJournal::record(const std::string& key, bool passed, double duration)
+{
+	if (fd < 0) return;
+	uint64_t ns = (uint64_t)duration;
+	uint32_t size = sizeof(uint8_t) + sizeof(ns) + key.size();
+	std::string rec(2 * sizeof(uint32_t) + size, '\0');
+	char* payload = rec.data() + 2 * sizeof(uint32_t);
+	payload[0] = passed;
+	std::memcpy(payload + 1, &ns, sizeof(ns));
+	std::memcpy(payload + 1 + sizeof(ns), key.data(), key.size());
+	uint32_t checksum = journal_checksum(payload, size);
+	std::memcpy(rec.data(), &size, sizeof(size));
+	std::memcpy(rec.data() + sizeof(size), &checksum, sizeof(checksum));
+	#ifdef _WIN32
+	_write(fd, rec.data(), (unsigned)rec.size());
+	#else
+	if (::write(fd, rec.data(), rec.size()) < 0) return;
+	#endif
+	auto now = std::chrono::steady_clock::now();
+	if (++unsynced >= TEST_JOURNAL_SYNC_COUNT || now - last_sync >= std::chrono::milliseconds(TEST_JOURNAL_SYNC_MS)) {
+		sync();
+	}
+}
+
+inline void QTestJournal::sync()
+{
+	if (!unsynced) return;
+	#ifdef _WIN32
+	_commit(fd);
+	#else
+	fsync(fd);
+	#endif
+	unsynced = 0;
+	last_sync = std::chrono::steady_clock::now();
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTJOURNAL_H
@@ -0,0 +1,191 @@
+#ifndef QTESTLATENCY_H
+#define QTESTLATENCY_H
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+
+#include "qtestexpect.hpp"
+#include "qtestbench.hpp"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+inline int highest_bit_index(uint64_t value)
+{
+	#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, value);
+	return (int)index;
+	#else
+	return 63 - __builtin_clzll(value);
+	#endif
+}
+
+// HDR style log-linear histogram of nanoseconds. Values below 2^sub_bits are
+// stored exactly, every next power of two range is split into 2^sub_bits
+// buckets, so any recorded value is known with the 1/128 relative precision.
+class LatencyHistogram
+{
+	static constexpr int sub_bits = 7;
+	static constexpr uint64_t sub_count = 1 << sub_bits;
+
+	public:
+		LatencyHistogram() : counts((64 - sub_bits + 1) * sub_count, 0) {}
+		void record(uint64_t ns);
+		uint64_t percentile(double p);
+		uint64_t max() { return max_value; }
+		uint64_t min() { return total ? min_value : 0; }
+		double mean() { return total ? (double)sum / total : 0; }
+		uint64_t count() { return total; }
+		std::string summary();
+
+	private:
+		size_t index_of(uint64_t ns);
+		uint64_t highest_value_at(size_t index);
+
+		std::vector<uint64_t> counts;
+		uint64_t total = 0;
+		uint64_t sum = 0;
+		uint64_t min_value = UINT64_MAX;
+		uint64_t max_value = 0;
+};
+
+class QTestLatency
+{
+	public:
+		QTestLatency(LatencyHistogram&& histogram, bool* result, ErrorReport* error)
+			: histogram(std::move(histogram)), result(result), error(error) {}
+		template<typename R, typename P> bool percentileToBeLessThan(double p, std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool p50ToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool p90ToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool p99ToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool p999ToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool maxToBeLessThan(std::chrono::duration<R, P> compare);
+
+		//Aliases
+		template<typename R, typename P> bool percentile_to_be_less_than(double p, std::chrono::duration<R, P> compare) { return percentileToBeLessThan(p, compare); }
+		template<typename R, typename P> bool p50_to_be_less_than(std::chrono::duration<R, P> compare) { return p50ToBeLessThan(compare); }
+		template<typename R, typename P> bool p90_to_be_less_than(std::chrono::duration<R, P> compare) { return p90ToBeLessThan(compare); }
+		template<typename R, typename P> bool p99_to_be_less_than(std::chrono::duration<R, P> compare) { return p99ToBeLessThan(compare); }
+		template<typename R, typename P> bool p999_to_be_less_than(std::chrono::duration<R, P> compare) { return p999ToBeLessThan(compare); }
+		template<typename R, typename P> bool max_to_be_less_than(std::chrono::duration<R, P> compare) { return maxToBeLessThan(compare); }
+
+	private:
+		template<typename R, typename P> bool check(std::string_view func, uint64_t value, std::chrono::duration<R, P> compare, std::string prefix = "");
+
+		LatencyHistogram histogram;
+		bool* result;
+		ErrorReport* error;
+};
+
+inline size_t LatencyHistogram::index_of(uint64_t ns)
+{
+	if (ns < sub_count) return ns;
+	int shift = highest_bit_index(ns) - sub_bits;
+	return sub_count * (shift + 1) + ((ns >> shift) - sub_count);
+}
+
+inline uint64_t LatencyHistogram::highest_value_at(size_t index)
+{
+	if (index < sub_count) return index;
+	int shift = index / sub_count - 1;
+	uint64_t lowest = (sub_count + index % sub_count) << shift;
+	return lowest + ((uint64_t(1) << shift) - 1);
+}
+
+inline void LatencyHistogram::record(uint64_t ns)
+{
+	counts[index_of(ns)]++;
+	total++;
+	sum += ns;
+	min_value = std::min(min_value, ns);
+	max_value = std::max(max_value, ns);
+}
+
+inline uint64_t LatencyHistogram::percentile(double p)
+{
+	if (!total) return 0;
+	uint64_t rank = std::max<uint64_t>(1, (uint64_t)std::ceil(p / 100 * total));
+	uint64_t seen = 0;
+	for (size_t i=0;i<counts.size();i++) {
+		seen += counts[i];
+		if (seen >= rank) return std::min(highest_value_at(i), max_value);
+	}
+	return max_value;
+}
+
+inline std::string LatencyHistogram::summary()
+{
+	return "min " + format_duration(min()) + ", p50 " + format_duration(percentile(50))
+		+ ", p90 " + format_duration(percentile(90)) + ", p99 " + format_duration(percentile(99))
+		+ ", p99.9 " + format_duration(percentile(99.9)) + ", max " + format_duration(max())
+		+ ", mean " + format_duration(mean()) + " (" + std::to_string(total) + " calls)";
+}
+
+template<typename R, typename P>
+bool QTestLatency::check(std::string_view func, uint64_t value, std::chrono::duration<R, P> compare, std::string prefix)
+{
+	double limit = std::chrono::duration<double, std::nano>(compare).count();
+	if (!(*result &= value < limit)) {
+		AllocationPause pause;
+		error->func = func;
+		error->value = format_duration(value);
+		error->compare = prefix + format_duration(limit);
+		error->hint = histogram.summary();
+		error->has_compare = true;
+		error->value_substituted = true;
+		error->compare_substituted = true;
+	}
+	return *result;
+}
+
+template<typename R, typename P>
+bool QTestLatency::percentileToBeLessThan(double p, std::chrono::duration<R, P> compare)
+{
+	char prefix[32];
+	std::snprintf(prefix, sizeof(prefix), "%g, ", p);
+	return check(__func__, histogram.percentile(p), compare, prefix);
+}
+
+template<typename R, typename P>
+bool QTestLatency::p50ToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.percentile(50), compare);
+}
+
+template<typename R, typename P>
+bool QTestLatency::p90ToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.percentile(90), compare);
+}
+
+template<typename R, typename P>
+bool QTestLatency::p99ToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.percentile(99), compare);
+}
+
+template<typename R, typename P>
+bool QTestLatency::p999ToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.percentile(99.9), compare);
+}
+
+template<typename R, typename P>
+bool QTestLatency::maxToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	return check(__func__, histogram.max(), compare);
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTLATENCY_H
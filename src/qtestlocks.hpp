@@ -0,0 +1,391 @@
+#ifndef QTESTLOCKS_H
+#define QTESTLOCKS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+
+#include "qtestexpect.hpp"
+#include "qtestbench.hpp"
+#include "qtestalloc.hpp"
+#include "qtestrealtime.hpp"
+#include "qtestprofile.hpp"
+
+#ifndef TEST_LOCK_PROFILE_TOP
+#define TEST_LOCK_PROFILE_TOP 3
+#endif
+
+// The lock hooks are shared by the lock profiler and the realtime safety checks.
+#if (defined(TEST_LOCK_PROFILE) || defined(TEST_REALTIME_SAFETY)) && defined(Q_TEST__HAS_REALTIME_HOOKS)
+#define Q_TEST__HAS_LOCK_HOOKS
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+// Durations are in nanoseconds. The site is the first caller outside of the
+// pthread and the standard library wrappers at the first acquisition.
+struct LockSite {
+	void* lock = nullptr;
+	std::string site;
+	uint64_t acquisitions = 0;
+	uint64_t contended = 0;
+	double wait = 0;
+	double hold = 0;
+};
+
+// The locks are sorted by the wait time, the most waited first.
+struct LockContention {
+	bool available = false;
+	uint64_t acquisitions = 0;
+	uint64_t contended = 0;
+	double wait = 0;
+	double hold = 0;
+	std::vector<LockSite> locks;
+};
+
+struct LockSlot {
+	static constexpr int max_depth = 8;
+	std::atomic<void*> lock{nullptr};
+	std::atomic<uint64_t> acquisitions{0};
+	std::atomic<uint64_t> contended{0};
+	std::atomic<uint64_t> wait{0};
+	std::atomic<uint64_t> hold{0};
+	void* frames[max_depth] = {};
+	int depth = 0;
+};
+
+struct HeldLock {
+	void* lock;
+	uint64_t since;
+	unsigned generation;
+};
+
+// The hooks run in every thread and can't allocate, so the locks are counted
+// in the lock-free open addressing table. The locks held by the thread are
+// remembered to measure the hold time, the entries left from the previous
+// profile are told apart by the generation.
+inline constexpr size_t lock_slots_count = 4096;
+inline constexpr int max_held_locks = 16;
+inline LockSlot lock_slots[lock_slots_count];
+inline std::atomic<int> lock_profile_depth{0};
+inline std::atomic<unsigned> lock_profile_generation{0};
+inline thread_local HeldLock held_locks[max_held_locks];
+inline thread_local int held_locks_count = 0;
+
+class QTestLockContention
+{
+	public:
+		QTestLockContention(LockContention&& contention, bool* result, ErrorReport* error)
+			: contention(std::move(contention)), result(result), error(error) {}
+		template<typename R, typename P> bool waitToBeLessThan(std::chrono::duration<R, P> compare);
+		template<typename R, typename P> bool holdToBeLessThan(std::chrono::duration<R, P> compare);
+		bool contendedToBeLessThan(uint64_t count);
+
+		//Aliases
+		template<typename R, typename P> bool wait_to_be_less_than(std::chrono::duration<R, P> compare) { return waitToBeLessThan(compare); }
+		template<typename R, typename P> bool hold_to_be_less_than(std::chrono::duration<R, P> compare) { return holdToBeLessThan(compare); }
+		bool contended_to_be_less_than(uint64_t count) { return contendedToBeLessThan(count); }
+
+	private:
+		void report(std::string_view func, std::string value, std::string compare);
+
+		LockContention contention;
+		bool* result;
+		ErrorReport* error;
+};
+
+inline uint64_t lock_clock()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Finds the slot of the lock. The slot is added only if the caller is given,
+// and remembers the stack of the first acquisition from the caller of the hook.
+inline LockSlot* lock_slot(void* lock, void* caller)
+{
+	size_t i = ((uintptr_t)lock >> 3) * 0x9E3779B97F4A7C15ull >> 52;
+	for (size_t probe=0;probe<64;probe++, i=(i + 1) & (lock_slots_count - 1)) {
+		LockSlot& s = lock_slots[i];
+		void* current = s.lock.load(std::memory_order_acquire);
+		if (current == lock) return &s;
+		if (current) continue;
+		if (!caller) return nullptr;
+		if (!s.lock.compare_exchange_strong(current, lock, std::memory_order_acq_rel)) {
+			if (current == lock) return &s;
+			continue;
+		}
+		s.frames[0] = caller;
+		s.depth = 1;
+		#ifdef Q_TEST__HAS_BACKTRACE
+		void* frames[LockSlot::max_depth + 8];
+		int depth = backtrace(frames, LockSlot::max_depth + 8);
+		for (int f=0;f<depth;f++) {
+			if (frames[f] != caller) continue;
+			s.depth = std::min(depth - f, LockSlot::max_depth);
+			std::copy(frames + f, frames + f + s.depth, s.frames);
+			break;
+		}
+		#endif
+		return &s;
+	}
+	return nullptr;
+}
+
+inline void lock_acquired(void* lock, void* caller, uint64_t wait, bool contended)
+{
+	LockSlot* s = lock_slot(lock, caller);
+	if (!s) return;
+	s->acquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (contended) {
+		s->contended.fetch_add(1, std::memory_order_relaxed);
+		s->wait.fetch_add(wait, std::memory_order_relaxed);
+	}
+	unsigned generation = lock_profile_generation.load(std::memory_order_relaxed);
+	int kept = 0;
+	for (int i=0;i<held_locks_count;i++) {
+		if (held_locks[i].generation == generation) held_locks[kept++] = held_locks[i];
+	}
+	held_locks_count = kept;
+	if (held_locks_count == max_held_locks) return;
+	held_locks[held_locks_count++] = {lock, lock_clock(), generation};
+}
+
+// The recursive lock is held from its first acquisition.
+inline void lock_released(void* lock)
+{
+	for (int i=0;i<held_locks_count;i++) {
+		if (held_locks[i].lock != lock) continue;
+		HeldLock held = held_locks[i];
+		std::copy(held_locks + i + 1, held_locks + held_locks_count, held_locks + i);
+		held_locks_count--;
+		if (held.generation != lock_profile_generation.load(std::memory_order_relaxed)) return;
+		LockSlot* s = lock_slot(lock, nullptr);
+		if (s) s->hold.fetch_add(lock_clock() - held.since, std::memory_order_relaxed);
+		return;
+	}
+}
+
+// Tries the lock first, so only the contended acquisition is timed.
+template<typename L>
+int lock_profiled(L* lock, void* caller, int (*lock_fn)(L*), int (*try_fn)(L*))
+{
+	if (!lock_profile_depth.load(std::memory_order_relaxed)) return lock_fn(lock);
+	if (try_fn(lock) == 0) {
+		lock_acquired(lock, caller, 0, false);
+		return 0;
+	}
+	uint64_t start = lock_clock();
+	int res = lock_fn(lock);
+	if (res == 0) lock_acquired(lock, caller, lock_clock() - start, true);
+	return res;
+}
+
+// The table is cleared by the outermost profile only, the nested one reads
+// the difference. The hooks of other threads can run meanwhile, so the slot
+// is released after its counters are zeroed: a lock claiming it again starts
+// from zero and only the late update of the old lock can leak into it.
+inline void lock_profile_begin()
+{
+	if (!lock_profile_depth.load()) {
+		for (auto& s : lock_slots) {
+			s.acquisitions.store(0, std::memory_order_relaxed);
+			s.contended.store(0, std::memory_order_relaxed);
+			s.wait.store(0, std::memory_order_relaxed);
+			s.hold.store(0, std::memory_order_relaxed);
+			s.lock.store(nullptr, std::memory_order_release);
+		}
+		lock_profile_generation++;
+		#ifdef Q_TEST__HAS_BACKTRACE
+		// The first backtrace call loads the unwinder, which allocates.
+		static bool warmed_up = [] { void* frame; return backtrace(&frame, 1) >= 0; }();
+		(void)warmed_up;
+		#endif
+	}
+	lock_profile_depth++;
+}
+
+inline void lock_profile_end()
+{
+	lock_profile_depth--;
+}
+
+// The wrappers are mostly inlined or not exported, so the first named frame
+// outside of the standard library is taken. The functions of the executable
+// are named only if it is linked with -rdynamic.
+inline std::string lock_call_site(LockSlot& s)
+{
+	std::string first;
+	for (int f=0;f<s.depth;f++) {
+		// Return addresses point after the call instruction
+		std::string name = address_symbol((char*)s.frames[f] - 1);
+		if (f == 0) first = name;
+		bool named = name != "??" && name.find("+0x") == std::string::npos;
+		if (named && name.rfind("std::", 0) != 0 && name.rfind("__gthread", 0) != 0 && name.rfind("pthread_", 0) != 0) return name;
+	}
+	return first;
+}
+
+inline LockContention read_lock_contention(const LockContention* since = nullptr)
+{
+	AllocationPause pause;
+	LockContention res;
+	#ifdef Q_TEST__HAS_LOCK_HOOKS
+	res.available = true;
+	#endif
+	std::map<void*, const LockSite*> previous;
+	if (since) {
+		for (auto& l : since->locks) {
+			previous[l.lock] = &l;
+		}
+	}
+	for (auto& s : lock_slots) {
+		LockSite l;
+		l.lock = s.lock.load(std::memory_order_acquire);
+		if (!l.lock) continue;
+		l.acquisitions = s.acquisitions.load(std::memory_order_relaxed);
+		l.contended = s.contended.load(std::memory_order_relaxed);
+		l.wait = s.wait.load(std::memory_order_relaxed);
+		l.hold = s.hold.load(std::memory_order_relaxed);
+		auto it = previous.find(l.lock);
+		if (it != previous.end()) {
+			l.acquisitions -= it->second->acquisitions;
+			l.contended -= it->second->contended;
+			l.wait -= it->second->wait;
+			l.hold -= it->second->hold;
+		}
+		if (!l.acquisitions && !l.hold) continue;
+		l.site = lock_call_site(s);
+		res.acquisitions += l.acquisitions;
+		res.contended += l.contended;
+		res.wait += l.wait;
+		res.hold += l.hold;
+		res.locks.push_back(std::move(l));
+	}
+	std::sort(res.locks.begin(), res.locks.end(), [](const LockSite& a, const LockSite& b) {
+		return a.wait != b.wait ? a.wait > b.wait : a.contended > b.contended;
+	});
+	return res;
+}
+
+template<typename F>
+LockContention measure_lock_contention(F&& fn)
+{
+	lock_profile_begin();
+	LockContention before = read_lock_contention();
+	fn();
+	lock_profile_end();
+	return read_lock_contention(&before);
+}
+
+// The summary line followed by the most waited contended locks.
+inline std::vector<std::string> generate_lock_contention_lines(LockContention& contention)
+{
+	std::vector<std::string> res;
+	if (!contention.acquisitions) return res;
+	res.push_back("locks " + std::to_string(contention.locks.size()) + ", acquired " + std::to_string(contention.acquisitions)
+		+ ", contended " + std::to_string(contention.contended) + ", wait " + format_duration(contention.wait)
+		+ ", hold " + format_duration(contention.hold));
+	for (size_t i=0;i<contention.locks.size() && i<TEST_LOCK_PROFILE_TOP;i++) {
+		LockSite& l = contention.locks[i];
+		if (!l.contended) break;
+		char lock[32];
+		std::snprintf(lock, sizeof(lock), "%p", l.lock);
+		res.push_back("lock " + std::string(lock) + " at " + l.site + ": contended " + std::to_string(l.contended) + " of "
+			+ std::to_string(l.acquisitions) + ", wait " + format_duration(l.wait) + ", hold " + format_duration(l.hold));
+	}
+	return res;
+}
+
+inline void QTestLockContention::report(std::string_view func, std::string value, std::string compare)
+{
+	AllocationPause pause;
+	error->func = func;
+	error->value = contention.available ? value : "not measured";
+	error->compare = compare;
+	error->has_compare = true;
+	error->value_substituted = true;
+	error->compare_substituted = true;
+	for (auto& line : generate_lock_contention_lines(contention)) {
+		error->hint += (error->hint.empty() ? "" : "\n") + line;
+	}
+}
+
+template<typename R, typename P>
+bool QTestLockContention::waitToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	double limit = std::chrono::duration<double, std::nano>(compare).count();
+	if (!(*result &= contention.available && contention.wait < limit)) {
+		report(__func__, format_duration(contention.wait), format_duration(limit));
+	}
+	return *result;
+}
+
+template<typename R, typename P>
+bool QTestLockContention::holdToBeLessThan(std::chrono::duration<R, P> compare)
+{
+	double limit = std::chrono::duration<double, std::nano>(compare).count();
+	if (!(*result &= contention.available && contention.hold < limit)) {
+		report(__func__, format_duration(contention.hold), format_duration(limit));
+	}
+	return *result;
+}
+
+inline bool QTestLockContention::contendedToBeLessThan(uint64_t count)
+{
+	if (!(*result &= contention.available && contention.contended < count)) {
+		report(__func__, std::to_string(contention.contended), std::to_string(count));
+	}
+	return *result;
+}
+
+} // Q_TEST_NS_DETAIL
+
+// Replacement functions can't be inline, so they are defined only in the
+// translation unit that defines TEST_LOCK_PROFILE or TEST_REALTIME_SAFETY.
+// The condition variable releases the mutex while it waits, and acquires it
+// again before the return.
+#ifdef Q_TEST__HAS_LOCK_HOOKS
+#define Q_TEST__LOCK_HOOK(name, try_name, type) \
+	extern "C" int name(type* l) noexcept(true) \
+	{ \
+		static int (*next)(type*) = nullptr; \
+		static int (*next_try)(type*) = nullptr; \
+		Q_TEST_NS_DETAIL::realtime_violation(#name); \
+		return Q_TEST_NS_DETAIL::lock_profiled(l, __builtin_return_address(0), Q_TEST_NS_DETAIL::realtime_next(#name, next), Q_TEST_NS_DETAIL::realtime_next(#try_name, next_try)); \
+	}
+
+#define Q_TEST__UNLOCK_HOOK(name, type) \
+	extern "C" int name(type* l) noexcept(true) \
+	{ \
+		static int (*next)(type*) = nullptr; \
+		Q_TEST_NS_DETAIL::lock_released(l); \
+		return Q_TEST_NS_DETAIL::realtime_next(#name, next)(l); \
+	}
+
+#define Q_TEST__COND_HOOK(name, params, args) \
+	extern "C" int name params noexcept(false) \
+	{ \
+		static int (*next) params = nullptr; \
+		Q_TEST_NS_DETAIL::realtime_violation(#name); \
+		Q_TEST_NS_DETAIL::lock_released(m); \
+		int res = Q_TEST_NS_DETAIL::realtime_next(#name, next) args; \
+		if (Q_TEST_NS_DETAIL::lock_profile_depth.load(std::memory_order_relaxed)) Q_TEST_NS_DETAIL::lock_acquired(m, __builtin_return_address(0), 0, false); \
+		return res; \
+	}
+
+Q_TEST__LOCK_HOOK(pthread_mutex_lock, pthread_mutex_trylock, pthread_mutex_t)
+Q_TEST__LOCK_HOOK(pthread_rwlock_rdlock, pthread_rwlock_tryrdlock, pthread_rwlock_t)
+Q_TEST__LOCK_HOOK(pthread_rwlock_wrlock, pthread_rwlock_trywrlock, pthread_rwlock_t)
+Q_TEST__UNLOCK_HOOK(pthread_mutex_unlock, pthread_mutex_t)
+Q_TEST__UNLOCK_HOOK(pthread_rwlock_unlock, pthread_rwlock_t)
+Q_TEST__COND_HOOK(pthread_cond_wait, (pthread_cond_t* c, pthread_mutex_t* m), (c, m))
+Q_TEST__COND_HOOK(pthread_cond_timedwait, (pthread_cond_t* c, pthread_mutex_t* m, const timespec* t), (c, m, t))
+#endif
+
+#endif // QTESTLOCKS_H
@@ -0,0 +1,129 @@
+#ifndef QTESTMATCH_H
+#define QTESTMATCH_H
+
+#include <string>
+#include <string_view>
+#include <algorithm>
+#include <utility>
+#include <cstring>
+#include <regex>
+#include <unordered_map>
+#include <mutex>
+
+#include "qtestutils.hpp"
+#include "qtestalloc.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define Q_TEST__HAS_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+inline int lowest_bit_index(unsigned mask)
+{
+	#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return (int)index;
+	#else
+	return __builtin_ctz(mask);
+	#endif
+}
+
+// Returns the position of the first `needle` occurrence in `haystack` or npos.
+// Blocks of 16 bytes are filtered by the first and the last character of the needle,
+// so only the rare candidates are verified with memcmp.
+inline size_t find_substring(std::string_view haystack, std::string_view needle)
+{
+	const size_t n = haystack.size();
+	const size_t k = needle.size();
+	if (k == 0) return 0;
+	if (k > n) return std::string_view::npos;
+
+	const char* hs = haystack.data();
+	const char* nd = needle.data();
+	size_t i = 0;
+
+	#ifdef Q_TEST__HAS_SSE2
+	const __m128i first = _mm_set1_epi8(nd[0]);
+	const __m128i last = _mm_set1_epi8(nd[k-1]);
+	for (; i + k + 15 <= n; i += 16) {
+		const __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hs + i));
+		const __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hs + i + k - 1));
+		unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+		while (mask) {
+			const int bit = lowest_bit_index(mask);
+			if (std::memcmp(hs + i + bit + 1, nd + 1, k - 1) == 0) {
+				return i + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+	#endif
+
+	// Tail (or the whole haystack without SSE2) goes through memchr.
+	while (i + k <= n) {
+		const void* p = std::memchr(hs + i, nd[0], n - k + 1 - i);
+		if (!p) break;
+		i = (size_t)(static_cast<const char*>(p) - hs);
+		if (std::memcmp(hs + i + 1, nd + 1, k - 1) == 0) {
+			return i;
+		}
+		++i;
+	}
+	return std::string_view::npos;
+}
+
+// Returns the longest prefix of the `needle` that occurs in the `haystack`.
+// Prefix presence is monotonic, so binary search needs only log(needle) scans.
+inline std::pair<size_t, size_t> find_nearest_match(std::string_view haystack, std::string_view needle)
+{
+	size_t lo = 0, hi = needle.size(), pos = std::string_view::npos;
+	while (lo < hi) {
+		size_t mid = (lo + hi + 1) / 2;
+		size_t p = find_substring(haystack, needle.substr(0, mid));
+		if (p != std::string_view::npos) {
+			lo = mid;
+			pos = p;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	return {pos, lo};
+}
+
+inline std::string excerpt_region(std::string_view str, size_t pos, size_t len)
+{
+	constexpr size_t context = 20;
+	size_t from = pos > context ? pos - context : 0;
+	size_t to = std::min(str.size(), pos + len + context);
+	std::string region(str.substr(from, to - from));
+	std::string res = from > 0 ? "..." : "";
+	res += sanitize(region);
+	if (to < str.size()) res += "...";
+	return res;
+}
+
+// Compiled regular expressions are kept for the whole run, as the same
+// pattern usually gets checked in many tests.
+inline const std::regex& cached_regex(std::string_view pattern)
+{
+	static std::unordered_map<std::string, std::regex> cache;
+	static std::mutex mtx;
+	std::lock_guard<std::mutex> lock(mtx);
+	AllocationPause pause;
+	auto it = cache.find(std::string(pattern));
+	if (it == cache.end()) {
+		it = cache.emplace(std::string(pattern), std::regex(pattern.begin(), pattern.end())).first;
+	}
+	return it->second;
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTMATCH_H
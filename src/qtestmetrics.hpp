@@ -0,0 +1,193 @@
+#ifndef QTESTMETRICS_H
+#define QTESTMETRICS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <iterator>
+#include <cstdio>
+
+#include "qtestreport.hpp"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+// Collects the run into the OpenMetrics text file, written once at the end.
+// The file is written next to the target and renamed over it, so the
+// node-exporter textfile collector never reads the half-written file.
+class QTestMetricsReporter : public QTestReporter
+{
+	using clock = std::chrono::steady_clock;
+
+	public:
+		QTestMetricsReporter(std::string path) : path(path) {}
+		void describe_enter(std::string_view name) override;
+		void describe_leave(std::string_view name) override;
+		void test_result(const TestResult& result) override;
+		void statistics(const RunStatistics& stats) override;
+
+	private:
+		static constexpr double buckets[] = {0.0001, 0.001, 0.01, 0.1, 1, 10};
+
+		void family(std::string& res, std::string_view name, std::string_view type, std::string_view help, std::string& samples);
+
+		std::string path;
+		std::vector<std::string> describes;
+		std::vector<clock::time_point> describe_starts;
+		std::map<std::string, double> describe_durations;
+		std::map<std::string, uint64_t> occurrences;
+		uint64_t bucket_counts[std::size(buckets)] = {};
+		uint64_t tests = 0;
+		double tests_duration = 0;
+		std::string benchmarks;
+		std::string page_faults;
+		std::string context_switches;
+		std::string io_bytes;
+		std::string allocations;
+		std::string allocated_bytes;
+};
+
+inline std::string metrics_label(std::string_view str)
+{
+	std::string res;
+	for (char c : str) {
+		if (c == '\\' || c == '"') res.push_back('\\');
+		if (c == '\n') {
+			res += "\\n";
+		} else {
+			res.push_back(c);
+		}
+	}
+	return res;
+}
+
+inline std::string metrics_value(double value)
+{
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.9g", value);
+	return buf;
+}
+
+inline void QTestMetricsReporter::describe_enter(std::string_view name)
+{
+	describes.push_back(std::string(name));
+	describe_starts.push_back(clock::now());
+}
+
+// The same describe path met twice is summed up.
+inline void QTestMetricsReporter::describe_leave(std::string_view)
+{
+	std::string key;
+	for (auto& d : describes) {
+		key += (key.empty() ? "" : " ") + d;
+	}
+	describe_durations[key] += std::chrono::duration<double>(clock::now() - describe_starts.back()).count();
+	describes.pop_back();
+	describe_starts.pop_back();
+}
+
+inline void QTestMetricsReporter::test_result(const TestResult& result)
+{
+	if (result.skipped) return;
+	double seconds = result.duration / 1e9;
+	tests++;
+	tests_duration += seconds;
+	for (size_t i=0;i<std::size(buckets);i++) {
+		if (seconds <= buckets[i]) bucket_counts[i]++;
+	}
+	std::string labels = "describe=\"" + metrics_label(result.suite) + "\",test=\"" + metrics_label(result.name)
+		+ "\",line=\"" + std::to_string(result.line) + "\"";
+	// The IT_EACH rows share the line and may share the name, so the tests met
+	// with the same labels are numbered, the collector rejects the file with
+	// the duplicate series.
+	labels += ",occurrence=\"" + std::to_string(occurrences[labels]++) + "\"";
+	auto sample = [&labels](std::string& samples, std::string_view name, std::string extra, double value) {
+		samples += std::string(name) + "{" + labels + extra + "} " + metrics_value(value) + "\n";
+	};
+	if (result.benchmark) {
+		const BenchmarkStats& b = *result.benchmark;
+		sample(benchmarks, "qtest_benchmark_seconds", ",stat=\"median\"", b.median / 1e9);
+		sample(benchmarks, "qtest_benchmark_seconds", ",stat=\"mean\"", b.mean / 1e9);
+		sample(benchmarks, "qtest_benchmark_seconds", ",stat=\"min\"", b.min / 1e9);
+		sample(benchmarks, "qtest_benchmark_seconds", ",stat=\"stddev\"", b.stddev / 1e9);
+	}
+	if (result.resources && result.resources->available) {
+		const ResourceUsage& r = *result.resources;
+		sample(page_faults, "qtest_test_page_faults", ",type=\"minor\"", r.minor_faults);
+		sample(page_faults, "qtest_test_page_faults", ",type=\"major\"", r.major_faults);
+		sample(context_switches, "qtest_test_context_switches", ",type=\"voluntary\"", r.voluntary_switches);
+		sample(context_switches, "qtest_test_context_switches", ",type=\"involuntary\"", r.involuntary_switches);
+		sample(io_bytes, "qtest_test_io_bytes", ",direction=\"read\"", r.read_chars);
+		sample(io_bytes, "qtest_test_io_bytes", ",direction=\"write\"", r.write_chars);
+	}
+	if (result.allocations) {
+		sample(allocations, "qtest_test_allocations", "", result.allocations->count);
+		sample(allocated_bytes, "qtest_test_allocated_bytes", "", result.allocations->bytes);
+	}
+}
+
+inline void QTestMetricsReporter::family(std::string& res, std::string_view name, std::string_view type, std::string_view help, std::string& samples)
+{
+	if (samples.empty()) return;
+	res += "# TYPE " + std::string(name) + " " + std::string(type) + "\n# HELP " + std::string(name) + " " + std::string(help) + "\n" + samples;
+}
+
+inline void QTestMetricsReporter::statistics(const RunStatistics& stats)
+{
+	std::string res;
+	std::string samples = "qtest_tests{status=\"passed\"} " + std::to_string(stats.tests - stats.failed - stats.skipped) + "\n"
+		+ "qtest_tests{status=\"failed\"} " + std::to_string(stats.failed) + "\n"
+		+ "qtest_tests{status=\"skipped\"} " + std::to_string(stats.skipped) + "\n";
+	family(res, "qtest_tests", "gauge", "Tests of the last run by status.", samples);
+	samples = "qtest_run_duration_seconds " + metrics_value(stats.duration / 1e9) + "\n";
+	family(res, "qtest_run_duration_seconds", "gauge", "Duration of the last run.", samples);
+	samples = "qtest_hooks_duration_seconds " + metrics_value(stats.hooks_duration / 1e9) + "\n";
+	family(res, "qtest_hooks_duration_seconds", "gauge", "Time spent in the BEFORE and AFTER hooks.", samples);
+	samples.clear();
+	for (auto& [describe, seconds] : describe_durations) {
+		samples += "qtest_describe_duration_seconds{describe=\"" + metrics_label(describe) + "\"} " + metrics_value(seconds) + "\n";
+	}
+	family(res, "qtest_describe_duration_seconds", "gauge", "Duration of the describe with its nested describes.", samples);
+	samples.clear();
+	for (size_t i=0;i<std::size(buckets);i++) {
+		samples += "qtest_test_duration_seconds_bucket{le=\"" + metrics_value(buckets[i]) + "\"} " + std::to_string(bucket_counts[i]) + "\n";
+	}
+	samples += "qtest_test_duration_seconds_bucket{le=\"+Inf\"} " + std::to_string(tests) + "\n"
+		+ "qtest_test_duration_seconds_sum " + metrics_value(tests_duration) + "\n"
+		+ "qtest_test_duration_seconds_count " + std::to_string(tests) + "\n";
+	family(res, "qtest_test_duration_seconds", "histogram", "Durations of the tests with their hooks.", samples);
+	family(res, "qtest_benchmark_seconds", "gauge", "Benchmark iteration time.", benchmarks);
+	family(res, "qtest_test_page_faults", "gauge", "Page faults of the test.", page_faults);
+	family(res, "qtest_test_context_switches", "gauge", "Context switches of the test.", context_switches);
+	family(res, "qtest_test_io_bytes", "gauge", "Bytes passed to the read and write calls during the test.", io_bytes);
+	family(res, "qtest_test_allocations", "gauge", "Allocations made by the test.", allocations);
+	family(res, "qtest_test_allocated_bytes", "gauge", "Bytes allocated by the test.", allocated_bytes);
+	res += "# EOF\n";
+
+	std::string tmp = path + ".tmp";
+	std::FILE* file = std::fopen(tmp.c_str(), "w");
+	if (!file) return;
+	bool written = std::fwrite(res.data(), 1, res.size(), file) == res.size();
+	written &= std::fclose(file) == 0;
+	#ifdef _WIN32
+	written = written && MoveFileExA(tmp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+	#else
+	written = written && std::rename(tmp.c_str(), path.c_str()) == 0;
+	#endif
+	if (!written) std::remove(tmp.c_str());
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTMETRICS_H
@@ -0,0 +1,173 @@
+#ifndef QTESTPERF_H
+#define QTESTPERF_H
+
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+// Counters are counted in the user space of the calling thread only.
+// `opened` has the bit set for every counter supported by the machine.
+struct PerfCounters {
+	bool available = false;
+	unsigned opened = 0;
+	uint64_t cycles = 0;
+	uint64_t instructions = 0;
+	uint64_t branch_misses = 0;
+	uint64_t l1d_misses = 0;
+	uint64_t llc_misses = 0;
+	uint64_t dtlb_misses = 0;
+};
+
+class QTestPerf
+{
+	static constexpr int counters_count = 6;
+
+	public:
+		QTestPerf();
+		~QTestPerf();
+		QTestPerf(const QTestPerf&) = delete;
+		QTestPerf& operator=(const QTestPerf&) = delete;
+
+		bool is_available();
+		void start();
+		PerfCounters stop();
+
+	private:
+		int fds[counters_count] = {-1, -1, -1, -1, -1, -1};
+};
+
+inline QTestPerf::QTestPerf()
+{
+	#ifdef __linux__
+	constexpr uint64_t read_miss = PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+	const std::pair<uint32_t, uint64_t> configs[counters_count] = {
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+		{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | read_miss},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | read_miss},
+		{PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | read_miss},
+	};
+	for (int i=0;i<counters_count;i++) {
+		perf_event_attr attr;
+		std::memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = configs[i].first;
+		attr.config = configs[i].second;
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+	#endif
+}
+
+inline QTestPerf::~QTestPerf()
+{
+	#ifdef __linux__
+	for (int fd : fds) {
+		if (fd >= 0) close(fd);
+	}
+	#endif
+}
+
+inline bool QTestPerf::is_available()
+{
+	for (int fd : fds) {
+		if (fd >= 0) return true;
+	}
+	return false;
+}
+
+inline void QTestPerf::start()
+{
+	#ifdef __linux__
+	for (int fd : fds) {
+		if (fd < 0) continue;
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+	#endif
+}
+
+// Values are scaled by the enabled to running time ratio, as the kernel
+// multiplexes the counters if there are more of them than the hardware has.
+inline PerfCounters QTestPerf::stop()
+{
+	PerfCounters counters;
+	#ifdef __linux__
+	uint64_t PerfCounters::* fields[counters_count] = {
+		&PerfCounters::cycles, &PerfCounters::instructions, &PerfCounters::branch_misses,
+		&PerfCounters::l1d_misses, &PerfCounters::llc_misses, &PerfCounters::dtlb_misses,
+	};
+	for (int i=0;i<counters_count;i++) {
+		if (fds[i] >= 0) ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+	for (int i=0;i<counters_count;i++) {
+		uint64_t data[3];
+		if (fds[i] < 0 || read(fds[i], data, sizeof(data)) != sizeof(data)) continue;
+		counters.*fields[i] = data[2] ? (uint64_t)((double)data[0] * data[1] / data[2]) : 0;
+		counters.opened |= 1u << i;
+	}
+	counters.available = counters.opened != 0;
+	#endif
+	return counters;
+}
+
+template<typename F>
+PerfCounters measure_perf_counters(F&& fn)
+{
+	QTestPerf perf;
+	perf.start();
+	fn();
+	return perf.stop();
+}
+
+inline std::string format_count(uint64_t value)
+{
+	const char* prefixes[] = {"", " k", " M", " G", " T"};
+	if (value < 1000) return std::to_string(value);
+	double v = value;
+	int i = 0;
+	while (v >= 1000 && i < 4) {
+		v /= 1000;
+		i++;
+	}
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.2f%s", v, prefixes[i]);
+	return buf;
+}
+
+inline std::string generate_perf_counters_text(PerfCounters& counters)
+{
+	const char* names[] = {"cycles", "instructions", "branch misses", "L1d misses", "LLC misses", "dTLB misses"};
+	uint64_t values[] = {counters.cycles, counters.instructions, counters.branch_misses, counters.l1d_misses, counters.llc_misses, counters.dtlb_misses};
+	std::string res;
+	for (int i=0;i<6;i++) {
+		if (!(counters.opened & (1u << i))) continue;
+		if (!res.empty()) res += ", ";
+		res += names[i] + std::string(" ") + format_count(values[i]);
+		if (i == 1 && (counters.opened & 1u) && counters.cycles) {
+			char ipc[32];
+			std::snprintf(ipc, sizeof(ipc), " (IPC %.2f)", (double)counters.instructions / counters.cycles);
+			res += ipc;
+		}
+	}
+	return res;
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTPERF_H
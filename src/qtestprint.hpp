@@ -2,7 +2,13 @@
 #define QTESTPRINT_H
 
 #ifdef _WIN32
-// For windows
+// For windows, the min and max macros break std::min and std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
 #include <windows.h>
 #else
 // For unix
@@ -33,8 +39,12 @@ class QTestPrint
 		void print_test(std::string_view str, bool good, bool skipped);
 		void print_test_info(std::string_view arr);
 		void print_test_error(std::string_view s);
+		void print_benchmark(std::string_view s);
+		void print_test_stats(std::string_view s);
+		void print_describe_stats(std::string_view descr, std::string_view s);
 		void print_failed_test(std::string_view str, std::string_view file, int line);
 		void print_statistics(int tests_count, int tests_failed, int tests_skipped);
+		void print_top_allocations(std::vector<std::string>& lines);
 		void print_start();
 		void print_title(std::string_view str);
 		void print_delimeter();
@@ -66,6 +76,7 @@ class QTestPrint
 		static constexpr std::string_view skipped_txt = "skipped";
 		static constexpr std::string_view statistics_txt = "statistics";
 		static constexpr std::string_view testing_txt = "testing";
+		static constexpr std::string_view allocations_txt = "top allocations";
 		static constexpr std::string_view succ_sign = "[/]";
 		static constexpr std::string_view fail_sign = "[x]";
 		static constexpr std::string_view skip_sign = "[-]";
@@ -136,6 +147,30 @@ inline void QTestPrint::print_test_error(std::string_view s)
 	print(newline);
 }
 
+inline void QTestPrint::print_benchmark(std::string_view s)
+{
+	print("        ");
+	print(" - ");
+	print_neutral(s);
+	print(newline);
+}
+
+inline void QTestPrint::print_test_stats(std::string_view s)
+{
+	print("        ");
+	print(" # ");
+	print_grey(s);
+	print(newline);
+}
+
+inline void QTestPrint::print_describe_stats(std::string_view descr, std::string_view s)
+{
+	print("    ");
+	print(" # ");
+	print_grey(std::string(descr) + "total: " + std::string(s));
+	print(newline);
+}
+
 inline void QTestPrint::print_failed_test(std::string_view str, std::string_view file, int line)
 {
 	print(tab);
@@ -193,6 +228,18 @@ inline void QTestPrint::print_statistics(int tests_count, int tests_failed, int
 	print(newline);
 }
 
+inline void QTestPrint::print_top_allocations(std::vector<std::string>& lines)
+{
+	print_title(toupper(allocations_txt));
+	print(newline);
+	for (auto& line : lines) {
+		print(" ");
+		print_grey(line);
+		print(newline);
+	}
+	print(newline);
+}
+
 inline void QTestPrint::print_start()
 {
 	print_delimeter("_");
@@ -0,0 +1,213 @@
+#ifndef QTESTPROFILE_H
+#define QTESTPROFILE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <fstream>
+#include <atomic>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include "qtestalloc.hpp"
+#include "qtestrealtime.hpp"
+
+#ifndef TEST_PROFILE_HZ
+#define TEST_PROFILE_HZ 1000
+#endif
+
+#if defined(Q_TEST__HAS_BACKTRACE) && defined(__linux__) && defined(__GLIBC__)
+#include <signal.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#define Q_TEST__HAS_PROFILER
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+struct ProfileSample {
+	static constexpr int max_depth = 48;
+	void* frames[max_depth];
+	int depth;
+};
+
+// Samples the CPU time of the thread that runs the tests with SIGPROF. The
+// signal handler only copies the stack into the preallocated buffer, the
+// symbols are resolved and folded after the test.
+class QTestProfiler
+{
+	static constexpr size_t max_samples = 8192;
+
+	public:
+		QTestProfiler(std::string path);
+		~QTestProfiler();
+		QTestProfiler(const QTestProfiler&) = delete;
+		QTestProfiler& operator=(const QTestProfiler&) = delete;
+
+		bool is_available() { return available; }
+		void start();
+		void stop();
+		size_t write(const std::string& test);
+
+	private:
+		static void handler(int);
+		std::string symbol(void* addr);
+
+		std::ofstream out;
+		std::unique_ptr<ProfileSample[]> samples;
+		std::atomic<size_t> count{0};
+		std::unordered_map<void*, std::string> symbols;
+		void* base_frames[ProfileSample::max_depth];
+		int base_depth = 0;
+		bool available = false;
+		#ifdef Q_TEST__HAS_PROFILER
+		timer_t timer;
+		struct sigaction previous = {};
+		bool installed = false;
+		#endif
+};
+
+inline QTestProfiler* profiler = nullptr;
+
+inline QTestProfiler::QTestProfiler(std::string path) : out(path, std::ios::trunc), samples(new ProfileSample[max_samples])
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	struct sigaction sa = {};
+	sa.sa_handler = handler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigevent sev = {};
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+	// glibc names the thread id field only since 2.41
+	sev._sigev_un._tid = (pid_t)syscall(SYS_gettid);
+	installed = out && sigaction(SIGPROF, &sa, &previous) == 0;
+	available = installed && timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &timer) == 0;
+	// The first backtrace call loads the unwinder, which is not signal safe.
+	void* frame;
+	backtrace(&frame, 1);
+	#endif
+}
+
+inline QTestProfiler::~QTestProfiler()
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	if (available) timer_delete(timer);
+	// The handler of the program is put back once the timer can not fire
+	if (installed) sigaction(SIGPROF, &previous, nullptr);
+	#endif
+}
+
+inline void QTestProfiler::handler(int)
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	QTestProfiler* p = profiler;
+	if (!p) return;
+	size_t i = p->count.fetch_add(1, std::memory_order_relaxed);
+	if (i >= max_samples) return;
+	p->samples[i].depth = backtrace(p->samples[i].frames, ProfileSample::max_depth);
+	#endif
+}
+
+// The stack of the caller is remembered, so its frames can be cut off from
+// every sample, and the folded stacks start from the test body.
+inline void QTestProfiler::start()
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	base_depth = backtrace(base_frames, ProfileSample::max_depth);
+	count = 0;
+	long interval = 1000000000L / TEST_PROFILE_HZ;
+	itimerspec spec = {{0, interval}, {0, interval}};
+	timer_settime(timer, 0, &spec, nullptr);
+	#endif
+}
+
+inline void QTestProfiler::stop()
+{
+	#ifdef Q_TEST__HAS_PROFILER
+	itimerspec spec = {};
+	timer_settime(timer, 0, &spec, nullptr);
+	#endif
+}
+
+// The name of the function the address is in, or the object file with the
+// offset if the symbol is not exported (the executable is not linked with
+// -rdynamic).
+inline std::string address_symbol(void* addr)
+{
+	std::string name;
+	#ifdef Q_TEST__HAS_PROFILER
+	Dl_info info = {};
+	if (!dladdr(addr, &info)) return "??";
+	if (info.dli_sname) {
+		int status = 0;
+		char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+		name = status == 0 ? demangled : info.dli_sname;
+		std::free(demangled);
+	} else if (info.dli_fname) {
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "+0x%zx", (size_t)addr - (size_t)info.dli_fbase);
+		std::string file = info.dli_fname;
+		name = file.substr(file.find_last_of('/') + 1) + buf;
+	}
+	#else
+	(void)addr;
+	#endif
+	return name.empty() ? "??" : name;
+}
+
+// The folded format separates the frames with ';' and the stacks with the line
+// breaks, so neither can be in the frame name.
+inline std::string folded_frame(std::string name)
+{
+	for (char& c : name) {
+		if (c == ';' || c == '\n' || c == '\r') c = ',';
+	}
+	return name;
+}
+
+inline std::string QTestProfiler::symbol(void* addr)
+{
+	auto it = symbols.find(addr);
+	if (it != symbols.end()) return it->second;
+	return symbols[addr] = folded_frame(address_symbol(addr));
+}
+
+// Writes the folded stacks of the test with the test name as the root frame.
+// Frame 0 is the signal handler and frame 1 is the signal trampoline.
+inline size_t QTestProfiler::write(const std::string& test)
+{
+	AllocationPause pause;
+	size_t total = std::min<size_t>(count, max_samples);
+	std::map<std::string, size_t> folded;
+	for (size_t i=0;i<total;i++) {
+		ProfileSample& s = samples[i];
+		int depth = s.depth;
+		// Cuts off the common outermost frames, except the frame that called start
+		int common = 0;
+		while (common < depth - 2 && common < base_depth - 1 && s.frames[depth - 1 - common] == base_frames[base_depth - 1 - common]) {
+			common++;
+		}
+		std::string stack = folded_frame(test);
+		for (int f=depth-1-common;f>=2;f--) {
+			// Return addresses point after the call instruction
+			stack += ";" + symbol((char*)s.frames[f] - (f > 2 ? 1 : 0));
+		}
+		folded[stack]++;
+	}
+	for (auto& [stack, n] : folded) {
+		out << stack << ' ' << n << '\n';
+	}
+	out.flush();
+	return total;
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTPROFILE_H
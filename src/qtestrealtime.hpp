@@ -0,0 +1,167 @@
+#ifndef QTESTREALTIME_H
+#define QTESTREALTIME_H
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+
+#if __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define Q_TEST__HAS_BACKTRACE
+#endif
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#if defined(__GLIBC__) && defined(__linux__)
+#include <dlfcn.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <unistd.h>
+#include <time.h>
+#define Q_TEST__HAS_REALTIME_HOOKS
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+struct RealtimeViolation {
+	const char* call = nullptr;
+	void* frames[8] = {};
+	int depth = 0;
+};
+
+// Violations are recorded by the hooks while the scope is active on the
+// calling thread, into the fixed storage, as the hooks can't allocate.
+class RealtimeScope
+{
+	static constexpr int max_violations = 8;
+
+	public:
+		template<typename F> void run(F&& fn);
+		RealtimeViolation* add(const char* call);
+		bool is_safe() { return !violations_count && !context_switches; }
+		int count() { return violations_count; }
+		RealtimeViolation& violation(int i) { return violations[i]; }
+		long blocked() { return context_switches; }
+
+	private:
+		RealtimeViolation violations[max_violations];
+		int violations_count = 0;
+		long context_switches = 0;
+};
+
+inline thread_local RealtimeScope* realtime_scope = nullptr;
+
+inline long voluntary_context_switches()
+{
+	#if defined(__linux__) && defined(RUSAGE_THREAD)
+	rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) == 0) return usage.ru_nvcsw;
+	#endif
+	return 0;
+}
+
+template<typename F>
+void RealtimeScope::run(F&& fn)
+{
+	#ifdef Q_TEST__HAS_BACKTRACE
+	// The first backtrace call loads the unwinder, which allocates.
+	static bool warmed_up = [] { void* frame; return backtrace(&frame, 1) >= 0; }();
+	(void)warmed_up;
+	#endif
+	long switches = voluntary_context_switches();
+	realtime_scope = this;
+	fn();
+	realtime_scope = nullptr;
+	context_switches = voluntary_context_switches() - switches;
+}
+
+inline RealtimeViolation* RealtimeScope::add(const char* call)
+{
+	if (violations_count >= max_violations) return nullptr;
+	RealtimeViolation* v = &violations[violations_count++];
+	v->call = call;
+	return v;
+}
+
+// Called by every hook. The scope is detached while the violation is recorded,
+// so the calls made by the recording itself are not reported.
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+inline void realtime_violation(const char* call)
+{
+	RealtimeScope* scope = realtime_scope;
+	if (!scope) return;
+	realtime_scope = nullptr;
+	RealtimeViolation* v = scope->add(call);
+	#ifdef Q_TEST__HAS_BACKTRACE
+	if (v) v->depth = backtrace(v->frames, 8);
+	#else
+	(void)v;
+	#endif
+	realtime_scope = scope;
+}
+
+inline std::string generate_realtime_hint(RealtimeScope& scope)
+{
+	std::string res;
+	for (int i=0;i<scope.count();i++) {
+		RealtimeViolation& v = scope.violation(i);
+		if (!res.empty()) res += "\n";
+		res += v.call + std::string(" was called");
+		#ifdef Q_TEST__HAS_BACKTRACE
+		// The first frame is realtime_violation itself.
+		char** symbols = backtrace_symbols(v.frames, v.depth);
+		for (int f=1;symbols && f<v.depth;f++) {
+			res += "\n    " + std::string(symbols[f]);
+		}
+		std::free(symbols);
+		#endif
+	}
+	if (scope.blocked()) {
+		if (!res.empty()) res += "\n";
+		res += "the thread blocked " + std::to_string(scope.blocked()) + " times (voluntary context switches)";
+	}
+	return res;
+}
+
+// Resolves the function the hook replaced. The cache is constant initialized,
+// so no static guard (which may lock the mutex the hook is called for) is used.
+template<typename T>
+T realtime_next(const char* name, T& cache)
+{
+	#ifdef Q_TEST__HAS_REALTIME_HOOKS
+	if (!cache) cache = reinterpret_cast<T>(dlsym(RTLD_NEXT, name));
+	#else
+	(void)name;
+	#endif
+	return cache;
+}
+
+} // Q_TEST_NS_DETAIL
+
+// Replacement functions can't be inline, so they are defined only in the
+// translation unit that defines TEST_REALTIME_SAFETY. The lock hooks are in
+// qtestlocks.hpp, as the lock profiler uses them too.
+#if defined(TEST_REALTIME_SAFETY) && defined(Q_TEST__HAS_REALTIME_HOOKS)
+#define Q_TEST__REALTIME_HOOK(ret, name, params, args, spec) \
+	extern "C" ret name params spec \
+	{ \
+		static ret (*next) params = nullptr; \
+		Q_TEST_NS_DETAIL::realtime_violation(#name); \
+		return Q_TEST_NS_DETAIL::realtime_next(#name, next) args; \
+	}
+
+Q_TEST__REALTIME_HOOK(int, pthread_join, (pthread_t t, void** r), (t, r), noexcept(false))
+Q_TEST__REALTIME_HOOK(int, sem_wait, (sem_t* s), (s), noexcept(false))
+Q_TEST__REALTIME_HOOK(int, sched_yield, (), (), noexcept(true))
+Q_TEST__REALTIME_HOOK(int, nanosleep, (const timespec* t, timespec* r), (t, r), noexcept(false))
+Q_TEST__REALTIME_HOOK(int, usleep, (useconds_t t), (t), noexcept(false))
+Q_TEST__REALTIME_HOOK(ssize_t, read, (int fd, void* buf, size_t n), (fd, buf, n), noexcept(false))
+Q_TEST__REALTIME_HOOK(ssize_t, write, (int fd, const void* buf, size_t n), (fd, buf, n), noexcept(false))
+#endif
+
+#endif // QTESTREALTIME_H
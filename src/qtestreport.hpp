@@ -0,0 +1,298 @@
+#ifndef QTESTREPORT_H
+#define QTESTREPORT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "qtestexpect.hpp"
+#include "qtestbench.hpp"
+#include "qtestalloc.hpp"
+#include "qtestresource.hpp"
+#include "qtesttrace.hpp"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+// The error is set for the failed tests only. The message is the same
+// EXPECT(...) FAILED! line the console shows. The stats are set only if they
+// were collected.
+struct TestResult {
+	std::string_view suite;
+	std::string_view name;
+	std::string_view file;
+	int line = 0;
+	bool passed = true;
+	bool skipped = false;
+	double duration = 0;
+	std::string_view expect;
+	const ErrorReport* error = nullptr;
+	std::string_view message;
+	const BenchmarkStats* benchmark = nullptr;
+	const ResourceUsage* resources = nullptr;
+	const AllocationStats* allocations = nullptr;
+};
+
+struct RunStatistics {
+	int tests = 0;
+	int failed = 0;
+	int skipped = 0;
+	double duration = 0;
+	double hooks_duration = 0;
+};
+
+// Receives the events of the run as they happen. Durations are in nanoseconds.
+class QTestReporter
+{
+	public:
+		virtual ~QTestReporter() = default;
+		virtual void run_start() {}
+		virtual void describe_enter(std::string_view) {}
+		virtual void describe_leave(std::string_view) {}
+		virtual void test_result(const TestResult&) {}
+		virtual void statistics(const RunStatistics&) {}
+};
+
+// The file path, or "fd:N" for the already open file descriptor (e.g. the
+// pipe of the CI runner). Every event is flushed as soon as it is written, so
+// the report is never kept in memory.
+class ReportStream
+{
+	public:
+		ReportStream(std::string_view target);
+		~ReportStream();
+		ReportStream(const ReportStream&) = delete;
+		ReportStream& operator=(const ReportStream&) = delete;
+
+		void write(std::string_view s);
+
+	private:
+		std::FILE* file = nullptr;
+};
+
+class QTestJUnitReporter : public QTestReporter
+{
+	public:
+		QTestJUnitReporter(std::string_view target);
+		void run_start() override;
+		void test_result(const TestResult& result) override;
+		void statistics(const RunStatistics& stats) override;
+
+	private:
+		ReportStream out;
+};
+
+class QTestJsonReporter : public QTestReporter
+{
+	public:
+		QTestJsonReporter(std::string_view target) : out(target) {}
+		void run_start() override;
+		void describe_enter(std::string_view name) override;
+		void describe_leave(std::string_view name) override;
+		void test_result(const TestResult& result) override;
+		void statistics(const RunStatistics& stats) override;
+
+	private:
+		ReportStream out;
+		int depth = 0;
+};
+
+class QTestTapReporter : public QTestReporter
+{
+	public:
+		QTestTapReporter(std::string_view target) : out(target) {}
+		void run_start() override;
+		void describe_enter(std::string_view name) override;
+		void test_result(const TestResult& result) override;
+		void statistics(const RunStatistics& stats) override;
+
+	private:
+		ReportStream out;
+		int number = 0;
+};
+
+inline ReportStream::ReportStream(std::string_view target)
+{
+	std::string path(target);
+	if (path.rfind("fd:", 0) == 0) {
+		int fd = std::atoi(path.c_str() + 3);
+		#ifdef _WIN32
+		file = _fdopen(_dup(fd), "w");
+		#else
+		file = fdopen(dup(fd), "w");
+		#endif
+	} else {
+		file = std::fopen(path.c_str(), "w");
+	}
+}
+
+inline ReportStream::~ReportStream()
+{
+	if (file) std::fclose(file);
+}
+
+inline void ReportStream::write(std::string_view s)
+{
+	if (!file) return;
+	std::fwrite(s.data(), 1, s.size(), file);
+	std::fflush(file);
+}
+
+// XML 1.0 can't hold the control characters even escaped.
+inline std::string xml_escape(std::string_view str)
+{
+	std::string res;
+	for (char c : str) {
+		switch (c) {
+			case '&': res += "&amp;"; break;
+			case '<': res += "&lt;"; break;
+			case '>': res += "&gt;"; break;
+			case '"': res += "&quot;"; break;
+			case '\'': res += "&apos;"; break;
+			case '\n': case '\t': res.push_back(c); break;
+			default: res.push_back((unsigned char)c < 0x20 ? '?' : c);
+		}
+	}
+	return res;
+}
+
+inline std::string format_seconds(double ns)
+{
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%.6f", ns / 1e9);
+	return buf;
+}
+
+// The test counts of the suite are not known until the end of the run, so
+// they are left out, and the consumers count the test cases.
+inline QTestJUnitReporter::QTestJUnitReporter(std::string_view target) : out(target)
+{
+	out.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+}
+
+inline void QTestJUnitReporter::run_start()
+{
+	out.write("<testsuites name=\"QTest\">\n<testsuite name=\"QTest\">\n");
+}
+
+inline void QTestJUnitReporter::test_result(const TestResult& result)
+{
+	std::string res = "  <testcase classname=\"" + xml_escape(result.suite) + "\" name=\"" + xml_escape(result.name)
+		+ "\" file=\"" + xml_escape(result.file) + "\" line=\"" + std::to_string(result.line)
+		+ "\" time=\"" + format_seconds(result.duration) + "\"";
+	if (result.skipped) {
+		res += ">\n    <skipped/>\n  </testcase>\n";
+	} else if (result.error) {
+		res += ">\n    <failure message=\"" + xml_escape(result.message) + "\" type=\"" + xml_escape(result.error->func) + "\">"
+			+ xml_escape(result.error->hint) + "</failure>\n  </testcase>\n";
+	} else {
+		res += "/>\n";
+	}
+	out.write(res);
+}
+
+inline void QTestJUnitReporter::statistics(const RunStatistics&)
+{
+	out.write("</testsuite>\n</testsuites>\n");
+}
+
+inline void QTestJsonReporter::run_start()
+{
+	out.write("{\"event\":\"run_start\"}\n");
+}
+
+inline void QTestJsonReporter::describe_enter(std::string_view name)
+{
+	out.write("{\"event\":\"describe_enter\",\"name\":\"" + json_escape(name) + "\",\"depth\":" + std::to_string(++depth) + "}\n");
+}
+
+inline void QTestJsonReporter::describe_leave(std::string_view name)
+{
+	out.write("{\"event\":\"describe_leave\",\"name\":\"" + json_escape(name) + "\",\"depth\":" + std::to_string(depth--) + "}\n");
+}
+
+inline void QTestJsonReporter::test_result(const TestResult& result)
+{
+	auto str = [](std::string_view s) { return "\"" + json_escape(s) + "\""; };
+	std::string status = result.skipped ? "skipped" : (result.passed ? "passed" : "failed");
+	std::string res = "{\"event\":\"test\",\"suite\":" + str(result.suite) + ",\"name\":" + str(result.name)
+		+ ",\"file\":" + str(result.file) + ",\"line\":" + std::to_string(result.line)
+		+ ",\"status\":\"" + status + "\",\"duration_ns\":" + std::to_string((uint64_t)result.duration);
+	if (result.error) {
+		const ErrorReport& e = *result.error;
+		res += ",\"message\":" + str(result.message) + ",\"expect\":" + str(result.expect) + ",\"func\":" + str(e.func)
+			+ ",\"inverse\":" + (e.inverse ? "true" : "false");
+		if (e.value_substituted) res += ",\"value\":" + str(e.value);
+		if (e.compare_substituted) res += ",\"compare\":" + str(e.compare);
+		if (!e.hint.empty()) res += ",\"hint\":" + str(e.hint);
+	}
+	out.write(res + "}\n");
+}
+
+inline void QTestJsonReporter::statistics(const RunStatistics& stats)
+{
+	out.write("{\"event\":\"statistics\",\"tests\":" + std::to_string(stats.tests) + ",\"failed\":" + std::to_string(stats.failed)
+		+ ",\"skipped\":" + std::to_string(stats.skipped) + ",\"duration_ns\":" + std::to_string((uint64_t)stats.duration) + "}\n");
+}
+
+// The TAP description ends at the line break, and the hash sign starts the
+// directive, so both are escaped.
+inline std::string tap_escape(std::string_view str)
+{
+	std::string res;
+	for (char c : str) {
+		if (c == '#' || c == '\\') res.push_back('\\');
+		res.push_back(c == '\n' || c == '\r' ? ' ' : c);
+	}
+	return res;
+}
+
+inline void QTestTapReporter::run_start()
+{
+	out.write("TAP version 13\n");
+}
+
+inline void QTestTapReporter::describe_enter(std::string_view name)
+{
+	out.write("# " + tap_escape(name) + "\n");
+}
+
+// The diagnostics are the YAML block, the JSON strings are valid YAML scalars.
+inline void QTestTapReporter::test_result(const TestResult& result)
+{
+	std::string name = result.suite.empty() ? std::string(result.name) : std::string(result.suite) + " " + std::string(result.name);
+	std::string res = (result.passed ? "ok " : "not ok ") + std::to_string(++number) + " - " + tap_escape(name);
+	if (result.skipped) res += " # SKIP";
+	res += "\n";
+	if (result.error) {
+		res += "  ---\n  message: \"" + json_escape(result.message) + "\"\n  severity: fail\n"
+			+ "  at:\n    file: \"" + json_escape(result.file) + "\"\n    line: " + std::to_string(result.line) + "\n";
+		if (!result.error->hint.empty()) res += "  hint: \"" + json_escape(result.error->hint) + "\"\n";
+		res += "  ...\n";
+	}
+	out.write(res);
+}
+
+inline void QTestTapReporter::statistics(const RunStatistics& stats)
+{
+	out.write("1.." + std::to_string(stats.tests) + "\n");
+}
+
+} // Q_TEST_NS_DETAIL
+
+namespace QTest {
+	using Reporter = Q_TEST_NS_DETAIL::QTestReporter;
+	using TestResult = Q_TEST_NS_DETAIL::TestResult;
+	using RunStatistics = Q_TEST_NS_DETAIL::RunStatistics;
+}
+
+#endif // QTESTREPORT_H
@@ -0,0 +1,98 @@
+#ifndef QTESTRERUN_H
+#define QTESTRERUN_H
+
+#include <string>
+#include <string_view>
+#include <set>
+#include <fstream>
+
+#if (defined(TEST_FAILED_FIRST) || defined(TEST_FAILED_ONLY)) && !defined(TEST_FAILED_STATE)
+#define TEST_FAILED_STATE ".qtest_failed"
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+// Keeps the ids of the failed tests between the runs, one per line. The tests
+// that didn't run this time (filtered or skipped) keep their previous state,
+// and the ids no test matched (the test was moved or renamed) are dropped.
+class QTestRerunState
+{
+	public:
+		enum class Pass{All, Failed, First};
+
+		QTestRerunState(std::string path);
+
+		bool has_failed() { return !previous.empty(); }
+		void set_pass(Pass p) { pass = p; }
+		bool has_matched() { return !matched.empty(); }
+		bool filtered(const std::string& id);
+		bool deferred(const std::string& id);
+		void record(const std::string& id, bool passed);
+		void save();
+
+	private:
+		std::string path;
+		std::set<std::string> previous;
+		std::set<std::string> matched;
+		std::set<std::string> ran;
+		std::set<std::string> failed;
+		Pass pass = Pass::All;
+};
+
+inline QTestRerunState* rerun = nullptr;
+
+// The id can't hold the line break, so it is escaped.
+inline std::string rerun_test_id(std::string_view describes, std::string_view test, int line)
+{
+	std::string res;
+	for (char c : std::string(describes) + std::string(test)) {
+		if (c == '\\') res += "\\\\";
+		else if (c == '\n') res += "\\n";
+		else res.push_back(c);
+	}
+	return res + ":" + std::to_string(line);
+}
+
+inline QTestRerunState::QTestRerunState(std::string path) : path(path)
+{
+	std::ifstream in(path);
+	std::string line;
+	while (std::getline(in, line)) {
+		if (!line.empty()) previous.insert(line);
+	}
+}
+
+// Every id the tests have is passed here, the filtered ones as well.
+inline bool QTestRerunState::filtered(const std::string& id)
+{
+	bool failed = previous.count(id);
+	if (failed) matched.insert(id);
+	return pass == Pass::Failed && !failed;
+}
+
+// The tests that passed last time run after the failed ones of their describe.
+inline bool QTestRerunState::deferred(const std::string& id)
+{
+	return pass == Pass::First && !previous.count(id);
+}
+
+inline void QTestRerunState::record(const std::string& id, bool passed)
+{
+	ran.insert(id);
+	if (!passed) failed.insert(id);
+}
+
+inline void QTestRerunState::save()
+{
+	std::ofstream out(path, std::ios::trunc);
+	for (auto& id : previous) {
+		if (matched.count(id) && !ran.count(id)) out << id << '\n';
+	}
+	for (auto& id : failed) {
+		out << id << '\n';
+	}
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTRERUN_H
@@ -0,0 +1,130 @@
+#ifndef QTESTRESOURCE_H
+#define QTESTRESOURCE_H
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+
+#include "qtestalloc.hpp"
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+// Faults and context switches are counted for the calling thread only, the
+// I/O bytes for the whole process. `read_chars` and `write_chars` are the
+// bytes passed to the read and write syscalls, `read_bytes` and `write_bytes`
+// are the bytes that really hit the storage.
+struct ResourceUsage {
+	bool available = false;
+	uint64_t minor_faults = 0;
+	uint64_t major_faults = 0;
+	uint64_t voluntary_switches = 0;
+	uint64_t involuntary_switches = 0;
+	uint64_t read_chars = 0;
+	uint64_t write_chars = 0;
+	uint64_t read_bytes = 0;
+	uint64_t write_bytes = 0;
+
+	ResourceUsage& operator+=(const ResourceUsage& other);
+	ResourceUsage operator-(const ResourceUsage& other) const;
+};
+
+inline ResourceUsage& ResourceUsage::operator+=(const ResourceUsage& other)
+{
+	available |= other.available;
+	minor_faults += other.minor_faults;
+	major_faults += other.major_faults;
+	voluntary_switches += other.voluntary_switches;
+	involuntary_switches += other.involuntary_switches;
+	read_chars += other.read_chars;
+	write_chars += other.write_chars;
+	read_bytes += other.read_bytes;
+	write_bytes += other.write_bytes;
+	return *this;
+}
+
+inline ResourceUsage ResourceUsage::operator-(const ResourceUsage& other) const
+{
+	auto diff = [](uint64_t a, uint64_t b) { return a > b ? a - b : 0; };
+	ResourceUsage res;
+	res.available = available && other.available;
+	res.minor_faults = diff(minor_faults, other.minor_faults);
+	res.major_faults = diff(major_faults, other.major_faults);
+	res.voluntary_switches = diff(voluntary_switches, other.voluntary_switches);
+	res.involuntary_switches = diff(involuntary_switches, other.involuntary_switches);
+	res.read_chars = diff(read_chars, other.read_chars);
+	res.write_chars = diff(write_chars, other.write_chars);
+	res.read_bytes = diff(read_bytes, other.read_bytes);
+	res.write_bytes = diff(write_bytes, other.write_bytes);
+	return res;
+}
+
+// Bytes read from /proc/self/io by the framework itself, subtracted from the
+// read counter, so the measurement doesn't show up in its own result.
+inline std::atomic<uint64_t> resource_usage_own_reads{0};
+
+inline ResourceUsage read_resource_usage()
+{
+	ResourceUsage usage;
+	#if defined(__linux__) && defined(RUSAGE_THREAD)
+	rusage ru;
+	if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+		usage.available = true;
+		usage.minor_faults = ru.ru_minflt;
+		usage.major_faults = ru.ru_majflt;
+		usage.voluntary_switches = ru.ru_nvcsw;
+		usage.involuntary_switches = ru.ru_nivcsw;
+	}
+	int fd = open("/proc/self/io", O_RDONLY);
+	if (fd >= 0) {
+		char buf[512];
+		uint64_t own_reads = resource_usage_own_reads.load();
+		ssize_t n = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (n > 0) {
+			resource_usage_own_reads += n;
+			buf[n] = 0;
+			auto field = [&buf](const char* key) -> uint64_t {
+				const char* line = std::strstr(buf, key);
+				return line ? std::strtoull(line + std::strlen(key), nullptr, 10) : 0;
+			};
+			usage.read_chars = field("rchar:") - own_reads;
+			usage.write_chars = field("wchar:");
+			usage.read_bytes = field("\nread_bytes:");
+			usage.write_bytes = field("\nwrite_bytes:");
+		}
+	}
+	#endif
+	return usage;
+}
+
+template<typename F>
+ResourceUsage measure_resource_usage(F&& fn)
+{
+	ResourceUsage start = read_resource_usage();
+	fn();
+	return read_resource_usage() - start;
+}
+
+inline std::string generate_resource_usage_text(ResourceUsage& usage)
+{
+	auto io = [](uint64_t chars, uint64_t bytes) {
+		std::string res = format_bytes(chars);
+		if (bytes) res += " (" + format_bytes(bytes) + " storage)";
+		return res;
+	};
+	return "page faults " + std::to_string(usage.minor_faults) + " minor, " + std::to_string(usage.major_faults) + " major"
+		+ ", context switches " + std::to_string(usage.voluntary_switches) + " voluntary, " + std::to_string(usage.involuntary_switches) + " involuntary"
+		+ ", read " + io(usage.read_chars, usage.read_bytes) + ", written " + io(usage.write_chars, usage.write_bytes);
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTRESOURCE_H
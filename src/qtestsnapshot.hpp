@@ -0,0 +1,180 @@
+#ifndef QTESTSNAPSHOT_H
+#define QTESTSNAPSHOT_H
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <algorithm>
+
+#include "qtestutils.hpp"
+
+namespace Q_TEST_NS_DETAIL {
+
+// Read only memory mapping of the whole file.
+class QTestMappedFile
+{
+	public:
+		QTestMappedFile(const std::string& path);
+		~QTestMappedFile();
+		QTestMappedFile(const QTestMappedFile&) = delete;
+		QTestMappedFile& operator=(const QTestMappedFile&) = delete;
+
+		bool is_open() { return opened; }
+		std::string_view view() { return std::string_view(data, size); }
+
+	private:
+		#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+		#else
+		int fd = -1;
+		#endif
+		const char* data = nullptr;
+		size_t size = 0;
+		bool opened = false;
+};
+
+struct SnapshotResult {
+	bool exists = false;
+	bool equal = false;
+	size_t offset = 0;
+	std::string hint = {};
+};
+
+inline QTestMappedFile::QTestMappedFile(const std::string& path)
+{
+	#ifdef _WIN32
+	file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return;
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) return;
+	size = (size_t)file_size.QuadPart;
+	opened = true;
+	if (!size) return;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping) {
+		data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	opened = data != nullptr;
+	#else
+	fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return;
+	struct stat st;
+	if (fstat(fd, &st) != 0) return;
+	size = (size_t)st.st_size;
+	opened = true;
+	if (!size) return;
+	void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (ptr == MAP_FAILED) {
+		opened = false;
+		return;
+	}
+	madvise(ptr, size, MADV_SEQUENTIAL);
+	data = static_cast<const char*>(ptr);
+	#endif
+}
+
+inline QTestMappedFile::~QTestMappedFile()
+{
+	#ifdef _WIN32
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+	#else
+	if (data) munmap(const_cast<char*>(data), size);
+	if (fd >= 0) close(fd);
+	#endif
+}
+
+inline std::string_view snapshot_line_at(std::string_view str, size_t offset)
+{
+	offset = std::min(offset, str.size());
+	size_t from = str.rfind('\n', offset ? offset - 1 : 0);
+	from = (from == std::string_view::npos || from >= offset) ? 0 : from + 1;
+	size_t to = str.find('\n', offset);
+	if (to == std::string_view::npos) to = str.size();
+	constexpr size_t max_line = 120;
+	if (to - from > max_line) {
+		from = offset > max_line / 2 ? offset - max_line / 2 : 0;
+		to = std::min(str.size(), from + max_line);
+	}
+	return str.substr(from, to - from);
+}
+
+// Compares `actual` with the mapped snapshot chunk by chunk, so pages of the
+// golden file are streamed from the page cache once and never copied.
+inline SnapshotResult compare_snapshot(std::string_view actual, const std::string& path)
+{
+	SnapshotResult res;
+	QTestMappedFile file(path);
+	if (!file.is_open()) {
+		res.hint = "snapshot " + path + " can't be read";
+		return res;
+	}
+	res.exists = true;
+	std::string_view expected = file.view();
+
+	constexpr size_t chunk = 1 << 20;
+	size_t common = std::min(actual.size(), expected.size());
+	size_t offset = 0;
+	while (offset < common) {
+		size_t len = std::min(chunk, common - offset);
+		if (std::memcmp(actual.data() + offset, expected.data() + offset, len) != 0) {
+			auto diff = std::mismatch(actual.begin() + offset, actual.begin() + offset + len, expected.begin() + offset);
+			offset = diff.first - actual.begin();
+			break;
+		}
+		offset += len;
+	}
+	res.offset = offset;
+	res.equal = offset == common && actual.size() == expected.size();
+	if (res.equal) return res;
+
+	size_t line = 1 + std::count(expected.begin(), expected.begin() + offset, '\n');
+	std::string expected_line(snapshot_line_at(expected, offset));
+	std::string actual_line(snapshot_line_at(actual, offset));
+	res.hint = "first difference at offset " + std::to_string(offset) + " (line " + std::to_string(line) + "), sizes "
+		+ std::to_string(actual.size()) + " vs " + std::to_string(expected.size()) + " in " + path + "\n"
+		+ "-" + sanitize(expected_line) + "\n"
+		+ "+" + sanitize(actual_line);
+	return res;
+}
+
+// Snapshot is written to the temporary file first, so the interrupted update
+// never leaves the half written golden file.
+inline bool write_snapshot(std::string_view actual, const std::string& path)
+{
+	std::string tmp_path = path + ".tmp";
+	{
+		std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+		if (!out) return false;
+		out.write(actual.data(), actual.size());
+		if (!out) return false;
+	}
+	#ifdef _WIN32
+	return MoveFileExA(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+	#else
+	return std::rename(tmp_path.c_str(), path.c_str()) == 0;
+	#endif
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTSNAPSHOT_H
@@ -0,0 +1,305 @@
+#ifndef QTESTTHREADS_H
+#define QTESTTHREADS_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <algorithm>
+
+#include "qtestexpect.hpp"
+#include "qtestbench.hpp"
+#include "qtestalloc.hpp"
+
+#if defined(__linux__) && defined(__GLIBC__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifndef TEST_SCALING_TIME_MS
+#define TEST_SCALING_TIME_MS 50
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+struct ScalingPoint {
+	unsigned threads = 0;
+	uint64_t ops = 0;
+	double throughput = 0;
+	double efficiency = 0;
+};
+
+// Starts all of the threads at once: every thread announces it is ready and
+// spins until the start flag, so the thread creation is not measured.
+class SpinBarrier
+{
+	public:
+		void arrive() { ready.fetch_add(1, std::memory_order_acq_rel); }
+		void wait_start() { while (!started.load(std::memory_order_acquire)) std::this_thread::yield(); }
+		void start(unsigned threads);
+
+	private:
+		std::atomic<unsigned> ready{0};
+		std::atomic<bool> started{false};
+};
+
+// The failure of the EXPECT called from the thread other than the test one.
+// Every thread checks into its own node, so the passing check takes no lock.
+struct ThreadFailure {
+	ThreadFailure* next = nullptr;
+	std::thread::id thread;
+	std::string_view expect_str;
+	ErrorReport error;
+	bool result = true;
+};
+
+// The node of the thread is pushed to the lock-free list at its first EXPECT
+// in the test, and the list is taken by the test thread at the end of the test.
+// The nodes of the previous tests are told apart by the generation. The taken
+// nodes live until the next take, so a thread that still checks after its test
+// ended writes into the live node during the next test. Threads that outlive
+// two tests are not supported.
+class ThreadFailures
+{
+	public:
+		~ThreadFailures() { take(); }
+		ThreadFailure& node();
+		std::vector<ThreadFailure*> take();
+
+	private:
+		std::atomic<ThreadFailure*> head{nullptr};
+		std::atomic<unsigned> generation{1};
+		std::vector<std::unique_ptr<ThreadFailure>> retired;
+};
+
+inline thread_local ThreadFailure* thread_failure = nullptr;
+inline thread_local unsigned thread_failure_generation = 0;
+
+// Durations are in nanoseconds. The iterations are summed over the threads.
+struct StressStats {
+	unsigned threads = 0;
+	uint64_t iterations = 0;
+	double duration = 0;
+	double throughput = 0;
+	unsigned failed_threads = 0;
+};
+
+inline thread_local unsigned stress_thread = 0;
+
+class QTestScaling
+{
+	public:
+		QTestScaling(std::vector<ScalingPoint>&& points, bool* result, ErrorReport* error)
+			: points(std::move(points)), result(result), error(error) {}
+		bool throughputToBeGreaterThan(double ops_per_second, unsigned threads);
+		bool efficiencyToBeGreaterThan(double efficiency, unsigned threads);
+
+		//Aliases
+		bool throughput_to_be_greater_than(double ops_per_second, unsigned threads) { return throughputToBeGreaterThan(ops_per_second, threads); }
+		bool efficiency_to_be_greater_than(double efficiency, unsigned threads) { return efficiencyToBeGreaterThan(efficiency, threads); }
+
+	private:
+		ScalingPoint* find(unsigned threads);
+		void report(std::string_view func, std::string value, std::string compare);
+
+		std::vector<ScalingPoint> points;
+		bool* result;
+		ErrorReport* error;
+};
+
+inline void SpinBarrier::start(unsigned threads)
+{
+	while (ready.load(std::memory_order_acquire) < threads) std::this_thread::yield();
+	started.store(true, std::memory_order_release);
+}
+
+inline ThreadFailure& ThreadFailures::node()
+{
+	unsigned current = generation.load(std::memory_order_acquire);
+	if (thread_failure_generation != current) {
+		AllocationPause pause;
+		thread_failure = new ThreadFailure();
+		thread_failure->thread = std::this_thread::get_id();
+		thread_failure_generation = current;
+		ThreadFailure* next = head.load(std::memory_order_relaxed);
+		do {
+			thread_failure->next = next;
+		} while (!head.compare_exchange_weak(next, thread_failure, std::memory_order_release, std::memory_order_relaxed));
+	}
+	return *thread_failure;
+}
+
+// Returns the nodes in the order the threads made their first EXPECT.
+inline std::vector<ThreadFailure*> ThreadFailures::take()
+{
+	std::vector<ThreadFailure*> res;
+	// The generation goes first: the thread that checks in between gets the
+	// new node, which is still pushed to the list taken here.
+	generation.fetch_add(1, std::memory_order_acq_rel);
+	ThreadFailure* node = head.exchange(nullptr, std::memory_order_acquire);
+	AllocationPause pause;
+	retired.clear();
+	if (!node) return res;
+	for (;node;node=node->next) {
+		res.push_back(node);
+		retired.emplace_back(node);
+	}
+	std::reverse(res.begin(), res.end());
+	return res;
+}
+
+// Pins the thread to the allowed CPU of its index, if TEST_STRESS_PIN is
+// defined (Linux only).
+inline void pin_stress_thread(unsigned index)
+{
+	#if defined(TEST_STRESS_PIN) && defined(__linux__) && defined(__GLIBC__)
+	cpu_set_t allowed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || !CPU_COUNT(&allowed)) return;
+	unsigned n = index % CPU_COUNT(&allowed);
+	for (int cpu=0;cpu<CPU_SETSIZE;cpu++) {
+		if (!CPU_ISSET(cpu, &allowed) || n--) continue;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		return;
+	}
+	#else
+	(void)index;
+	#endif
+}
+
+inline std::string generate_stress_text(StressStats& stats)
+{
+	std::string res = "stress " + std::to_string(stats.threads) + " threads, " + std::to_string(stats.iterations) + " iterations in "
+		+ format_duration(stats.duration) + ", " + format_rate(stats.throughput, " ops/s");
+	if (stats.failed_threads) res += ", " + std::to_string(stats.failed_threads) + (stats.failed_threads == 1 ? " thread" : " threads") + " failed";
+	return res;
+}
+
+inline std::vector<unsigned> scaling_thread_counts(unsigned max_threads)
+{
+	std::vector<unsigned> counts;
+	for (unsigned t=1;t<max_threads;t*=2) {
+		counts.push_back(t);
+	}
+	counts.push_back(std::max(1u, max_threads));
+	return counts;
+}
+
+// Every thread counts its operations locally, so the measurement itself
+// doesn't add the contention to the body.
+template<typename F>
+ScalingPoint measure_throughput(F& fn, unsigned threads)
+{
+	using clock = std::chrono::steady_clock;
+	AllocationPause pause;
+	SpinBarrier barrier;
+	std::atomic<bool> stop{false};
+	std::vector<uint64_t> ops(threads, 0);
+	std::vector<std::thread> workers;
+	workers.reserve(threads);
+	for (unsigned t=0;t<threads;t++) {
+		workers.emplace_back([&, t]{
+			AllocationPause pause;
+			barrier.arrive();
+			barrier.wait_start();
+			uint64_t count = 0;
+			while (!stop.load(std::memory_order_relaxed)) {
+				fn(t);
+				count++;
+			}
+			ops[t] = count;
+		});
+	}
+	barrier.start(threads);
+	auto start = clock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(TEST_SCALING_TIME_MS));
+	stop.store(true, std::memory_order_relaxed);
+	for (auto& w : workers) {
+		w.join();
+	}
+	double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+	ScalingPoint point;
+	point.threads = threads;
+	for (uint64_t n : ops) {
+		point.ops += n;
+	}
+	point.throughput = seconds > 0 ? point.ops / seconds : 0;
+	return point;
+}
+
+template<typename F>
+std::vector<ScalingPoint> measure_scaling(F& fn, unsigned max_threads)
+{
+	std::vector<ScalingPoint> points;
+	for (unsigned threads : scaling_thread_counts(max_threads)) {
+		points.push_back(measure_throughput(fn, threads));
+		double single = points.front().throughput;
+		points.back().efficiency = single > 0 ? points.back().throughput / (single * threads) : 0;
+	}
+	return points;
+}
+
+inline std::string generate_scaling_table(std::vector<ScalingPoint>& points)
+{
+	char buf[128];
+	std::string res = "threads        throughput   speedup   efficiency";
+	for (auto& p : points) {
+		std::snprintf(buf, sizeof(buf), "\n%7u  %16s  %7.2fx  %10.1f%%", p.threads, format_rate(p.throughput, " ops/s").c_str(), p.efficiency * p.threads, p.efficiency * 100);
+		res += buf;
+	}
+	return res;
+}
+
+inline ScalingPoint* QTestScaling::find(unsigned threads)
+{
+	for (auto& p : points) {
+		if (p.threads == threads) return &p;
+	}
+	return nullptr;
+}
+
+inline void QTestScaling::report(std::string_view func, std::string value, std::string compare)
+{
+	error->func = func;
+	error->value = value;
+	error->compare = compare;
+	error->has_compare = true;
+	error->value_substituted = true;
+	error->compare_substituted = true;
+}
+
+inline bool QTestScaling::throughputToBeGreaterThan(double ops_per_second, unsigned threads)
+{
+	ScalingPoint* point = find(threads);
+	if (!(*result &= point && point->throughput > ops_per_second)) {
+		AllocationPause pause;
+		report(__func__, point ? format_rate(point->throughput, " ops/s") : "not measured", format_rate(ops_per_second, " ops/s") + ", " + std::to_string(threads));
+	}
+	return *result;
+}
+
+inline bool QTestScaling::efficiencyToBeGreaterThan(double efficiency, unsigned threads)
+{
+	ScalingPoint* point = find(threads);
+	if (!(*result &= point && point->efficiency > efficiency)) {
+		AllocationPause pause;
+		char buf[32];
+		std::snprintf(buf, sizeof(buf), "%.2f", point ? point->efficiency : 0);
+		std::string value = point ? buf : "not measured";
+		std::snprintf(buf, sizeof(buf), "%.2f, %u", efficiency, threads);
+		report(__func__, value, buf);
+	}
+	return *result;
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTTHREADS_H
@@ -0,0 +1,148 @@
+#ifndef QTESTTRACE_H
+#define QTESTTRACE_H
+
+#include <string>
+#include <string_view>
+#include <fstream>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <cstdio>
+
+#include "qtestalloc.hpp"
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Q_TEST_NS_DETAIL {
+
+// Streams the Chrome trace event format (opened by Perfetto and
+// chrome://tracing). Every span is written and flushed as the complete ("X")
+// event as soon as it ends, so the trace of the crashed run is still readable
+// without the closing bracket.
+class QTestTrace
+{
+	using clock = std::chrono::steady_clock;
+
+	public:
+		QTestTrace(std::string path);
+		~QTestTrace();
+		QTestTrace(const QTestTrace&) = delete;
+		QTestTrace& operator=(const QTestTrace&) = delete;
+
+		clock::time_point now() { return clock::now(); }
+		void complete(std::string_view name, std::string_view cat, clock::time_point start, clock::time_point end);
+
+	private:
+		void write(const std::string& event);
+		unsigned thread_id();
+		double timestamp(clock::time_point t) { return std::chrono::duration<double, std::micro>(t - origin).count(); }
+
+		std::ofstream out;
+		std::mutex mtx;
+		clock::time_point origin = clock::now();
+		std::atomic<unsigned> threads{0};
+		int pid = 0;
+		bool first = true;
+};
+
+inline QTestTrace* trace = nullptr;
+
+// The span of the code scope. Does nothing if the trace is not written.
+// The category must be the string literal.
+class TraceSpan
+{
+	public:
+		TraceSpan(std::string_view name, std::string_view cat = "user");
+		~TraceSpan();
+		TraceSpan(const TraceSpan&) = delete;
+		TraceSpan& operator=(const TraceSpan&) = delete;
+
+	private:
+		std::string name;
+		std::string_view cat;
+		std::chrono::steady_clock::time_point start;
+};
+
+inline std::string json_escape(std::string_view str)
+{
+	std::string res;
+	for (char c : str) {
+		switch (c) {
+			case '"': res += "\\\""; break;
+			case '\\': res += "\\\\"; break;
+			case '\n': res += "\\n"; break;
+			case '\t': res += "\\t"; break;
+			default:
+				if ((unsigned char)c < 0x20) {
+					char buf[8];
+					std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+					res += buf;
+				} else {
+					res.push_back(c);
+				}
+		}
+	}
+	return res;
+}
+
+inline QTestTrace::QTestTrace(std::string path) : out(path, std::ios::trunc)
+{
+	#ifdef _WIN32
+	pid = _getpid();
+	#else
+	pid = getpid();
+	#endif
+	out << "[";
+	write("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + std::to_string(pid) + ",\"tid\":" + std::to_string(thread_id()) + ",\"args\":{\"name\":\"QTest\"}}");
+}
+
+inline QTestTrace::~QTestTrace()
+{
+	out << "\n]\n";
+}
+
+// Threads are numbered in the order of their first span, so the lanes are
+// stable between the runs.
+inline unsigned QTestTrace::thread_id()
+{
+	thread_local unsigned id = ++threads;
+	return id;
+}
+
+inline void QTestTrace::write(const std::string& event)
+{
+	std::lock_guard<std::mutex> lock(mtx);
+	out << (first ? "\n" : ",\n") << event;
+	out.flush();
+	first = false;
+}
+
+inline void QTestTrace::complete(std::string_view name, std::string_view cat, clock::time_point start, clock::time_point end)
+{
+	AllocationPause pause;
+	char times[96];
+	std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", timestamp(start), timestamp(end) - timestamp(start));
+	write("{\"name\":\"" + json_escape(name) + "\",\"cat\":\"" + std::string(cat) + "\",\"ph\":\"X\"," + times
+		+ ",\"pid\":" + std::to_string(pid) + ",\"tid\":" + std::to_string(thread_id()) + "}");
+}
+
+inline TraceSpan::TraceSpan(std::string_view name, std::string_view cat) : cat(cat)
+{
+	if (!trace) return;
+	AllocationPause pause;
+	this->name = name;
+	start = trace->now();
+}
+
+inline TraceSpan::~TraceSpan()
+{
+	if (trace) trace->complete(name, cat, start, trace->now());
+}
+
+} // Q_TEST_NS_DETAIL
+
+#endif // QTESTTRACE_H
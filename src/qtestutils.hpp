@@ -2,6 +2,8 @@
 #define QTESTUTILS_H
 
 #include <functional>
+#include <string>
+#include <string_view>
 
 #define QTEST_TEST_PARAM_ID 0
 #define QTEST_ONLY_PARAM_ID 1
@@ -16,11 +18,60 @@
 #define Q_TEST__UNIQ_NAME() Q_TEST__UNIQ_NAME_GENERATE(Q___TEST___U_N_I_Q___)
 #define Q_TEST__LAMBDA(...) [Q_TEST__SCOPE]()__VA_ARGS__
 #define Q_TEST__LAMBDA_CALLBACK(...) [Q_TEST__SCOPE](auto callback){ do __VA_ARGS__ while((callback(), false)); }
+#define Q_TEST__TYPED_LAMBDA_CALLBACK(...) [Q_TEST__SCOPE](auto type_tag, auto callback){ using TypeParam [[maybe_unused]] = typename decltype(type_tag)::type; do __VA_ARGS__ while((callback(), false)); }
 #define Q_TEST__TEST_UNIT inline static Q_TEST_NS_DETAIL::QTestScenario Q_TEST__UNIQ_NAME()
 #define Q_TEST__RETURN_IF_FALSE(...) for (int _some_val_=1,_result_val_=1;;) if (!_some_val_--) { if (!_result_val_) return; break; } else _result_val_ = __VA_ARGS__
 
 namespace Q_TEST_NS_DETAIL {
 	struct QTestScenario { QTestScenario(std::function<void()> fn) { fn(); } };
+
+	template<typename... Ts> struct TypeList {};
+	template<typename T> struct TypeTag { using type = T; };
+
+	template<typename T>
+	inline std::string type_name()
+	{
+		#ifdef _MSC_VER
+		std::string_view name = __FUNCSIG__;
+		size_t from = name.find("type_name<") + 10;
+		size_t to = name.rfind(">(void)");
+		#else
+		std::string_view name = __PRETTY_FUNCTION__;
+		size_t from = name.find("T = ") + 4;
+		// GCC lists the other template aliases after "; ", the array types end
+		// with "]" themselves, so only the last bracket closes the signature.
+		size_t to = name.find(';', from);
+		if (to == std::string_view::npos) to = name.rfind(']');
+		#endif
+		return std::string(name.substr(from, to - from));
+	}
+
+	inline std::string sanitize(std::string& value)
+	{
+		std::string str;
+		for (char c : value) {
+			switch(c) {
+				case '\n':
+					str.append("\\n");
+					break;
+				case '\r':
+					str.append("\\r");
+					break;
+				case '\t':
+					str.append("\\t");
+					break;
+				case '\b':
+					str.append("\\b");
+					break;
+				case '\x1b':
+					str.append("\\x1b");
+					break;
+				default:
+					str.push_back(c);
+			}
+		}
+		return str;
+	}
 }
 
 #endif //QTESTUTILS_H
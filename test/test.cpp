@@ -1,14 +1,125 @@
 #include <iostream>
 #include <unistd.h>
+#include <signal.h>
 #include <list>
 #include <set>
 #include <unordered_set>
+#include <optional>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <filesystem>
 
 #define TEST_ONLY_RULE
+#define TEST_PERF_COUNTERS
+#define TEST_TRACK_ALLOCATIONS
+#define TEST_REALTIME_SAFETY
 #include "dist/qtest.hpp"
 
 using namespace std;
 
+constexpr int factorial(int n) { return n <= 1 ? 1 : n * factorial(n-1); }
+
+struct CountingReporter : QTest::Reporter {
+	void run_start() override { run_starts++; }
+	void describe_enter(std::string_view) override { depth++; }
+	void describe_leave(std::string_view) override { depth--; }
+	void test_result(const QTest::TestResult& result) override {
+		results++;
+		if (!result.passed) failed++;
+	}
+	int run_starts = 0;
+	int depth = 0;
+	int results = 0;
+	int failed = 0;
+};
+
+struct LastResultReporter : QTest::Reporter {
+	void test_result(const QTest::TestResult& result) override {
+		passed = result.passed;
+		expect = std::string(result.expect);
+		hint = result.error ? result.error->hint : "";
+		message = std::string(result.message);
+		allocations = result.allocations ? result.allocations->count : 0;
+		live_allocations = result.allocations ? result.allocations->live_count : 0;
+	}
+	bool passed = true;
+	std::string expect;
+	std::string hint;
+	std::string message;
+	uint64_t allocations = 0;
+	uint64_t live_allocations = 0;
+};
+
+// The path of the scratch file in the temp directory.
+std::string temp_path(const std::string& name)
+{
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+// Reads the whole scratch file and removes it.
+std::string take_file(const std::string& path)
+{
+	std::string res;
+	{
+		std::ifstream in(path);
+		res.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+	std::filesystem::remove(path);
+	return res;
+}
+
+// Writes one failed result with the given reporter and returns the report.
+template<typename R>
+std::string write_report(const QTest::TestResult& result)
+{
+	std::string path = temp_path("qtest_report.txt");
+	{
+		R reporter(path);
+		reporter.run_start();
+		reporter.describe_enter(result.suite);
+		reporter.test_result(result);
+		reporter.describe_leave(result.suite);
+		reporter.statistics({1, 1, 0, result.duration, 0});
+	}
+	return take_file(path);
+}
+
+// The function entered by the BEFORE_ALL of the impact test.
+void impact_fixture() {}
+
+// Records the function into the impact table, false if the recording is not available.
+bool record_impact(void* fn)
+{
+#ifdef Q_TEST__HAS_IMPACT
+	Q_TEST_NS_DETAIL::impact_record(fn);
+	return true;
+#else
+	(void)fn;
+	return false;
+#endif
+}
+
+// Records a test that overflows the impact table into the map, false if the recording is not available.
+bool record_impact_overflow(const std::string& map_path, const std::string& changed_path, const std::string& id)
+{
+#ifdef Q_TEST__HAS_IMPACT
+	Q_TEST_NS_DETAIL::QTestImpactMap map(map_path);
+	map.select(changed_path);
+	map.begin();
+	for (auto& slot : Q_TEST_NS_DETAIL::impact_slots) {
+		slot = &slot;
+	}
+	Q_TEST_NS_DETAIL::impact_record((void*)&factorial);
+	map.end(id);
+	map.save();
+	return true;
+#else
+	(void)map_path, (void)changed_path, (void)id;
+	return false;
+#endif
+}
+
 SCENARIO_START
 
 DESCRIBE_ONLY("[Test]", {
@@ -296,6 +407,966 @@ DESCRIBE_ONLY("[Test]", {
 		});
 	});
 
+	DESCRIBE("String matchers", {
+		std::string log;
+
+		BEFORE_ALL({
+			for (int i=0;i<10000;i++)
+				log += "[info] request " + std::to_string(i) + " served\n";
+			log += "[error] connection reset by peer\n";
+		});
+
+		IT("log should contain the error line", {
+			EXPECT(log).toContain("[error] connection reset");
+			EXPECT(log).NOT().toContain("[fatal]");
+		});
+
+		IT("log should start with info and end with a new line", {
+			EXPECT(log).toStartWith("[info] request 0");
+			EXPECT(log).toEndWith("peer\n");
+		});
+
+		IT("log should match the regex", {
+			EXPECT(log).toMatch("request [0-9]+ served");
+			EXPECT(log).NOT().toMatch("request -[0-9]+");
+		});
+
+		IT("vector should contain the item", {
+			EXPECT((vector<int>{1,2,3})).toContain(2);
+		});
+
+		IT("should fail with the nearest match", {
+			EXPECT(log).toContain("[error] connection refused");
+		});
+	});
+
+	DESCRIBE("toMatchSnapshot expect method", {
+		std::string report;
+
+		BEFORE_ALL({
+			for (int i=0;i<1000;i++)
+				report += "row " + std::to_string(i) + ": " + std::to_string(i*i) + "\n";
+		});
+
+		IT("report should match the golden file", {
+			EXPECT(report).toMatchSnapshot("test/snapshots/report.txt");
+		});
+
+		IT("should fail with the first differing line", {
+			std::string changed = report;
+			changed.replace(changed.find("row 500: "), 15, "row 500: 250001");
+			EXPECT(changed).toMatchSnapshot("test/snapshots/report.txt");
+		});
+	});
+
+	DESCRIBE("EXPECT_LATENCY", {
+		auto reporter = make_shared<LastResultReporter>();
+		ADD_REPORTER(reporter);
+		auto short_call = []{
+			int sum = 0;
+			for (int i=0;i<100;i++)
+				sum += i;
+			DO_NOT_OPTIMIZE(sum);
+		};
+
+		IT("short call should be fast at the median and the tail", {
+			EXPECT_LATENCY(short_call, 1000).p50ToBeLessThan(1ms);
+			EXPECT_LATENCY(short_call, 1000).percentileToBeLessThan(99.5, 10ms);
+		});
+
+		IT("should fail as the sleep is longer than 1us", {
+			EXPECT_LATENCY([]{ usleep(100); }, 20).p99ToBeLessThan(1us);
+		});
+
+		IT("should name the latency macro in the failure", {
+			EXPECT(reporter->message).toStartWith("EXPECT_LATENCY([]{ usleep(100); }, 20[=");
+		});
+	});
+
+	DESCRIBE("EXPECT_SCALING", {
+		std::atomic<uint64_t> shared_counter{0};
+		auto increment = [&](size_t){
+			shared_counter.fetch_add(1, std::memory_order_relaxed);
+		};
+
+		IT("atomic counter should be incremented on every thread count", {
+			EXPECT_SCALING(increment, 4).throughputToBeGreaterThan(1000, 1);
+			EXPECT_SCALING(increment, 4).throughputToBeGreaterThan(1000, 4);
+		});
+
+		IT("should fail as the efficiency can't be greater than 2", {
+			EXPECT_SCALING(increment, 2).efficiencyToBeGreaterThan(2.0, 2);
+		});
+	});
+
+	DESCRIBE("EXPECT from the threads", {
+		auto run_threads = [](int count, std::function<void(int)> fn) {
+			vector<std::thread> threads;
+			for (int t=0;t<count;t++) {
+				threads.emplace_back(fn, t);
+			}
+			for (auto& t : threads) {
+				t.join();
+			}
+		};
+
+		IT("every thread should check its own values", {
+			run_threads(4, [](int t) {
+				for (int i=0;i<10000;i++) {
+					EXPECT(i * t % 4 < 4).toBe(true);
+				}
+			});
+		});
+
+		IT("should fail as the third thread gets the wrong value", {
+			run_threads(4, [](int t) {
+				EXPECT(t).NOT().toBe(2);
+			});
+		});
+
+		IT("the thread checking after the take should get the new node", {
+			Q_TEST_NS_DETAIL::ThreadFailures failures;
+			std::atomic<int> step{0};
+			Q_TEST_NS_DETAIL::ThreadFailure* first = nullptr;
+			Q_TEST_NS_DETAIL::ThreadFailure* second = nullptr;
+			std::thread worker([&]{
+				first = &failures.node();
+				first->result = false;
+				step.store(1, std::memory_order_release);
+				while (step.load(std::memory_order_acquire) != 2) std::this_thread::yield();
+				second = &failures.node();
+			});
+			while (step.load(std::memory_order_acquire) != 1) std::this_thread::yield();
+			std::vector<Q_TEST_NS_DETAIL::ThreadFailure*> taken = failures.take();
+			step.store(2, std::memory_order_release);
+			worker.join();
+			EXPECT(taken.size()).toBe(1u);
+			EXPECT(taken[0] == first).toBe(true);
+			EXPECT(second != first).toBe(true);
+			EXPECT(first->result).toBe(false);
+			EXPECT(failures.take().size()).toBe(1u);
+		});
+	});
+
+	DESCRIBE("STRESS", {
+		IT("atomic counter should not lose the increments", {
+			std::atomic<int> counter{0};
+			STRESS(4, 10000, {
+				counter.fetch_add(1, std::memory_order_relaxed);
+			});
+			EXPECT(counter.load()).toBe(40000);
+		});
+
+		IT("every thread should read its own index for 20ms", {
+			vector<std::atomic<int>> slots(4);
+			STRESS(4, std::chrono::milliseconds(20), {
+				slots[STRESS_THREAD()].store((int)STRESS_THREAD(), std::memory_order_relaxed);
+				EXPECT(slots[STRESS_THREAD()].load()).toBe((int)STRESS_THREAD());
+			});
+		});
+
+		IT("should fail as the second thread checks the wrong index", {
+			STRESS(4, 1000, {
+				unsigned thread = STRESS_THREAD();
+				EXPECT(thread).NOT().toBe(1u);
+			});
+		});
+	});
+
+	DESCRIBE("Sampling profiler", {
+		IT("busy loop should be folded under the escaped test name", {
+			std::string path = temp_path("qtest_profile.folded");
+			size_t samples = 0;
+			{
+				Q_TEST_NS_DETAIL::QTestProfiler sampler(path);
+				if (!sampler.is_available()) {
+					INFO_PRINT("the profiler is not available");
+					TEST_SUCCEED();
+					return;
+				}
+				Q_TEST_NS_DETAIL::profiler = &sampler;
+				sampler.start();
+				auto start = std::chrono::steady_clock::now();
+				size_t sum = 0;
+				while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(50)) {
+					sum++;
+				}
+				DO_NOT_OPTIMIZE(sum);
+				sampler.stop();
+				Q_TEST_NS_DETAIL::profiler = nullptr;
+				samples = sampler.write("Profiler busy;loop\nIT");
+			}
+			std::string folded = take_file(path);
+			std::string line = folded.substr(0, folded.find('\n'));
+			EXPECT(samples).toBeGreaterThan(0u);
+			EXPECT(line).toStartWith("Profiler busy,loop,IT");
+			EXPECT(line).toMatch("^[^\\n]+ [0-9]+$");
+		});
+
+		IT("should put back the SIGPROF handler of the program", {
+			struct sigaction ignore = {}, restored = {};
+			ignore.sa_handler = SIG_IGN;
+			sigemptyset(&ignore.sa_mask);
+			sigaction(SIGPROF, &ignore, nullptr);
+			{
+				Q_TEST_NS_DETAIL::QTestProfiler sampler(temp_path("qtest_profile.folded"));
+			}
+			std::filesystem::remove(temp_path("qtest_profile.folded"));
+			sigaction(SIGPROF, nullptr, &restored);
+			signal(SIGPROF, SIG_DFL);
+			EXPECT(restored.sa_handler == SIG_IGN).toBe(true);
+		});
+
+		IT("should name the unknown address", {
+			EXPECT(Q_TEST_NS_DETAIL::address_symbol((void*)16)).toBe(std::string("??"));
+		});
+	});
+
+	DESCRIBE("PERF_COUNTERS", {
+		IT("short loop should execute less than a million instructions", {
+			auto counters = PERF_COUNTERS({
+				int sum = 0;
+				for (int i=0;i<1000;i++)
+					sum += i;
+				DO_NOT_OPTIMIZE(sum);
+			});
+			if (!counters.available) {
+				INFO_PRINT("hardware counters are not available");
+				TEST_SUCCEED();
+				return;
+			}
+			EXPECT(counters.instructions).toBeGreaterThan(1000);
+			EXPECT(counters.instructions).toBeLessThan(1000000);
+		});
+	});
+
+	DESCRIBE("TRACE_SPAN", {
+		IT("spans of two threads should be written to their own lanes", {
+			std::string path = temp_path("qtest_trace.json");
+			std::string events;
+			{
+				Q_TEST_NS_DETAIL::QTestTrace tracer(path);
+				Q_TEST_NS_DETAIL::trace = &tracer;
+				{
+					TRACE_SPAN("main \"span\"");
+				}
+				std::thread worker([]{
+					TRACE_SPAN(string("worker"));
+				});
+				worker.join();
+				Q_TEST_NS_DETAIL::trace = nullptr;
+				// Every event is flushed, so the file is read before the closing bracket
+				events = take_file(path);
+			}
+			EXPECT(events).toMatch("^\\[(\\n\\{[^\\n]*\\},?)+$");
+			std::smatch main_lane, worker_lane;
+			std::string lane = ",\"ph\":\"X\",\"ts\":[0-9.]+,\"dur\":[0-9.]+,\"pid\":[0-9]+,\"tid\":([0-9]+)\\}";
+			EXPECT(std::regex_search(events, main_lane, std::regex("\\{\"name\":\"main \\\\\"span\\\\\"\",\"cat\":\"user\"" + lane))).toBe(true);
+			EXPECT(std::regex_search(events, worker_lane, std::regex("\\{\"name\":\"worker\",\"cat\":\"user\"" + lane))).toBe(true);
+			EXPECT(worker_lane[1].str()).NOT().toBe(main_lane[1].str());
+		});
+	});
+
+	DESCRIBE("ADD_REPORTER", {
+		auto reporter = make_shared<CountingReporter>();
+		ADD_REPORTER(reporter);
+
+		IT("should be reported", {
+			TEST_SUCCEED();
+		});
+
+		IT("should see the result of the previous test", {
+			EXPECT(reporter->results).toBe(1);
+			EXPECT(reporter->failed).toBe(0);
+		});
+
+		DESCRIBE("nested", {
+			IT("should get the run start and the open describes", {
+				EXPECT(reporter->run_starts).toBe(1);
+				EXPECT(reporter->depth).toBe(3);
+			});
+		});
+	});
+
+	DESCRIBE("Test impact map", {
+		std::string map_path = temp_path("qtest_impact.map");
+		std::string changed_path = temp_path("qtest_changed.txt");
+
+		BEFORE_EACH({
+			std::ofstream map(map_path);
+			map << "test parser:10\n/repo/src/parser.cpp\tparse()\n"
+				<< "test lexer:20\n/repo/mysrc/parser.cpp\tlex()\n/repo/src/lexer.cpp\tlex()\n";
+			std::ofstream changed(changed_path);
+			changed << "src/parser.cpp\n";
+		});
+
+		AFTER_EACH({
+			std::filesystem::remove(map_path);
+			std::filesystem::remove(changed_path);
+		});
+
+		IT("should select the tests by the path suffix", {
+			Q_TEST_NS_DETAIL::QTestImpactMap map(map_path);
+			EXPECT(map.filtered("lexer:20")).toBe(false);
+			map.select(changed_path);
+			EXPECT(map.filtered("parser:10")).toBe(false);
+			EXPECT(map.filtered("lexer:20")).toBe(true);
+			EXPECT(map.filtered("new:30")).toBe(false);
+		});
+
+		IT("should never deselect the test that overflowed the table", {
+			if (record_impact_overflow(map_path, changed_path, "lexer:20")) {
+				Q_TEST_NS_DETAIL::QTestImpactMap saved(map_path);
+				saved.select(changed_path);
+				EXPECT(saved.filtered("lexer:20")).toBe(false);
+				EXPECT(saved.filtered("parser:10")).toBe(false);
+			} else {
+				INFO_PRINT("the impact recording is not available");
+				TEST_SUCCEED();
+			}
+		});
+	});
+
+	DESCRIBE("Impact of BEFORE_ALL", {
+		std::string map_path = temp_path("qtest_fixture.map");
+		bool recorded = false;
+		{
+			Q_TEST_NS_DETAIL::QTestImpactMap map(map_path);
+			Q_TEST_NS_DETAIL::impact = &map;
+			DESCRIBE("tests", {
+				BEFORE_ALL({
+					recorded = record_impact((void*)&impact_fixture);
+				});
+				IT("first", {
+					record_impact((void*)&factorial);
+				});
+				IT("second", {
+					record_impact((void*)&factorial);
+				});
+			});
+			Q_TEST_NS_DETAIL::impact = nullptr;
+			map.save();
+		}
+
+		IT("should add the BEFORE_ALL functions to every test of the describe", {
+			std::string saved = take_file(map_path);
+			if (!recorded) {
+				INFO_PRINT("the impact recording is not available");
+				TEST_SUCCEED();
+				return;
+			}
+			int fixtures = 0;
+			for (size_t pos=saved.find("\timpact_fixture()\n");pos!=std::string::npos;pos=saved.find("\timpact_fixture()\n", pos + 1)) {
+				fixtures++;
+			}
+			EXPECT(saved).toContain("tests first:");
+			EXPECT(saved).toContain("tests second:");
+			EXPECT(fixtures).toBe(2);
+		});
+	});
+
+	DESCRIBE("Failed tests state", {
+		IT("should defer the passed tests and drop the stale ids", {
+			using Q_TEST_NS_DETAIL::QTestRerunState;
+			std::string path = temp_path("qtest_failed.txt");
+			{
+				std::ofstream out(path);
+				out << "outer fails:11\nouter other:20\n";
+			}
+			QTestRerunState state(path);
+			state.set_pass(QTestRerunState::Pass::First);
+			EXPECT(state.filtered("outer passes:10")).toBe(false);
+			EXPECT(state.deferred("outer passes:10")).toBe(true);
+			EXPECT(state.filtered("outer fails:12")).toBe(false);
+			EXPECT(state.deferred("outer fails:12")).toBe(true);
+			EXPECT(state.has_matched()).toBe(false);
+			EXPECT(state.filtered("outer other:20")).toBe(false);
+			EXPECT(state.deferred("outer other:20")).toBe(false);
+			EXPECT(state.has_matched()).toBe(true);
+			state.set_pass(QTestRerunState::Pass::Failed);
+			EXPECT(state.filtered("outer passes:10")).toBe(true);
+			state.record("outer fails:12", false);
+			state.save();
+			EXPECT(take_file(path)).toBe(std::string("outer other:20\nouter fails:12\n"));
+		});
+	});
+
+	DESCRIBE("Failed-first order", {
+		using Q_TEST_NS_DETAIL::QTestRerunState;
+		std::string path = temp_path("qtest_order.txt");
+		vector<string> order;
+		// The id holds the line of the "failed last time" test below
+		std::ofstream(path) << Q_TEST_NS_DETAIL::rerun_test_id("[Test] Failed-first order tests ", "failed last time", __LINE__ + 15) << '\n';
+		QTestRerunState state(path);
+		state.set_pass(QTestRerunState::Pass::First);
+		Q_TEST_NS_DETAIL::rerun = &state;
+		DESCRIBE("tests", {
+			IT("passed last time", {
+				order.push_back("passed");
+				TEST_SUCCEED();
+			});
+			DESCRIBE("nested", {
+				IT("runs in place", {
+					order.push_back("nested");
+					TEST_SUCCEED();
+				});
+			});
+			IT("failed last time", {
+				order.push_back("failed");
+				TEST_SUCCEED();
+			});
+		});
+		Q_TEST_NS_DETAIL::rerun = nullptr;
+		std::filesystem::remove(path);
+
+		IT("should run the failed test first and the passed one at the end of the describe", {
+			EXPECT(order).toBeIterableEqual(vector<string>{"nested", "failed", "passed"});
+		});
+	});
+
+	DESCRIBE("Results journal", {
+		IT("should replay the records and drop the torn one", {
+			using Q_TEST_NS_DETAIL::QTestJournal;
+			std::string path = temp_path("qtest_results.journal");
+			Q_TEST_NS_DETAIL::JournalEntry entry;
+			{
+				QTestJournal journal(path, false);
+				journal.record("passed", true, 100);
+				journal.record("failed", false, 200);
+				journal.record("torn", true, 300);
+			}
+			std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+			{
+				QTestJournal journal(path, true);
+				EXPECT(journal.replay("passed", entry)).toBe(true);
+				EXPECT(entry.passed).toBe(true);
+				EXPECT(journal.replay("passed", entry)).toBe(false);
+				EXPECT(journal.replay("failed", entry)).toBe(true);
+				EXPECT(entry.passed).toBe(false);
+				EXPECT(entry.duration).toBe(200.0);
+				EXPECT(journal.replay("torn", entry)).toBe(false);
+				journal.record("resumed", true, 400);
+			}
+			QTestJournal journal(path, true);
+			std::filesystem::remove(path);
+			EXPECT(journal.replay("failed", entry)).toBe(true);
+			EXPECT(journal.replay("torn", entry)).toBe(false);
+			EXPECT(journal.replay("resumed", entry)).toBe(true);
+			EXPECT(entry.duration).toBe(400.0);
+		});
+	});
+
+	DESCRIBE("Resumed run", {
+		using Q_TEST_NS_DETAIL::QTestJournal;
+		std::string path = temp_path("qtest_resumed.journal");
+		{
+			QTestJournal interrupted(path, false);
+			interrupted.record("[Test] Resumed run tests passed before", true, 100);
+			interrupted.record("[Test] Resumed run tests should fail as it failed before the run was resumed", false, 200);
+		}
+		vector<string> ran;
+		auto reporter = make_shared<LastResultReporter>();
+		ADD_REPORTER(reporter);
+		{
+			QTestJournal resumed(path, true);
+			Q_TEST_NS_DETAIL::journal = &resumed;
+			DESCRIBE("tests", {
+				IT("passed before", {
+					ran.push_back("passed");
+				});
+				IT("not ran before", {
+					ran.push_back("new");
+					TEST_SUCCEED();
+				});
+				IT("should fail as it failed before the run was resumed", {
+					ran.push_back("failed");
+				});
+			});
+			Q_TEST_NS_DETAIL::journal = nullptr;
+		}
+
+		IT("should fail the replayed test with the hint", {
+			EXPECT(reporter->expect).toBe(std::string("journaled result"));
+			EXPECT(reporter->hint).toBe(std::string("the test failed before the run was resumed"));
+		});
+
+		IT("should run only the test missing from the journal", {
+			EXPECT(ran).toBeIterableEqual(vector<string>{"new"});
+		});
+
+		IT("should record only the test that ran", {
+			Q_TEST_NS_DETAIL::JournalEntry entry;
+			QTestJournal journal(path, true);
+			std::filesystem::remove(path);
+			EXPECT(journal.replay("[Test] Resumed run tests passed before", entry)).toBe(true);
+			EXPECT(journal.replay("[Test] Resumed run tests passed before", entry)).toBe(false);
+			EXPECT(journal.replay("[Test] Resumed run tests should fail as it failed before the run was resumed", entry)).toBe(true);
+			EXPECT(journal.replay("[Test] Resumed run tests should fail as it failed before the run was resumed", entry)).toBe(false);
+			EXPECT(journal.replay("[Test] Resumed run tests not ran before", entry)).toBe(true);
+		});
+	});
+
+	DESCRIBE("Metrics", {
+		IT("should write the families, the cumulative buckets and the EOF", {
+			std::string path = temp_path("qtest_metrics.prom");
+			Q_TEST_NS_DETAIL::AllocationStats allocations;
+			allocations.count = 3;
+			{
+				Q_TEST_NS_DETAIL::QTestMetricsReporter reporter(path);
+				QTest::TestResult result;
+				result.suite = "rows";
+				result.name = "same name";
+				result.allocations = &allocations;
+				reporter.describe_enter("rows");
+				for (int line : {10, 11}) {
+					result.line = line;
+					result.duration = line == 10 ? 5e4 : 5e6;
+					reporter.test_result(result);
+				}
+				reporter.describe_leave("rows");
+				reporter.statistics({2, 0, 0, 1e7, 0});
+			}
+			std::string metrics = take_file(path);
+			EXPECT(metrics).toStartWith("# TYPE qtest_tests gauge\n# HELP qtest_tests Tests of the last run by status.\nqtest_tests{status=\"passed\"} 2\n");
+			EXPECT(metrics).toContain("qtest_test_duration_seconds_bucket{le=\"0.0001\"} 1\nqtest_test_duration_seconds_bucket{le=\"0.001\"} 1\n"
+				"qtest_test_duration_seconds_bucket{le=\"0.01\"} 2\n");
+			EXPECT(metrics).toContain("qtest_test_duration_seconds_bucket{le=\"+Inf\"} 2\nqtest_test_duration_seconds_sum 0.00505\nqtest_test_duration_seconds_count 2\n");
+			EXPECT(metrics).toContain("# TYPE qtest_test_allocations gauge\n# HELP qtest_test_allocations Allocations made by the test.\n"
+				"qtest_test_allocations{describe=\"rows\",test=\"same name\",line=\"10\",occurrence=\"0\"} 3\n"
+				"qtest_test_allocations{describe=\"rows\",test=\"same name\",line=\"11\",occurrence=\"0\"} 3\n");
+			EXPECT(metrics).toEndWith("# EOF\n");
+		});
+
+		IT("should number the IT_EACH rows with the same name", {
+			std::string path = temp_path("qtest_metrics.prom");
+			Q_TEST_NS_DETAIL::AllocationStats allocations;
+			{
+				Q_TEST_NS_DETAIL::QTestMetricsReporter reporter(path);
+				QTest::TestResult result;
+				result.suite = "d";
+				result.line = 7;
+				result.allocations = &allocations;
+				for (int row : {1, 1, 2}) {
+					result.name = "row " + std::to_string(row);
+					reporter.test_result(result);
+				}
+				reporter.statistics({3, 0, 0, 1e7, 0});
+			}
+			std::string metrics = take_file(path);
+			EXPECT(metrics).toContain("qtest_test_allocations{describe=\"d\",test=\"row 1\",line=\"7\",occurrence=\"0\"} 0\n"
+				"qtest_test_allocations{describe=\"d\",test=\"row 1\",line=\"7\",occurrence=\"1\"} 0\n"
+				"qtest_test_allocations{describe=\"d\",test=\"row 2\",line=\"7\",occurrence=\"0\"} 0\n");
+		});
+	});
+
+	DESCRIBE("Report escaping", {
+		std::string name = "a<b&\"c\"#d\ne";
+		Q_TEST_NS_DETAIL::ErrorReport error;
+		error.func = "toBe";
+		error.hint = "first\nsecond";
+		QTest::TestResult result;
+		result.suite = "suite <&\"#";
+		result.name = name;
+		result.file = "test.cpp";
+		result.line = 7;
+		result.passed = false;
+		result.duration = 1000;
+		result.expect = "x";
+		result.error = &error;
+		result.message = "EXPECT(x) FAILED!";
+
+		IT("escapers should keep the names in their formats", {
+			EXPECT(Q_TEST_NS_DETAIL::xml_escape(name + "\x01")).toBe(std::string("a&lt;b&amp;&quot;c&quot;#d\ne?"));
+			EXPECT(Q_TEST_NS_DETAIL::json_escape(name + "\x01")).toBe(std::string("a<b&\\\"c\\\"#d\\ne\\u0001"));
+			EXPECT(Q_TEST_NS_DETAIL::tap_escape(name + "\\")).toBe(std::string("a<b&\"c\"\\#d e\\\\"));
+		});
+
+		IT("JUnit report should escape the attributes", {
+			std::string report = write_report<Q_TEST_NS_DETAIL::QTestJUnitReporter>(result);
+			EXPECT(report).toContain("classname=\"suite &lt;&amp;&quot;#\" name=\"a&lt;b&amp;&quot;c&quot;#d\ne\"");
+			EXPECT(report).toContain("<failure message=\"EXPECT(x) FAILED!\" type=\"toBe\">first\nsecond</failure>");
+			EXPECT(report).toEndWith("</testsuite>\n</testsuites>\n");
+		});
+
+		IT("JSON Lines report should keep every event on its line", {
+			std::string report = write_report<Q_TEST_NS_DETAIL::QTestJsonReporter>(result);
+			EXPECT(report).toContain("\"name\":\"a<b&\\\"c\\\"#d\\ne\"");
+			EXPECT(report).toContain("\"hint\":\"first\\nsecond\"");
+			EXPECT(report).toMatch("^(\\{[^\\n]*\\}\\n){5}$");
+		});
+
+		IT("TAP report should escape the directive and the line breaks", {
+			std::string report = write_report<Q_TEST_NS_DETAIL::QTestTapReporter>(result);
+			EXPECT(report).toContain("not ok 1 - suite <&\"\\# a<b&\"c\"\\#d e\n");
+			EXPECT(report).toContain("  hint: \"first\\nsecond\"\n");
+			EXPECT(report).toEndWith("1..1\n");
+		});
+	});
+
+	DESCRIBE("RESOURCE_USAGE", {
+		IT("touching the fresh memory should cause the minor page faults", {
+			auto usage = RESOURCE_USAGE({
+				vector<char> pages(1 << 22, 1);
+				DO_NOT_OPTIMIZE(pages);
+			});
+			if (!usage.available) {
+				INFO_PRINT("resource usage is not available");
+				TEST_SUCCEED();
+				return;
+			}
+			EXPECT(usage.minor_faults).toBeGreaterThan(0u);
+		});
+	});
+
+	DESCRIBE("Allocations tracking", {
+		vector<int>* fixture = nullptr;
+
+		BEFORE_EACH({
+			fixture = new vector<int>(100);
+		});
+
+		AFTER_EACH({
+			delete fixture;
+		});
+
+		IT("should count the allocations of the test", {
+			vector<int> v(1000);
+			string s(100, 'a');
+			EXPECT((int)v.size()).toBe(1000);
+		});
+
+		IT("should show the memory that is not released", {
+			int* leaked = new int[16];
+			DO_NOT_OPTIMIZE(leaked);
+			TEST_SUCCEED();
+		});
+	});
+
+	DESCRIBE("Allocations of the failed checks", {
+		auto reporter = make_shared<LastResultReporter>();
+		ADD_REPORTER(reporter);
+
+		BEFORE_ALL({
+			Q_TEST_NS_DETAIL::fail_on_leaks = true;
+		});
+
+		AFTER_ALL({
+			Q_TEST_NS_DETAIL::fail_on_leaks = false;
+		});
+
+		IT("should fail as the test leaks", {
+			DO_NOT_OPTIMIZE(new int[16]);
+		});
+
+		IT("should see the leak failure", {
+			EXPECT(reporter->passed).toBe(false);
+			EXPECT(reporter->expect).toBe(std::string("not released allocations"));
+		});
+
+		IT("should fail and leak", {
+			DO_NOT_OPTIMIZE(new int[16]);
+			TEST_FAILED();
+		});
+
+		IT("should report the leak of the failed test with its own error", {
+			EXPECT(reporter->live_allocations).toBe(1u);
+			EXPECT(reporter->expect).NOT().toBe(std::string("not released allocations"));
+		});
+
+		IT("should fail with the message longer than the short string", {
+			TEST_FAILED("the message that does not fit into the short string buffer");
+		});
+
+		IT("should not count the report of the failed check", {
+			EXPECT(reporter->passed).toBe(false);
+			EXPECT(reporter->allocations).toBe(0u);
+		});
+
+		IT("should fail to compare the strings", {
+			EXPECT(std::string_view("the value that does not fit into the short string buffer")).toContain("missing");
+		});
+
+		IT("should not count the report of the failed matcher", {
+			EXPECT(reporter->passed).toBe(false);
+			EXPECT(reporter->allocations).toBe(0u);
+		});
+
+		IT("should print the chained info", {
+			INFO_PRINT() << "chained " << 123 << " info";
+		});
+
+		IT("should not count the chained info", {
+			EXPECT(reporter->passed).toBe(true);
+			EXPECT(reporter->allocations).toBe(0u);
+		});
+	});
+
+	DESCRIBE("Realtime safety", {
+		vector<int> buffer(1024, 1);
+
+		IT("summing the preallocated buffer should be realtime safe", {
+			long long sum = 0;
+			EXPECT_REALTIME_SAFE({
+				for (int v : buffer) sum += v;
+			});
+			EXPECT(sum).toBe(1024);
+		});
+
+		IT("should fail as push_back allocates", {
+			vector<int> values;
+			EXPECT_REALTIME_SAFE({
+				values.push_back(1);
+			});
+		});
+
+		IT("should fail as the mutex is locked", {
+			std::mutex mtx;
+			EXPECT_REALTIME_SAFE({
+				std::lock_guard<std::mutex> lock(mtx);
+			});
+		});
+	});
+
+	DESCRIBE("EXPECT_LOCK_CONTENTION", {
+		IT("single thread should never wait for the mutex", {
+			std::mutex mtx;
+			int counter = 0;
+			EXPECT_LOCK_CONTENTION({
+				for (int i=0;i<1000;i++) {
+					std::lock_guard<std::mutex> lock(mtx);
+					counter++;
+				}
+			}).contendedToBeLessThan(1);
+			EXPECT(counter).toBe(1000);
+		});
+
+		IT("should fail as the other thread holds the mutex", {
+			std::mutex mtx;
+			std::atomic<bool> locked = false;
+			EXPECT_LOCK_CONTENTION({
+				std::thread holder([&]{
+					std::lock_guard<std::mutex> lock(mtx);
+					locked = true;
+					usleep(2000);
+				});
+				while (!locked) std::this_thread::yield();
+				mtx.lock();
+				mtx.unlock();
+				holder.join();
+			}).waitToBeLessThan(100us);
+		});
+	});
+
+	DESCRIBE("toScaleAs expect method", {
+		auto linear = [](size_t n){
+			vector<int> v(n, 1);
+			DO_NOT_OPTIMIZE(v);
+		};
+		auto quadratic = [](size_t n){
+			size_t sum = 0;
+			for (size_t i=0;i<n;i++)
+				for (size_t j=0;j<n;j++)
+					sum += i ^ j;
+			DO_NOT_OPTIMIZE(sum);
+		};
+
+		IT("vector construction should scale linearly", {
+			EXPECT(linear).toScaleAs(QTest::N);
+		});
+
+		IT("nested loops should scale quadratically", {
+			EXPECT(quadratic).toScaleAs(QTest::N2);
+			EXPECT(quadratic).NOT().toScaleAs(QTest::N);
+		});
+
+		IT("should fail as nested loops are not linear", {
+			EXPECT(quadratic).toScaleAs(QTest::N);
+		});
+
+		IT("should fail as only two sizes fit into the budget", {
+			EXPECT([](size_t){
+				std::this_thread::sleep_for(std::chrono::milliseconds(30));
+			}).NOT().toScaleAs(QTest::N);
+		});
+	});
+
+	DESCRIBE("Compile-time tests", {
+		constexpr int base = 5;
+
+		STATIC_IT("factorial should be evaluated by the compiler", {
+			CONSTEXPR_EXPECT(factorial(0) == 1);
+			CONSTEXPR_EXPECT(factorial(base) == 120);
+		});
+
+		STATIC_IT("type traits should be checked by the compiler", {
+			CONSTEXPR_EXPECT(std::is_same_v<decltype(base), const int>);
+		});
+
+		STATIC_IT_SKIP("should be skipped", {
+			CONSTEXPR_EXPECT(sizeof(char) == 1);
+		});
+	});
+
+	DESCRIBE_TYPES("Typed vector", TYPE_LIST(int, double, std::string), {
+		vector<TypeParam> vec;
+
+		BEFORE_EACH({
+			vec.assign(3, TypeParam{});
+		});
+
+		IT("should contain 3 default values", {
+			EXPECT((int)vec.size()).toBe(3);
+			EXPECT(vec[0]).toBe(TypeParam{});
+		});
+
+		IT("should grow after push_back", {
+			vec.push_back(TypeParam{});
+			EXPECT((int)vec.size()).toBe(4);
+		});
+	});
+
+	DESCRIBE_TYPES("Typed arrays", TYPE_LIST(int[3], std::array<int, 3>), {
+		IT("should keep the whole type in the name", {
+			std::string name = Q_TEST_NS_DETAIL::type_name<TypeParam>();
+			EXPECT(name).toMatch(".*int.*3.*");
+			EXPECT(name).toEndWith(std::is_array_v<TypeParam> ? "[3]" : "3>");
+		});
+	});
+
+	DESCRIBE("Table-driven tests", {
+		vector<int> evens{2, 4, 8, 16};
+		int calls = 0;
+
+		BEFORE_EACH({
+			calls++;
+		});
+
+		IT_EACH(evens, "{} should be even", [](int& row){
+			EXPECT(row % 2).toBe(0);
+		});
+
+		IT("BEFORE_EACH should be called for every row", {
+			EXPECT(calls).toBe(5);
+		});
+
+		int next = 0;
+		auto squares = [&]() -> std::optional<int> {
+			if (next == 3) return std::nullopt;
+			++next;
+			return next * next;
+		};
+
+		IT_EACH(squares, "square {} should be positive", [](int& row){
+			EXPECT(row).toBeGreaterThan(0);
+		});
+
+		IT_EACH((vector<string>{"a", "bb"}), "length of `{}` should be less than 2", [](string& row){
+			EXPECT((int)row.size()).toBeLessThan(2);
+		});
+	});
+
+	DESCRIBE("Benchmarks", {
+		vector<int> data;
+		int prepared = 0;
+
+		BEFORE_ALL({
+			for (int i=0;i<4096;i++)
+				data.push_back(i);
+		});
+
+		BEFORE_EACH({
+			prepared++;
+		});
+
+		BENCHMARK("sum of 4096 ints", {
+			long long sum = 0;
+			for (int v : data)
+				sum += v;
+			DO_NOT_OPTIMIZE(sum);
+			BENCHMARK_BYTES(data.size() * sizeof(int));
+			BENCHMARK_ITEMS(data.size());
+		});
+
+		BENCHMARK("vector push_back", {
+			vector<int> v;
+			v.push_back(42);
+			CLOBBER_MEMORY();
+		});
+
+		IT("BEFORE_EACH should be called once per benchmark", {
+			EXPECT(prepared).toBe(3);
+		});
+
+		DESCRIBE("Baseline", {
+			IT("should fail the median slower than the tolerance and the noise", {
+				std::string path = temp_path("qtest_baseline.txt");
+				{
+					std::ofstream out(path);
+					out << "1000 10 10 sum\n";
+				}
+				Q_TEST_NS_DETAIL::QTestBaseline store(path);
+				std::filesystem::remove(path);
+				Q_TEST_NS_DETAIL::BenchmarkStats stats;
+				stats.samples.resize(10);
+				stats.stddev = 10;
+				stats.median = 1050;
+				EXPECT(store.is_regression(*store.find("sum"), stats)).toBe(false);
+				stats.median = 1500;
+				EXPECT(store.is_regression(*store.find("sum"), stats)).toBe(true);
+				stats.stddev = 10000;
+				EXPECT(store.is_regression(*store.find("sum"), stats)).toBe(false);
+			});
+
+			IT("should create the missing baseline", {
+				std::string path = temp_path("qtest_baseline.txt");
+				std::filesystem::remove(path);
+				Q_TEST_NS_DETAIL::BenchmarkStats stats;
+				stats.median = 1000;
+				{
+					Q_TEST_NS_DETAIL::QTestBaseline store(path);
+					store.record("sum", stats);
+					store.save();
+				}
+				EXPECT(take_file(path)).toBe(std::string("1000 0 0 sum\n"));
+			});
+
+			IT("should not write the existing baseline", {
+				std::string path = temp_path("qtest_baseline.txt");
+				{
+					std::ofstream out(path);
+					out << "1000 10 10 sum\n";
+				}
+				Q_TEST_NS_DETAIL::BenchmarkStats stats;
+				stats.median = 2000;
+				{
+					Q_TEST_NS_DETAIL::QTestBaseline store(path);
+					store.record("sum", stats);
+					store.record("new", stats);
+					store.save();
+				}
+				EXPECT(take_file(path)).toBe(std::string("1000 10 10 sum\n"));
+			});
+
+			IT("tolerance should be printed rounded", {
+				EXPECT(Q_TEST_NS_DETAIL::format_percent(0.29)).toBe(std::string("29%"));
+				EXPECT(Q_TEST_NS_DETAIL::format_percent(0.125)).toBe(std::string("12.5%"));
+			});
+		});
+
+		DESCRIBE("Compare", {
+			auto sum_of = [&](size_t n){
+				long long sum = 0;
+				for (size_t i=0;i<n;i++)
+					sum += data[i];
+				DO_NOT_OPTIMIZE(sum);
+			};
+
+			BENCHMARK_COMPARE("summing 256 ints should be faster than 4096", [&]{ sum_of(4096); }, [&]{ sum_of(256); });
+
+			BENCHMARK_COMPARE("should fail as the candidate sums more ints", [&]{ sum_of(256); }, [&]{ sum_of(4096); });
+		});
+	});
+
 	DESCRIBE_SKIP("skip describe", {
 
 		BEFORE_ALL({